@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef COLUMNAR_RECORDING_H_
+#define COLUMNAR_RECORDING_H_
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ethercat_slave.h"
+#include "process_image.h"
+#include "recorder.h"
+
+/**
+ * A variable of a slave, stored as one column of a columnar recording
+ */
+struct ColumnInfo
+{
+    std::string name; // SLAVE_NUMBER.FIELD, as for kddv-extract
+    int slave_idx;
+    bool is_rx;
+    int field_idx;
+    FieldType type;
+    size_t block_offset; // offset of the column's values from the start of a block
+};
+
+/**
+ * Summary of a column within a block: the smallest and largest value, as
+ * uint64 for integer columns and as double for float columns (NaN is
+ * ignored), for integer columns the bitwise OR and AND of all values, i.e.
+ * the bits which are set in any and in every row, and for float columns the
+ * number of NaN values
+ */
+struct ColumnStats
+{
+    uint64_t min;
+    uint64_t max;
+    uint64_t bits_or;
+    uint64_t bits_and;
+    uint64_t nan_count;
+};
+
+/**
+ * Layout of a columnar recording (.kddv), in the byte order of the
+ * writer (little-endian on all supported platforms):
+ *  - header: "KDDVCOL2", the length of the schema (uint32) and the number
+ *    of rows per block (uint32)
+ *  - schema: JSON with the slaves (name, number, type and EEPROM ids) and
+ *    the columns (slave index, sensors or commands, field name, type, unit)
+ *  - blocks of BLOCK_ROWS rows, which all have the same size: the number
+ *    of rows (uint32), padding (uint32), the earliest and latest timestamp
+ *    (int64 microseconds since epoch), ColumnStats of each column, then the
+ *    timestamps (int64) and the values of each column in its field type.
+ *    Only the last block may have less than BLOCK_ROWS rows.
+ * The blocks and every column within a block are aligned to pages, so a
+ * reader which maps the file only reads the pages of the columns it uses.
+ */
+class ColumnarLayout
+{
+    public:
+        static const uint32_t BLOCK_ROWS = 4096;
+        static const size_t PAGE_ALIGNMENT = 4096;
+
+        void setColumns(const std::vector<ColumnInfo> &columns);
+        std::vector<ColumnInfo> columns;
+        size_t stats_offset;
+        size_t timestamps_offset;
+        size_t block_size;
+};
+
+/**
+ * Records process images as a columnar recording
+ */
+class ColumnarRecorder : public Recorder
+{
+    public:
+        ColumnarRecorder();
+        virtual ~ColumnarRecorder();
+        // owns the file, which must not be closed twice
+        ColumnarRecorder(const ColumnarRecorder&) = delete;
+        ColumnarRecorder& operator=(const ColumnarRecorder&) = delete;
+        /**
+         * Replaces the file if it exists
+         */
+        void open(const std::string &filename, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, std::string &error);
+        /**
+         * Writes the last block, even if it is not full
+         */
+        void close();
+        void record(const ProcessImage &image);
+        std::shared_ptr<ImageEncoder> createEncoder() const;
+        void recordEncoded(const std::string &output, uint64_t image_count);
+        uint64_t getRecordCount() const;
+        uint64_t getWriteErrors() const;
+
+    private:
+        FILE *file;
+        std::string filename;
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        ColumnarLayout layout;
+        std::vector<uint8_t> block;
+        uint32_t block_row_count;
+        uint64_t record_count;
+        uint64_t write_errors;
+        std::vector<const uint8_t*> rx_data;
+        std::vector<const uint8_t*> tx_data;
+        // offset of each column's field within the slave's RX or TX data
+        std::vector<size_t> field_offsets;
+
+        void addRow(int64_t timestamp_us);
+        void writeBlock();
+};
+
+/**
+ * Encodes images for ColumnarRecorder::recordEncoded: the timestamp (int64
+ * microseconds) followed by the RX and TX bytes of each slave
+ */
+class ColumnarRowEncoder : public ImageEncoder
+{
+    public:
+        ColumnarRowEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void startChunk();
+        void encode(const ProcessImage &image, std::string &output);
+
+    private:
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+};
+
+/**
+ * Reads a columnar recording through a memory mapping; the pointers it
+ * returns are valid until it is closed
+ */
+class ColumnarReader
+{
+    public:
+        ColumnarReader();
+        virtual ~ColumnarReader();
+        // owns the mapping, which must not be unmapped twice
+        ColumnarReader(const ColumnarReader&) = delete;
+        ColumnarReader& operator=(const ColumnarReader&) = delete;
+        void open(const std::string &filename, std::string &error);
+        void close();
+
+        const Json::Value& getSchema() const;
+        int getColumnCount() const;
+        const ColumnInfo& getColumn(int column_idx) const;
+        /**
+         * Index of the column with the name SLAVE_NUMBER.FIELD, or -1
+         */
+        int findColumn(const std::string &name) const;
+
+        int getBlockCount() const;
+        uint32_t getRowCount(int block_idx) const;
+        int64_t getStartTime(int block_idx) const;
+        int64_t getEndTime(int block_idx) const;
+        const ColumnStats& getStats(int block_idx, int column_idx) const;
+        const int64_t* getTimestamps(int block_idx) const;
+        const uint8_t* getColumnData(int block_idx, int column_idx) const;
+        double getValue(int block_idx, int column_idx, uint32_t row) const;
+
+    private:
+        const uint8_t *mapping;
+        size_t file_size;
+        Json::Value schema;
+        ColumnarLayout layout;
+        size_t data_offset;
+        int block_count;
+
+        const uint8_t* getBlock(int block_idx) const;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef DATA_BUS_H_
+#define DATA_BUS_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "process_image.h"
+
+typedef std::function<void(const ProcessImagePtr &)> DataCallback;
+
+enum OverflowPolicy
+{
+    DROP_OLDEST, // make room for the new image; the consumer always gets the most recent data
+    DROP_NEWEST // discard the new image; the consumer gets the queued images without gaps in between
+};
+
+struct SubscriberOptions
+{
+    SubscriberOptions() : max_rate(0.0), queue_size(1), overflow_policy(DROP_OLDEST) {}
+    double max_rate; // maximum number of images per second passed to the callback, 0 for no limit
+    size_t queue_size; // number of images which can wait for the callback
+    OverflowPolicy overflow_policy;
+};
+
+struct SubscriberStats
+{
+    std::string name;
+    uint64_t delivered;
+    uint64_t dropped;
+    size_t queued;
+    size_t queue_size;
+};
+
+/**
+ * Passes each process image to any number of subscribers. Every subscriber
+ * has its own queue and thread in which its callback is called, so a slow
+ * subscriber only drops its own images and does not delay the data source
+ * or the other subscribers. Images are shared, not copied.
+ */
+class DataBus
+{
+    public:
+        DataBus();
+        virtual ~DataBus();
+        /**
+         * Returns an ID for unsubscribe; the callback is called in a new thread
+         */
+        int subscribe(const std::string &name, const DataCallback &callback, const SubscriberOptions &options);
+        /**
+         * Delivers the images still queued and stops the subscriber's thread;
+         * must not be called from its callback
+         */
+        void unsubscribe(int id);
+        void publish(const ProcessImagePtr &image);
+        std::vector<SubscriberStats> getStats() const;
+
+    private:
+        struct Subscriber
+        {
+            int id;
+            std::string name;
+            DataCallback callback;
+            SubscriberOptions options;
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::deque<ProcessImagePtr> queue;
+            bool running;
+            uint64_t delivered;
+            uint64_t dropped;
+            std::thread thread;
+        };
+
+        mutable std::mutex subscribers_mutex;
+        std::vector<std::shared_ptr<Subscriber>> subscribers;
+        int next_id;
+
+        static void runSubscriber(Subscriber *subscriber);
+        static void stopSubscriber(Subscriber *subscriber);
+};
+
+#endif
@@ -12,6 +12,10 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "zmq_publisher.h"
 #include <json/json.h>
 
@@ -20,12 +24,19 @@ extern "C" {
 }
 
 #include "ethercat_slave.h"
+#include "process_image.h"
+#include "data_bus.h"
+#include "metrics.h"
+
+// messages per second published on the ZMQ socket, as the EtherCAT master did before the data bus
+const double ZMQ_PUBLISH_RATE = 20.0;
 
 std::vector<std::string> getNetworkInterfaces();
 uint8_t getSlaveType(const std::string &name);
-
-class UI;
-typedef void(UI::*DataCallbackFunction)(const std::vector<std::shared_ptr<EthercatSlave>> &);
+/**
+ * Creates the slave class of a slave type (e.g. KELO_DRIVE_SLAVE), or returns NULL for unknown types
+ */
+std::shared_ptr<EthercatSlave> createSlave(uint8_t slave_type);
 
 class EthercatDataSource
 {
@@ -33,20 +44,63 @@ class EthercatDataSource
         EthercatDataSource(std::shared_ptr<ZMQPublisher> zmq_pub);
         virtual ~EthercatDataSource();
         virtual std::vector<std::shared_ptr<EthercatSlave>>& getSlaves(std::string &error) = 0;
-        void setDataCallback(DataCallbackFunction callback_fn, UI *ui_obj);
+        /**
+         * Consumers subscribe to the bus to receive the process images
+         */
+        DataBus& getDataBus();
+        MetricsRegistry& getMetrics();
+        /**
+         * One line with the most important metrics, for the status line of the UIs
+         */
+        std::string getMetricsSummary() const;
+        /**
+         * The metrics are written to this file in the Prometheus text format every second
+         */
+        void setMetricsFile(const std::string &filename);
         void setZMQPublish(bool value);
         virtual void start(std::string &error) = 0;
         virtual void stop() = 0;
     protected:
         std::vector<std::shared_ptr<EthercatSlave>> slaves;
-        std::string convertToJson(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
 
-        UI *ui;
-        DataCallbackFunction callback_fn;
+        /**
+         * Creates a new image pool for the current slaves and subscribes the
+         * ZMQ publisher; to be called before the first image of a run is created
+         */
+        void prepareRun();
+        std::shared_ptr<ProcessImage> createImage();
+        /**
+         * Assigns the next sequence number to the image and makes it the latest image.
+         * Must only be called from the thread which creates the images.
+         */
+        ProcessImagePtr commitImage(const std::shared_ptr<ProcessImage> &image);
+        ProcessImagePtr getLatestImage() const;
+        void publishImage(const ProcessImagePtr &image);
 
-        bool zmq_publish_enabled;
+        std::atomic_bool zmq_publish_enabled;
         std::shared_ptr<ZMQPublisher> zmq_pub;
-        Json::StreamWriterBuilder json_stream_builder;
+
+        // declared before the data bus, since subscribers update metrics until the bus is destroyed
+        MetricsRegistry metrics;
+        Metric &frames_seen_metric;
+        Metric &frames_filtered_metric;
+        Metric &working_counter_errors_metric;
+
+    private:
+        DataBus data_bus;
+        int zmq_subscription;
+        Metric &frames_decoded_metric;
+
+        std::string metrics_file;
+        std::thread metrics_thread;
+        std::mutex metrics_mutex;
+        std::condition_variable metrics_condition;
+        bool metrics_running;
+        void metricsLoop();
+        void reportMetrics();
+        std::shared_ptr<ProcessImagePool> image_pool;
+        ProcessImagePtr latest_image;
+        uint64_t image_sequence;
 
 };
 #endif
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef ETHERCAT_FRAME_H_
+#define ETHERCAT_FRAME_H_
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include "ethercat_slave.h"
+#include "process_image.h"
+
+const uint32_t ETHERNET_HEADER_SIZE = 14;
+
+/**
+ * The first datagram of a captured EtherCAT frame, parsed in place; the
+ * pointers refer to the captured frame
+ */
+struct EthercatFrame
+{
+    // sent back by the slaves, rather than sent by the master
+    bool returned;
+    uint8_t command;
+    uint8_t index;
+    const uint8_t *datagram;
+    int datagram_size;
+    int working_counter;
+};
+
+/**
+ * Receives every captured Ethernet frame, e.g. to record the raw frames.
+ * Called in the capture thread, so it must not wait for anything slow.
+ */
+class FrameListener
+{
+    public:
+        virtual ~FrameListener() {}
+        /**
+         * frame is only valid during the call
+         */
+        virtual void addFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us) = 0;
+};
+
+/**
+ * Returns false if the frame is too short for the datagram header, the
+ * datagram or its working counter
+ */
+bool parseEthercatFrame(const uint8_t *frame, uint32_t size, EthercatFrame &result);
+
+/**
+ * Copies the process data of each slave from a returned LRW datagram into
+ * the image; previous is the image of the last cycle (or NULL). Returns
+ * false, without copying anything, if the data of a slave is not within the
+ * datagram (e.g. with the config file of a different robot).
+ */
+bool copyFrameData(const EthercatFrame &frame, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                   ProcessImage &image, const ProcessImage *previous);
+
+#endif
@@ -10,7 +10,6 @@
 
 #include <thread>
 #include <atomic>
-#include <mutex>
 #include "zmq_publisher.h"
 #include <json/json.h>
 #include "ethercat_data_source.h"
@@ -30,13 +29,9 @@ class EthercatMaster : public EthercatDataSource
         char IOmap[4096];
 
         std::thread ethercat_thread;
-        std::thread data_copy_thread;
         std::atomic_bool ethercat_running;
 
-        std::mutex data_mutex;
-
         void ethercatLoop();
-        void dataCopyLoop();
         void copyData();
 
 
@@ -10,6 +10,8 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
+#include <stdint.h>
 #include <json/json.h>
 
 #define KELO_DRIVE_SLAVE 1
@@ -29,21 +31,76 @@ struct SlaveInfo
     int tx_start_offset; // where in the datagram does the TX data start
 };
 
+enum FieldType
+{
+    FIELD_UINT16,
+    FIELD_UINT32,
+    FIELD_UINT64,
+    FIELD_FLOAT
+};
+
+/**
+ * Location of a single variable within a PDO struct. The entries of a
+ * slave's layout have the same order as its variable names and units.
+ */
+struct FieldLayout
+{
+    FieldType type;
+    size_t offset; // offset of the variable in bytes from the start of the struct
+};
+
+size_t getFieldSize(FieldType type);
+
+/**
+ * Describes a slave and knows how to decode its PDOs. The slave does not
+ * hold any process data itself; the raw RX and TX bytes of each cycle are
+ * stored in a ProcessImage and passed to the decode functions below.
+ */
 class EthercatSlave
 {
     public:
-        EthercatSlave() {};
+        EthercatSlave(const std::vector<FieldLayout> &rx_layout, const std::vector<FieldLayout> &tx_layout,
+                      size_t rx_size, size_t tx_size);
         virtual ~EthercatSlave() {};
-        virtual void copyData(uint8_t *outputs, uint8_t *inputs) = 0;
-        virtual void convertToJson(Json::Value &data) const = 0;
-        virtual std::vector<std::string> getRxValues() = 0;
-        virtual std::vector<std::string> getTxValues() = 0;
-        virtual const std::vector<std::string>& getRxUnits() = 0;
-        virtual const std::vector<std::string>& getTxUnits() = 0;
-        virtual const std::vector<std::string>& getRxVariables() = 0;
-        virtual const std::vector<std::string>& getTxVariables() = 0;
+
+        size_t getRxSize() const;
+        size_t getTxSize() const;
+        const std::vector<FieldLayout>& getRxLayout() const;
+        const std::vector<FieldLayout>& getTxLayout() const;
+
+        std::string formatRxValue(const uint8_t *rx_data, int idx) const;
+        std::string formatTxValue(const uint8_t *tx_data, int idx) const;
+        uint64_t decodeRxInteger(const uint8_t *rx_data, int idx) const;
+        uint64_t decodeTxInteger(const uint8_t *tx_data, int idx) const;
+        double decodeRxDouble(const uint8_t *rx_data, int idx) const;
+        double decodeTxDouble(const uint8_t *tx_data, int idx) const;
+        void convertToJson(const uint8_t *rx_data, const uint8_t *tx_data, Json::Value &data) const;
+
+        virtual const std::vector<std::string>& getRxUnits() const = 0;
+        virtual const std::vector<std::string>& getTxUnits() const = 0;
+        virtual const std::vector<std::string>& getRxVariables() const = 0;
+        virtual const std::vector<std::string>& getTxVariables() const = 0;
+        // subset of the TX variables which summarise the state of the slave
+        virtual const std::vector<std::string>& getOverviewVariables() const = 0;
         virtual void parseBits(uint16_t data, const std::string &var_name, std::vector<std::string> &vars, std::vector<std::string> &vals) = 0;
         virtual bool areBitsParsable(const std::string &var_name) = 0;
+        /**
+         * Mask of a named bit of a bit field (e.g. OVERTEMP_1 of status1);
+         * returns false if the name is not a single bit, e.g. a mode encoded in several bits
+         */
+        bool findBit(const std::string &var_name, const std::string &bit_name, uint16_t &mask);
         SlaveInfo slave_info;
+
+    protected:
+        const std::vector<FieldLayout> &rx_layout;
+        const std::vector<FieldLayout> &tx_layout;
+        size_t rx_size;
+        size_t tx_size;
+
+    private:
+        static std::string formatField(const FieldLayout &field, const uint8_t *data);
+        static uint64_t decodeInteger(const FieldLayout &field, const uint8_t *data);
+        static double decodeDouble(const FieldLayout &field, const uint8_t *data);
+        static Json::Value decodeJson(const FieldLayout &field, const uint8_t *data);
 };
 #endif
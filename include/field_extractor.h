@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef FIELD_EXTRACTOR_H_
+#define FIELD_EXTRACTOR_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ethercat_slave.h"
+#include "offline_decoder.h"
+
+enum ExtractFormat
+{
+    EXTRACT_CSV,
+    EXTRACT_NDJSON,
+    EXTRACT_BINARY
+};
+
+/**
+ * A single variable of a slave selected for extraction
+ */
+struct FieldSelector
+{
+    std::string name; // as given by the user, used as the column name
+    int slave_idx;
+    bool is_rx;
+    int field_idx;
+    FieldType type;
+};
+
+/**
+ * Parses a comma separated list of selectors of the form SLAVE.FIELD, where
+ * SLAVE is the number of the slave in the EtherCAT ring or its name (if it
+ * is unique), and FIELD is the name of one of its sensor (TX) or command (RX)
+ * variables
+ */
+void parseFieldSelectors(const std::string &selectors, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                         std::vector<FieldSelector> &fields, std::string &error);
+
+/**
+ * All selectors of the slaves, one per variable
+ */
+std::vector<std::string> getFieldSelectors(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+
+bool parseExtractFormat(const std::string &name, ExtractFormat &format);
+
+/**
+ * Encodes only the selected fields of each image, with the capture
+ * timestamp in seconds since epoch:
+ *  - CSV: one row per image, after a header row with the column names
+ *  - NDJSON: one object per image, with the column names as keys
+ *  - binary: after the header (see writeHeader), one block per chunk of
+ *    images, consisting of the number of images (uint32), the timestamps
+ *    (float64) and then each column (uint64 for integer fields, float64 for
+ *    float fields). All values are little-endian.
+ */
+class FieldEncoder : public ImageEncoder
+{
+    public:
+        FieldEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves, const std::vector<FieldSelector> &fields,
+                     ExtractFormat format);
+        /**
+         * Header of the output: the column names for CSV, nothing for NDJSON,
+         * and for binary "KDDVEXT1", the number of columns (uint32) and for
+         * each column its type (uint8, 0 for integer and 1 for float), the
+         * length of its name (uint16) and the name
+         */
+        static void writeHeader(const std::vector<FieldSelector> &fields, ExtractFormat format, std::string &output);
+        void startChunk();
+        void encode(const ProcessImage &image, std::string &output);
+        void finishChunk(std::string &output);
+
+    private:
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        std::vector<FieldSelector> fields;
+        ExtractFormat format;
+        // the columns of the current chunk (binary only)
+        uint32_t row_count;
+        std::string timestamp_column;
+        std::vector<std::string> columns;
+
+        void appendValue(const ProcessImage &image, const FieldSelector &field, std::string &output) const;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef FRAME_RECORDER_H_
+#define FRAME_RECORDER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "ethercat_frame.h"
+#include "metrics.h"
+#include "pcapng_writer.h"
+
+struct FrameRecorderOptions
+{
+    FrameRecorderOptions() : compression(COMPRESSION_NONE), max_file_size(0), max_file_duration(0.0), max_files(0),
+                             buffer_size(64 * 1024 * 1024) {}
+    std::string filename;
+    Compression compression;
+    uint64_t max_file_size; // bytes (after compression) after which a new file is started, 0 for no limit
+    double max_file_duration; // seconds of capture time after which a new file is started, 0 for no limit
+    int max_files; // number of files which are kept; older files are deleted, 0 for no limit
+    size_t buffer_size; // bytes of frames which can wait for the disk
+};
+
+/**
+ * Writes the raw captured frames to pcapng files in its own thread, like
+ * tshark would, but optionally compressed.
+ *
+ * Frames are copied into a buffer of fixed size which the writer thread
+ * swaps with its own, so adding a frame never waits for the disk. If the
+ * disk cannot keep up until the buffer is full, or a write fails, frames
+ * are dropped and counted rather than delaying the capture.
+ *
+ * Without a size or duration limit, the frames are written to filename.
+ * Otherwise the files are numbered like tshark's ring buffer, e.g.
+ * robile_00001_20210301120000.pcapng(.zst), where the time is the capture
+ * time of the first frame in the file; only the files written by the
+ * recorder are deleted to keep at most max_files.
+ */
+class FrameRecorder : public FrameListener
+{
+    public:
+        FrameRecorder(const FrameRecorderOptions &options, MetricsRegistry &metrics);
+        virtual ~FrameRecorder();
+        void start(std::string &error);
+        /**
+         * Writes the frames still in the buffer and closes the file
+         */
+        void stop();
+        void addFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us);
+
+        uint64_t getRecordedFrames() const;
+        uint64_t getDroppedFrames() const;
+        int getFileCount() const;
+
+    private:
+        struct FrameHeader
+        {
+            uint64_t timestamp_us;
+            uint32_t size;
+        };
+
+        FrameRecorderOptions options;
+        Metric &recorded_frames_metric;
+        Metric &dropped_frames_metric;
+        Metric &written_bytes_metric;
+        Metric &files_metric;
+        Metric &write_errors_metric;
+        Metric &buffered_bytes_metric;
+
+        std::mutex buffer_mutex;
+        std::condition_variable buffer_condition;
+        // frames (FrameHeader followed by the frame) added since the writer took the last buffer
+        std::vector<uint8_t> buffer;
+        bool running;
+        std::thread writer_thread;
+
+        // only used by the writer thread
+        std::vector<uint8_t> write_buffer;
+        PcapngWriter writer;
+        int file_number;
+        uint64_t file_start_time;
+        std::deque<std::string> written_files;
+        bool has_write_error;
+        std::chrono::steady_clock::time_point retry_time;
+
+        void writeLoop();
+        void writeFrames();
+        void openFile(uint64_t timestamp_us);
+        void closeFile();
+        void countWrite(uint64_t file_size, uint64_t written_frames, uint64_t lost_frames);
+        void handleWriteError(const std::string &error);
+        std::string getFilename(uint64_t timestamp_us) const;
+};
+
+#endif
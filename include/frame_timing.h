@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef FRAME_TIMING_H_
+#define FRAME_TIMING_H_
+
+#include <stdint.h>
+#include "metrics.h"
+
+/**
+ * Timing of the master being observed by the sniffer. Each process data
+ * frame sent by the master is matched with the frame returning from the
+ * slaves by its datagram index, which gives
+ *  - the round trip time on the bus
+ *  - the master's cycle period (time between sent frames) and its jitter
+ *    (deviation of the period from the average period)
+ *  - late responses (round trip time longer than the average period) and
+ *    missing responses (the index was reused before the frame returned)
+ * Timestamps are capture timestamps in microseconds, so recorded PCAP files
+ * can be analysed as well. Not thread safe; all frames must be added from
+ * the capture thread.
+ */
+class FrameTimingAnalyzer
+{
+    public:
+        FrameTimingAnalyzer(MetricsRegistry &metrics);
+        void addOutgoingFrame(uint8_t index, uint64_t timestamp_us);
+        void addReturnedFrame(uint8_t index, uint64_t timestamp_us);
+        /**
+         * Forgets the frames waiting for a response, e.g. when a replay jumps to another time
+         */
+        void reset();
+        /**
+         * Average cycle period in microseconds, or 0 if not known yet
+         */
+        double getAveragePeriod() const;
+
+    private:
+        Histogram &round_trip_time_histogram;
+        Histogram &cycle_period_histogram;
+        Histogram &cycle_jitter_histogram;
+        Metric &late_responses_metric;
+        Metric &missing_responses_metric;
+
+        bool pending[256];
+        uint64_t sent_timestamps[256];
+        bool has_last_sent;
+        uint64_t last_sent_timestamp;
+        double average_period;
+};
+
+#endif
@@ -14,11 +14,17 @@
 #include <QPushButton>
 #include <QRadioButton>
 #include <QCheckBox>
-#include <QGroupBox>
 #include <QComboBox>
 #include <QLabel>
 #include <QListWidget>
+#include <QTableView>
+#include <QSlider>
+#include <QTimer>
+#include <atomic>
 #include "ui.h"
+#include "slave_data_model.h"
+
+class PacketSniffer;
 
 class GUI : public QWidget, public UI
 {
@@ -26,13 +32,17 @@ class GUI : public QWidget, public UI
 
     public:
         GUI(std::shared_ptr<ZMQPublisher> zmq_pub);
+        virtual ~GUI();
         void selectSource(const std::string &src);
         void selectNetworkInterface(const std::string &iface);
         void setConfigFile(const std::string &path);
         void setPCAPFile(const std::string &path);
         void enableZMQ(bool enable);
+        void setReplaySpeed(double speed);
+        void setTimeRange(double start_time, double end_time);
         void start();
-        void dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void setDisplayRate(double rate);
+        void dataCallback(const ProcessImagePtr &image);
     protected:
         void closeEvent(QCloseEvent *event) override;
 
@@ -43,17 +53,17 @@ class GUI : public QWidget, public UI
         void handleSelectPCAPFile();
         void handleInputButtonChanged();
         void handleZMQCheckBox(int state);
+        void handleShowUnitsCheckBox(int state);
         void handleWheelListChanged(QListWidgetItem *item);
-        void fixSize();
-        void handleDataChanged(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
-
-    signals:
-        void dataChanged(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void handleRefreshTimer();
+        void handleReplaySpeedChanged(int index);
+        void handlePauseButton();
+        void handleStepButton();
+        void handleTimelineChanged(int value);
 
 
     private:
         QGridLayout *main_layout;
-        QHBoxLayout *wheel_data_layout;
 
         QButtonGroup *input_data_button_group;
         QRadioButton *input_data_ethercat_button;
@@ -70,15 +80,40 @@ class GUI : public QWidget, public UI
 
         QPushButton *start_button;
 
+        QLabel *frame_counter_lbl;
+
+        // replay controls, only enabled for PCAP files
+        QComboBox *replay_speed_combo_box;
+        QPushButton *pause_button;
+        QPushButton *step_button;
+        // position in the recording in milliseconds; follows the replay, and seeks when moved by the user
+        QSlider *timeline_slider;
+        QLabel *replay_position_lbl;
+
         QCheckBox *publish_zmq_checkbox;
         QCheckBox *show_units_checkbox;
 
-        std::vector<QGroupBox *> wheel_group_boxes;
+        // one column per slave; only the visible cells are formatted
+        QTableView *data_table_view;
+        SlaveDataModel *data_model;
 
         QListWidget *wheel_list_widget;
 
+        // the data source only replaces the latest image; the timer displays it at the display rate
+        QTimer *refresh_timer;
+        ProcessImagePtr latest_image;
+        std::atomic<uint64_t> frames_received;
+        uint64_t frames_displayed;
+        uint64_t displayed_sequence;
+        // owned by the metrics registry of the current data source
+        Metric *frames_displayed_metric;
+
         void populateNetworkInterfaces();
+        /**
+         * The data source if it replays a PCAP file, or NULL
+         */
+        PacketSniffer* getReplaySource();
+        void updateTimeline();
 };
 
-Q_DECLARE_METATYPE(std::vector<std::shared_ptr<EthercatSlave>>)
 #endif
@@ -0,0 +1,60 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef JSON_RECORDER_H_
+#define JSON_RECORDER_H_
+
+#include <fstream>
+#include <string>
+#include "process_image.h"
+#include "offline_decoder.h"
+#include "recorder.h"
+
+/**
+ * Writes process images to a file as newline-delimited JSON (one image per
+ * line, in the same format as the ZMQ messages, with the capture timestamp)
+ */
+class JsonRecorder : public Recorder
+{
+    public:
+        JsonRecorder();
+        virtual ~JsonRecorder();
+        void open(const std::string &filename, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, std::string &error);
+        void close();
+        void record(const ProcessImage &image);
+        std::shared_ptr<ImageEncoder> createEncoder() const;
+        void recordEncoded(const std::string &lines, uint64_t image_count);
+        uint64_t getRecordCount() const;
+        uint64_t getWriteErrors() const;
+
+    private:
+        std::ofstream file;
+        std::string filename;
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        JsonEncoder json_encoder;
+        uint64_t record_count;
+        uint64_t write_errors;
+
+        bool checkWrite();
+};
+
+/**
+ * Encodes images in the format of JsonRecorder, e.g. to record the output of OfflineDecoder
+ */
+class JsonLineEncoder : public ImageEncoder
+{
+    public:
+        JsonLineEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void startChunk();
+        void encode(const ProcessImage &image, std::string &output);
+
+    private:
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        JsonEncoder json_encoder;
+};
+
+#endif
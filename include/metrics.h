@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <json/json.h>
+
+enum MetricType
+{
+    METRIC_COUNTER, // only increases
+    METRIC_GAUGE, // current value, e.g. a queue length
+    METRIC_HISTOGRAM // distribution of observed values, e.g. latencies
+};
+
+/**
+ * A single value which can be updated from any thread without locking
+ */
+class Metric
+{
+    public:
+        Metric() : value(0) {}
+        void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+        void set(uint64_t n) { value.store(n, std::memory_order_relaxed); }
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value;
+};
+
+/**
+ * Counts of observed values per bucket, which can be updated from any thread
+ * without locking. A value is counted in the first bucket whose upper bound
+ * is greater or equal to it, or in the last bucket (+Inf) if there is none.
+ */
+class Histogram
+{
+    public:
+        /**
+         * upper_bounds must be sorted in increasing order
+         */
+        Histogram(const std::vector<uint64_t> &upper_bounds);
+        void observe(uint64_t value);
+
+        const std::vector<uint64_t>& getUpperBounds() const;
+        /**
+         * Number of values in bucket idx (not cumulative); idx == getUpperBounds().size() is the +Inf bucket
+         */
+        uint64_t getBucketCount(int idx) const;
+        uint64_t getCount() const;
+        uint64_t getSum() const;
+
+    private:
+        std::vector<uint64_t> upper_bounds;
+        std::vector<Metric> bucket_counts;
+        Metric sum;
+};
+
+/**
+ * Named metrics of the capture, decode, publish and UI stages. Metrics are
+ * created once (e.g. in a constructor) and then updated through the returned
+ * reference; the registry is only locked to create and export metrics.
+ */
+class MetricsRegistry
+{
+    public:
+        /**
+         * Returns the existing metric with the same name and labels, or creates it.
+         * labels are in the Prometheus format without braces, e.g. subscriber="gui"
+         */
+        Metric& getMetric(const std::string &name, MetricType type, const std::string &help, const std::string &labels = "");
+        /**
+         * Like getMetric; the upper bounds are only used if the histogram is created
+         */
+        Histogram& getHistogram(const std::string &name, const std::string &help, const std::vector<uint64_t> &upper_bounds,
+                                const std::string &labels = "");
+        /**
+         * Value of the metric (the number of observations for histograms), or 0 if it does not exist
+         */
+        uint64_t getValue(const std::string &name, const std::string &labels = "") const;
+
+        std::string toPrometheus() const;
+        Json::Value toJson() const;
+        /**
+         * Writes to a temporary file which is then renamed, so readers never see a partial file
+         */
+        void writePrometheusFile(const std::string &filename, std::string &error) const;
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            std::string labels;
+            std::string help;
+            MetricType type;
+            Metric metric;
+            std::unique_ptr<Histogram> histogram;
+        };
+        mutable std::mutex entries_mutex;
+        std::vector<std::unique_ptr<Entry>> entries;
+
+        static const char* getTypeName(MetricType type);
+        static void writePrometheusHistogram(std::ostream &out, const Entry &entry);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef OFFLINE_DECODER_H_
+#define OFFLINE_DECODER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "ethercat_slave.h"
+#include "process_image.h"
+#include "pcap_reader.h"
+
+/**
+ * Converts the images decoded from a recording to the output of the
+ * decoder. Each decoding thread creates its own encoder.
+ */
+class ImageEncoder
+{
+    public:
+        virtual ~ImageEncoder() {}
+        /**
+         * Called before the first image of each chunk; the generations of
+         * the images start again in each chunk, so caches based on them
+         * must be cleared
+         */
+        virtual void startChunk() = 0;
+        virtual void encode(const ProcessImage &image, std::string &output) = 0;
+        /**
+         * Called after the last image of each chunk, e.g. to write buffered columns
+         */
+        virtual void finishChunk(std::string &output) {}
+};
+
+typedef std::function<std::shared_ptr<ImageEncoder>()> ImageEncoderFactory;
+// receives the output of each chunk and the number of images in it, in the order of the recording
+typedef std::function<void(const std::string &output, uint64_t image_count)> OutputCallback;
+
+struct OfflineDecodeStats
+{
+    uint64_t frames; // frames within the time range
+    uint64_t images;
+    uint64_t frames_filtered; // not returned LRW frames, or malformed
+    uint64_t working_counter_errors;
+};
+
+/**
+ * Decodes a PCAP recording as fast as possible on several threads. Each
+ * LRW frame carries the complete process image, so frames can be decoded
+ * independently: the recording is split into chunks of CHUNK_FRAMES frames
+ * at frames of its index, the chunks are decoded and encoded in parallel,
+ * and their output is passed on in the order of the recording (i.e. in
+ * timestamp order) from the calling thread. Only a few chunks per thread
+ * are held in memory, so a slow output callback stalls the decoding threads.
+ */
+class OfflineDecoder
+{
+    public:
+        static const int CHUNK_FRAMES = 4096;
+
+        OfflineDecoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        /**
+         * Number of decoding threads; 0 (the default) uses one thread per core
+         */
+        void setThreadCount(int thread_count);
+        /**
+         * Same as PacketSniffer::setTimeRange
+         */
+        void setTimeRange(double start_time, double end_time);
+        void decode(const std::string &filename, const ImageEncoderFactory &encoder_factory,
+                    const OutputCallback &output_callback, std::string &error);
+        const OfflineDecodeStats& getStats() const;
+
+    private:
+        struct Chunk
+        {
+            uint64_t start_offset;
+            uint64_t end_offset; // offset of the first frame of the next chunk, or after the last frame
+            bool done;
+            std::string output;
+            OfflineDecodeStats stats;
+            std::string error;
+        };
+
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        int thread_count;
+        double start_time;
+        double end_time;
+        OfflineDecodeStats stats;
+
+        std::mutex chunks_mutex;
+        std::condition_variable chunks_condition;
+        std::vector<Chunk> chunks;
+        int next_chunk;
+        int written_chunks;
+        int max_pending_chunks;
+        bool cancelled;
+
+        void decodeChunks(const std::string &filename, const ImageEncoderFactory &encoder_factory,
+                          uint64_t start_timestamp, uint64_t end_timestamp, int thread_idx);
+        void decodeChunk(PcapReader &reader, ImageEncoder &encoder, ProcessImagePool &pool, Chunk &chunk,
+                         uint64_t start_timestamp, uint64_t end_timestamp);
+};
+
+#endif
@@ -11,28 +11,144 @@
 #include <tins/tins.h>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include "zmq_publisher.h"
 #include <json/json.h>
 #include "ethercat_data_source.h"
+#include "ethercat_frame.h"
+#include "frame_timing.h"
+#include "pcap_index.h"
+#include "pcap_reader.h"
 
+// EtherCAT cycle rate in Hz for which the capture buffer is sized by default
+const double DEFAULT_EXPECTED_FRAME_RATE = 1000.0;
+
+/**
+ * Creates the slaves of a config file, e.g. to decode a recording without
+ * opening it with a PacketSniffer
+ */
+std::vector<std::shared_ptr<EthercatSlave>> readSlaveConfig(const std::string &filename, std::string &error);
+
+/**
+ * Live captures never sleep, and the kernel's capture buffer is sized from
+ * the expected frame rate. Frames dropped by the kernel and gaps in the
+ * index of the returned datagrams are counted, so that it is known when a
+ * capture is incomplete. Frames sent by the master are matched with the
+ * returned frames to measure the master's timing.
+ *
+ * PCAP files are replayed according to their capture timestamps, at real
+ * time, N times faster or slower, or as fast as possible. The replay can be
+ * paused and stepped one process image at a time, limited to a time range,
+ * and moved to any time using the index of the recording. Consumers are not affected
+ * by the replay speed, since they receive the images through the data bus.
+ */
 class PacketSniffer : public EthercatDataSource
 {
     public:
-        PacketSniffer(const std::string &ifname_or_filename, bool is_pcap_file, std::shared_ptr<ZMQPublisher> zmq_pub, std::string &error_msg);
+        PacketSniffer(const std::string &ifname_or_filename, bool is_pcap_file, std::shared_ptr<ZMQPublisher> zmq_pub, std::string &error_msg,
+                      double expected_frame_rate = DEFAULT_EXPECTED_FRAME_RATE);
         virtual ~PacketSniffer();
         std::vector<std::shared_ptr<EthercatSlave>>& getSlaves(std::string &error);
         void start(std::string &error);
         void stop();
         void setConfigFile(const std::string &filename, std::string &error_msg);
+        /**
+         * The listener receives every frame of the capture or replay, including
+         * the filtered ones; must be called before start
+         */
+        void addFrameListener(const std::shared_ptr<FrameListener> &listener);
+
+        bool isReplay() const;
+        /**
+         * Factor of the recorded speed, e.g. 1 for real time; 0 replays as fast as possible
+         */
+        void setReplaySpeed(double speed);
+        double getReplaySpeed();
+        void setPaused(bool paused);
+        bool isPaused();
+        /**
+         * While paused, publishes the next process image
+         */
+        void step();
+        /**
+         * Replays only the frames between start_time and end_time, in seconds
+         * since the first frame of the recording; a negative end_time replays
+         * until the end. Takes effect when the replay is started.
+         */
+        void setTimeRange(double start_time, double end_time);
+        /**
+         * Duration of the recording in seconds
+         */
+        double getDuration() const;
+        /**
+         * Continues the replay at time (in seconds since the first frame of the recording)
+         */
+        void seek(double time);
+        /**
+         * Time of the last published image, in seconds since the first frame of the recording
+         */
+        double getReplayPosition() const;
+        /**
+         * The replay reached the end of the recording or of the time range
+         */
+        bool isReplayFinished() const;
 
     private:
+        // live captures use libtins, recordings are read with the reader so that they can be seeked
         std::shared_ptr<Tins::BaseSniffer> sniffer;
+        PcapReader pcap_reader;
+        PcapIndex pcap_index;
         std::thread sniffer_thread;
 
         Json::Value config;
-        void loadConfig(const std::string &filename, std::string &error_msg);
+
+        bool is_live_capture;
+        Metric &kernel_drops_metric;
+        Metric &index_gaps_metric;
+        Metric &incomplete_seconds_metric;
+        std::chrono::steady_clock::time_point last_capture_stats_time;
+        uint64_t last_reported_losses;
+        void updateCaptureStats();
+
+        bool has_datagram_index;
+        uint8_t last_datagram_index;
+        // highest index seen, i.e. where the master wraps the index around (e.g. 15 for SOEM)
+        uint8_t max_datagram_index;
+        void checkDatagramIndex(uint8_t index);
+
+        FrameTimingAnalyzer frame_timing;
+        std::vector<std::shared_ptr<FrameListener>> frame_listeners;
+
+        std::mutex replay_mutex;
+        std::condition_variable replay_condition;
+        double replay_speed;
+        bool replay_paused;
+        int replay_steps;
+        bool replay_stopped;
+        // the wall clock time at which the frame with the anchor timestamp was replayed;
+        // reset whenever the speed changes or the replay is paused
+        bool has_replay_anchor;
+        uint64_t replay_anchor_timestamp;
+        std::chrono::steady_clock::time_point replay_anchor_time;
+        double replay_start_time;
+        double replay_end_time;
+        bool seek_pending;
+        uint64_t seek_timestamp;
+        std::atomic<uint64_t> replay_position;
+        std::atomic_bool replay_finished;
+        /**
+         * Returns false if the frame must not be published, since the replay was stopped or seeked
+         */
+        bool waitForReplay(uint64_t timestamp_us);
+        void replayLoop();
 
         bool packetCallback(Tins::Packet &packet);
+        /**
+         * frame is a complete Ethernet frame, which is only read during the call
+         */
+        void processFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us);
         void startSnifferLoop();
 
 };
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef PCAP_INDEX_H_
+#define PCAP_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "pcap_reader.h"
+
+/**
+ * Offsets and timestamps of every INDEX_INTERVAL-th frame of a recording,
+ * so that a reader can seek close to any time with a binary search and then
+ * read at most INDEX_INTERVAL frames. Building the index requires reading
+ * the whole recording once, so it is cached next to it (RECORDING.kddvidx)
+ * and rebuilt only if the size or modification time of the recording change.
+ */
+class PcapIndex
+{
+    public:
+        static const int INDEX_INTERVAL = 256;
+
+        PcapIndex();
+        /**
+         * Loads the cached index of the recording, or builds it with the
+         * reader (which must be open) and tries to cache it. Failing to write
+         * the cache (e.g. in a read-only directory) is not an error, and
+         * neither is a truncated or malformed end of the recording (e.g. if
+         * the capture was killed), which is only indexed up to the last
+         * complete frame.
+         */
+        void open(const std::string &filename, PcapReader &reader, std::string &error);
+        /**
+         * Offset of the last indexed frame whose timestamp is not after timestamp_us
+         * (or of the first frame); frames up to timestamp_us follow it
+         */
+        uint64_t findOffset(uint64_t timestamp_us) const;
+        // timestamps of the first and last frame in microseconds since epoch
+        uint64_t getStartTime() const;
+        uint64_t getEndTime() const;
+        uint64_t getFrameCount() const;
+        /**
+         * Offset after the last indexed frame, where readers should stop
+         */
+        uint64_t getEndOffset() const;
+        /**
+         * The indexed frames (every INDEX_INTERVAL-th frame), e.g. to split
+         * the recording into chunks; the timestamp of an entry is the highest
+         * timestamp up to its frame
+         */
+        int getEntryCount() const;
+        uint64_t getEntryOffset(int entry_idx) const;
+        uint64_t getEntryTimestamp(int entry_idx) const;
+
+    private:
+        struct Entry
+        {
+            uint64_t timestamp_us;
+            uint64_t offset;
+        };
+        std::vector<Entry> entries;
+        uint64_t first_frame_offset;
+        uint64_t end_offset;
+        uint64_t start_time;
+        uint64_t end_time;
+        uint64_t frame_count;
+
+        void build(PcapReader &reader, std::string &error);
+        bool load(const std::string &index_filename, uint64_t file_size, int64_t modification_time);
+        void save(const std::string &index_filename, uint64_t file_size, int64_t modification_time) const;
+};
+
+#endif
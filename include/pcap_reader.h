@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef PCAP_READER_H_
+#define PCAP_READER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct PcapFrame
+{
+    uint64_t offset; // file offset of the record or block containing the frame
+    uint64_t timestamp_us; // capture time in microseconds since epoch
+    // points into the mapping of the file; valid until the reader is closed
+    const uint8_t *data;
+    uint32_t size;
+};
+
+/**
+ * Reads the Ethernet frames of a pcap or pcapng file (either byte order,
+ * microsecond or nanosecond timestamps). Unlike Tins::FileSniffer, the
+ * reader can seek to the offset of any frame it returned before, so that
+ * a recording does not have to be read from the start.
+ *
+ * The file is mapped into memory and the records are parsed in place, so
+ * reading a frame neither copies nor allocates; the kernel is advised that
+ * the file is read sequentially, so it reads ahead and drops the pages
+ * that were read.
+ *
+ * For pcapng files, the interfaces are read from the blocks that precede
+ * the first frame; interfaces described after a seek target are unknown,
+ * and their timestamps are assumed to be in microseconds.
+ */
+class PcapReader
+{
+    public:
+        PcapReader();
+        virtual ~PcapReader();
+        // owns the mapping, which must not be unmapped twice
+        PcapReader(const PcapReader&) = delete;
+        PcapReader& operator=(const PcapReader&) = delete;
+        void open(const std::string &filename, std::string &error);
+        void close();
+        /**
+         * Reads the next frame; returns false at the end of the file, or if
+         * the file is malformed (error is set in that case)
+         */
+        bool readFrame(PcapFrame &frame, std::string &error);
+        /**
+         * offset must be the offset of a frame, or getFirstFrameOffset()
+         */
+        void seek(uint64_t offset);
+        uint64_t getFirstFrameOffset() const;
+        /**
+         * Offset of the next record or block to read
+         */
+        uint64_t getPosition() const;
+
+    private:
+        const uint8_t *mapping;
+        uint64_t file_size;
+        uint64_t position;
+        std::string filename;
+        bool is_pcapng;
+        // the file was written with the other byte order
+        bool swapped;
+        // timestamp units per second of the pcap file, or of each pcapng interface
+        uint64_t units_per_second;
+        std::vector<uint64_t> interface_units_per_second;
+        uint64_t first_frame_offset;
+        uint64_t last_timestamp_us;
+
+        /**
+         * Returns the size bytes at offset, or NULL if the file ends before
+         */
+        const uint8_t* getData(uint64_t offset, uint64_t size) const;
+        uint16_t toHost16(const uint8_t *data) const;
+        uint32_t toHost32(const uint8_t *data) const;
+        uint64_t toMicroseconds(uint64_t timestamp, uint64_t units) const;
+        void readPcapHeader(const uint8_t *header, std::string &error);
+        bool readPcapFrame(PcapFrame &frame, std::string &error);
+        bool readPcapngFrame(PcapFrame &frame, std::string &error);
+        void readSectionHeader(std::string &error);
+        void readInterfaceDescription(const uint8_t *block, uint32_t length, std::string &error);
+};
+
+#endif
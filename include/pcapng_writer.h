@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef PCAPNG_WRITER_H_
+#define PCAPNG_WRITER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef KDDV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef KDDV_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+enum Compression
+{
+    COMPRESSION_NONE,
+    COMPRESSION_ZSTD,
+    COMPRESSION_LZ4
+};
+
+/**
+ * Parses none, zstd or lz4; returns false for other names
+ */
+bool parseCompression(const std::string &name, Compression &compression);
+/**
+ * Whether kddv was built with the library of the compression
+ */
+bool isCompressionSupported(Compression compression);
+/**
+ * Extension of compressed files, e.g. ".zst"; empty for COMPRESSION_NONE
+ */
+std::string getCompressionExtension(Compression compression);
+/**
+ * Inserts a number and the local time of timestamp_us before the extension
+ * of filename, like tshark's ring buffer does, e.g. robile.pcapng.zst ->
+ * robile_00001_20210301120000.pcapng.zst
+ */
+std::string getNumberedFilename(const std::string &filename, int number, uint64_t timestamp_us);
+
+/**
+ * Writes Ethernet frames to a pcapng file with one section and one
+ * interface and microsecond timestamps, which Wireshark and PcapReader can
+ * read. The file can be compressed as a zstd or lz4 stream (which e.g.
+ * Wireshark reads directly); a compressed file is only complete after it
+ * was closed.
+ */
+class PcapngWriter
+{
+    public:
+        PcapngWriter();
+        virtual ~PcapngWriter();
+        // owns the file, which must not be closed twice
+        PcapngWriter(const PcapngWriter&) = delete;
+        PcapngWriter& operator=(const PcapngWriter&) = delete;
+        /**
+         * Replaces the file if it exists
+         */
+        void open(const std::string &filename, Compression compression, std::string &error);
+        /**
+         * Frames are collected and written in chunks; error is set if the
+         * chunk could not be written, in which case all its frames are lost
+         */
+        void writeFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us, std::string &error);
+        /**
+         * Ends the compressed stream and closes the file; error is set if
+         * the remaining data could not be written
+         */
+        void close(std::string &error);
+        bool isOpen() const;
+        /**
+         * Bytes written to the file so far, i.e. after compression
+         */
+        uint64_t getFileSize() const;
+        /**
+         * Frames of the file which were written, i.e. whose chunk was
+         * written, and frames which were lost because their chunk could not
+         * be written
+         */
+        uint64_t getWrittenFrames() const;
+        uint64_t getLostFrames() const;
+
+    private:
+        FILE *file;
+        std::string filename;
+        Compression compression;
+        uint64_t file_size;
+        // blocks are collected and compressed in larger chunks
+        std::vector<uint8_t> input;
+        uint64_t input_frames;
+        uint64_t written_frames;
+        uint64_t lost_frames;
+        std::vector<uint8_t> output;
+#ifdef KDDV_HAVE_ZSTD
+        ZSTD_CCtx *zstd_context;
+#endif
+#ifdef KDDV_HAVE_LZ4
+        LZ4F_cctx *lz4_context;
+#endif
+
+        void writeBlock(uint32_t block_type, const uint8_t *body, uint32_t body_size, const uint8_t *data, uint32_t data_size, std::string &error);
+        void compressInput(bool end, std::string &error);
+        void writeOutput(const uint8_t *data, size_t size, std::string &error);
+};
+
+#endif
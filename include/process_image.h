@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef PROCESS_IMAGE_H_
+#define PROCESS_IMAGE_H_
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "ethercat_slave.h"
+
+/**
+ * Where the RX and TX bytes of each slave are stored within a process image.
+ * The TX bytes of a slave directly follow its RX bytes.
+ */
+struct ProcessImageLayout
+{
+    std::vector<size_t> rx_offsets;
+    std::vector<size_t> rx_sizes;
+    std::vector<size_t> tx_offsets;
+    std::vector<size_t> tx_sizes;
+    size_t size;
+};
+
+/**
+ * Contiguous copy of the process data of all slaves from one cycle.
+ * Images are filled by a data source and handed to consumers as
+ * ProcessImagePtr, i.e. read-only and reference counted, so readers never
+ * see an image that is being written to.
+ */
+class ProcessImage
+{
+    public:
+        ProcessImage(const std::shared_ptr<const ProcessImageLayout> &layout);
+
+        int getSlaveCount() const;
+        const uint8_t *getRxData(int slave_idx) const;
+        const uint8_t *getTxData(int slave_idx) const;
+        /**
+         * Changes (relative to the previous image of the same source) only
+         * if the slave's data changed; unique across sources and runs
+         */
+        uint64_t getGeneration(int slave_idx) const;
+
+        /**
+         * Copies the data of one slave into the image; previous is the image
+         * of the last cycle (or NULL) and is used to update the generation
+         */
+        void copySlaveData(int slave_idx, const uint8_t *outputs, const uint8_t *inputs, const ProcessImage *previous);
+
+        uint64_t sequence; // number of the cycle in which the image was captured
+        double timestamp; // capture time in seconds since epoch
+
+    private:
+        std::shared_ptr<const ProcessImageLayout> layout;
+        std::vector<uint8_t> data;
+        std::vector<uint64_t> generations;
+};
+
+typedef std::shared_ptr<const ProcessImage> ProcessImagePtr;
+
+/**
+ * Recycles process images so that no allocations are needed per cycle.
+ * Images obtained with acquire() return to the pool when the last reference
+ * to them is dropped.
+ */
+class ProcessImagePool : public std::enable_shared_from_this<ProcessImagePool>
+{
+    public:
+        ProcessImagePool(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        virtual ~ProcessImagePool();
+        std::shared_ptr<ProcessImage> acquire();
+
+    private:
+        std::shared_ptr<ProcessImageLayout> layout;
+        std::mutex free_images_mutex;
+        std::vector<ProcessImage *> free_images;
+
+        void release(ProcessImage *image);
+};
+
+/**
+ * Formatted values of a consumer, so that fields are only converted to
+ * strings when they are requested and re-converted only when the slave's
+ * generation changes. Each consumer (thread) uses its own cache.
+ */
+class ValueCache
+{
+    public:
+        void setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        const std::string& getRxValue(const ProcessImage &image, int slave_idx, int field_idx);
+        const std::string& getTxValue(const ProcessImage &image, int slave_idx, int field_idx);
+
+    private:
+        struct Entry
+        {
+            std::string value;
+            uint64_t generation;
+        };
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        std::vector<std::vector<Entry>> rx_entries;
+        std::vector<std::vector<Entry>> tx_entries;
+};
+
+/**
+ * Converts process images to the JSON string published to PlotJuggler.
+ * The JSON of a slave is reused while its generation is unchanged. Like
+ * ValueCache, each consumer (thread) uses its own encoder.
+ */
+class JsonEncoder
+{
+    public:
+        JsonEncoder();
+        void setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        std::string encode(const ProcessImage &image, double timestamp);
+
+    private:
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        Json::StreamWriterBuilder json_stream_builder;
+        std::vector<Json::Value> slave_json;
+        std::vector<uint64_t> slave_json_generations;
+};
+
+#endif
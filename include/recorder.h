@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ethercat_slave.h"
+#include "process_image.h"
+#include "offline_decoder.h"
+
+/**
+ * Writes process images to a file, either one at a time (e.g. from a data
+ * bus subscriber) or encoded in parallel by the OfflineDecoder
+ */
+class Recorder
+{
+    public:
+        virtual ~Recorder() {}
+        virtual void open(const std::string &filename, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, std::string &error) = 0;
+        virtual void close() = 0;
+        virtual void record(const ProcessImage &image) = 0;
+        /**
+         * Encoder for the OfflineDecoder, whose output is written with recordEncoded
+         */
+        virtual std::shared_ptr<ImageEncoder> createEncoder() const = 0;
+        virtual void recordEncoded(const std::string &output, uint64_t image_count) = 0;
+        virtual uint64_t getRecordCount() const = 0;
+        /**
+         * Writes which failed (e.g. because the disk is full); the images
+         * of a failed write are lost, but the file remains readable
+         */
+        virtual uint64_t getWriteErrors() const = 0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef RECORDING_QUERY_H_
+#define RECORDING_QUERY_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "columnar_recording.h"
+
+/**
+ * A condition on one column of a columnar recording
+ */
+struct QueryPredicate
+{
+    enum Kind
+    {
+        RANGE, // the value is within [lo, hi]
+        BITS,  // any bit of mask is set
+        NEVER  // no value matches, e.g. a negative threshold for an unsigned field
+    };
+    Kind kind;
+    int column_idx;
+    bool negate;
+    // bounds of RANGE in the domain of the column
+    uint64_t lo;
+    uint64_t hi;
+    double lo_float;
+    double hi_float;
+    uint64_t mask;
+};
+
+/**
+ * Time of the first and last row of consecutive rows which match a query,
+ * in microseconds since epoch
+ */
+struct TimeInterval
+{
+    int64_t start_us;
+    int64_t end_us;
+    uint64_t rows;
+};
+
+struct QueryStats
+{
+    int blocks;
+    // blocks in which no row can match, or every row matches, according to their column summaries
+    int blocks_skipped;
+    int blocks_matched;
+    int blocks_scanned;
+    uint64_t rows_matched;
+};
+
+/**
+ * Finds the time intervals of a columnar recording in which conditions on
+ * its fields hold. The summary of each column in each block (see
+ * ColumnStats) is checked first; only blocks in which some but not all rows
+ * may match are read, and only the columns of the conditions.
+ */
+class RecordingQuery
+{
+    public:
+        /**
+         * The reader must be open and outlive the query
+         */
+        RecordingQuery(const ColumnarReader &reader);
+        /**
+         * Parses conditions joined by " and ":
+         *  - COLUMN OP NUMBER, where OP is one of > >= < <= == !=
+         *  - COLUMN & MASK: any bit of MASK (decimal or 0x...) is set
+         *  - COLUMN.BIT: the named bit of a bit field is set, e.g. 5.status1.OVERTEMP_1
+         *  - COLUMN: any bit is set
+         * where COLUMN is SLAVE_NUMBER.FIELD. The last three can be negated with !
+         */
+        void parse(const std::string &expression, std::string &error);
+        void run(std::vector<TimeInterval> &intervals, QueryStats &stats) const;
+
+    private:
+        enum BlockMatch
+        {
+            MATCH_NONE,
+            MATCH_SOME,
+            MATCH_ALL
+        };
+
+        const ColumnarReader &reader;
+        std::vector<QueryPredicate> predicates;
+
+        bool parseCondition(const std::string &condition, QueryPredicate &predicate, std::string &error) const;
+        void setRange(const std::string &op, double threshold, QueryPredicate &predicate) const;
+        bool findBitMask(int column_idx, const std::string &bit_name, uint64_t &mask) const;
+        BlockMatch checkBlock(int block_idx, const QueryPredicate &predicate) const;
+        void scanBlock(int block_idx, const QueryPredicate &predicate, uint8_t *match) const;
+};
+
+#endif
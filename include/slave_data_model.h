@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef SLAVE_DATA_MODEL_H_
+#define SLAVE_DATA_MODEL_H_
+
+#include <QAbstractTableModel>
+#include <map>
+#include "process_image.h"
+
+/**
+ * Table with one column per slave and one row per variable (the union of
+ * the RX and TX variables of all slave types). Values are only formatted
+ * when the view asks for a cell, i.e. for visible cells, and dataChanged
+ * is only emitted for the cells whose raw bytes changed.
+ */
+class SlaveDataModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+    public:
+        SlaveDataModel(QObject *parent = nullptr);
+        void setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void setShowUnits(bool show);
+        void updateData(const ProcessImagePtr &image);
+
+        int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+        int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+        QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+        QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    private:
+        struct Row
+        {
+            bool is_rx;
+            std::string name;
+        };
+        std::vector<Row> rows;
+        // index of each row's variable in the RX or TX variables of a slave (-1 if it doesn't have it), per slave
+        std::vector<std::vector<int>> field_indices;
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        std::vector<QString> slave_names;
+
+        ProcessImagePtr image;
+        mutable ValueCache value_cache;
+        bool show_units;
+
+        bool isFieldChanged(int slave_idx, int row, const ProcessImage &old_image) const;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef TRACER_H_
+#define TRACER_H_
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+/**
+ * Records the duration of pipeline stages (capture, decode, serialize,
+ * publish, render) into per-thread buffers and writes them as a Chrome
+ * trace (viewable in chrome://tracing or Perfetto). Each thread only writes
+ * to its own buffer, so recording an event does not lock. When tracing is
+ * not started, a TraceScope only checks a flag.
+ *
+ * Names and categories of events must be string literals.
+ */
+class Tracer
+{
+    public:
+        /**
+         * Can only be called once per process; buffers of events_per_thread
+         * events are allocated when a thread records its first event. When
+         * a buffer is full, the oldest events are overwritten
+         */
+        static void start(size_t events_per_thread = 262144);
+        static void stop();
+        static bool isEnabled()
+        {
+            return enabled.load(std::memory_order_relaxed);
+        }
+        /**
+         * Name of the calling thread in the trace; ignored if tracing is not started
+         */
+        static void setThreadName(const std::string &name);
+        /**
+         * Writes the last events_per_thread events of each thread, i.e. the
+         * most recent period; can be called while tracing
+         */
+        static void writeChromeTrace(const std::string &filename, std::string &error);
+
+        static uint64_t now();
+        static void addEvent(const char *category, const char *name, uint64_t start_ns, uint64_t end_ns);
+
+    private:
+        static std::atomic_bool enabled;
+};
+
+/**
+ * Records an event from construction until the end of the scope
+ */
+class TraceScope
+{
+    public:
+        TraceScope(const char *category, const char *name) : category(category), name(name), active(Tracer::isEnabled())
+        {
+            start_ns = active ? Tracer::now() : 0;
+        }
+        ~TraceScope()
+        {
+            if (active)
+            {
+                Tracer::addEvent(category, name, start_ns, Tracer::now());
+            }
+        }
+
+    private:
+        const char *category;
+        const char *name;
+        bool active;
+        uint64_t start_ns;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#ifndef TRIGGER_CAPTURE_H_
+#define TRIGGER_CAPTURE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include "ethercat_frame.h"
+#include "ethercat_slave.h"
+#include "field_extractor.h"
+#include "metrics.h"
+#include "pcapng_writer.h"
+
+/**
+ * A condition on the returned process data frames; the capture is triggered
+ * when the condition becomes true
+ */
+struct TriggerCondition
+{
+    enum Kind
+    {
+        WORKING_COUNTER, // the working counter is not the expected one
+        THRESHOLD, // the field compared with threshold
+        BITS // any bit of mask is set in the field
+    };
+    enum Comparison
+    {
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        EQUAL,
+        NOT_EQUAL
+    };
+    std::string text; // as given by the user, reported when the capture is triggered
+    Kind kind;
+    FieldSelector field;
+    Comparison comparison;
+    double threshold;
+    uint64_t mask;
+    bool negate;
+};
+
+/**
+ * Parses a comma separated list of conditions:
+ *  - wkc: the working counter is not the expected one
+ *  - SLAVE.FIELD OP NUMBER, where OP is one of > >= < <= == !=
+ *  - SLAVE.FIELD & MASK: any bit of MASK (decimal or 0x...) is set
+ *  - SLAVE.FIELD.BIT: the named bit is set, e.g. 5.status1.OVERTEMP_1
+ * where SLAVE is the number or the name of the slave as for kddv-extract.
+ * The last two can be negated with !
+ */
+void parseTriggerConditions(const std::string &conditions, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                            std::vector<TriggerCondition> &result, std::string &error);
+
+struct TriggerCaptureOptions
+{
+    TriggerCaptureOptions() : compression(COMPRESSION_NONE), pre_trigger_time(10.0), post_trigger_time(5.0),
+                              buffer_size(256 * 1024 * 1024) {}
+    // files to write for each trigger, numbered like the files of FrameRecorder; either may be empty
+    std::string pcap_filename;
+    std::string columnar_filename;
+    Compression compression; // of the pcapng files
+    double pre_trigger_time; // seconds
+    double post_trigger_time; // seconds
+    size_t buffer_size; // bytes of the ring buffer; limits the pre-trigger window at high frame rates
+};
+
+/**
+ * Keeps the frames of the last pre_trigger_time seconds in a ring buffer of
+ * fixed size, and when a condition becomes true (or on trigger()), writes
+ * them and the frames of the next post_trigger_time seconds to a pcapng
+ * and/or a columnar recording.
+ *
+ * The conditions are checked on every frame in the capture thread, so no
+ * edge is missed. The files are written in a separate thread, which reads
+ * the frames directly from the ring buffer: while it writes, old frames are
+ * not removed from the buffer, and if the buffer becomes full, new frames
+ * are dropped and counted rather than delaying the capture. A trigger
+ * during the post-trigger window extends the window; later triggers are
+ * ignored (and counted) until the files are written.
+ */
+class TriggerCapture : public FrameListener
+{
+    public:
+        TriggerCapture(const TriggerCaptureOptions &options, const std::vector<TriggerCondition> &conditions,
+                       const std::vector<std::shared_ptr<EthercatSlave>> &slaves, MetricsRegistry &metrics);
+        virtual ~TriggerCapture();
+        void start(std::string &error);
+        /**
+         * A capture in progress is written with the frames received so far
+         */
+        void stop();
+        void addFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us);
+        /**
+         * Triggers the capture at the next frame; can be called from any thread
+         */
+        void trigger();
+
+        int getCaptureCount() const;
+
+    private:
+        struct FrameHeader
+        {
+            uint64_t timestamp_us;
+            uint64_t sequence;
+            uint32_t size;
+            uint32_t padding;
+        };
+
+        TriggerCaptureOptions options;
+        std::vector<TriggerCondition> conditions;
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        Metric &triggers_metric;
+        Metric &ignored_triggers_metric;
+        Metric &dropped_frames_metric;
+        Metric &captures_metric;
+        Metric &buffered_bytes_metric;
+
+        // state of the capture thread
+        std::vector<bool> condition_states;
+        bool has_condition_states;
+        std::atomic_bool manual_trigger;
+        uint64_t next_sequence;
+        uint64_t capture_end_time; // of the post-trigger window
+
+        // the ring buffer: frames (FrameHeader followed by the frame, aligned
+        // to 8 bytes) from tail to head; a header with WRAP_MARKER as size or
+        // less than a header before the end means the next frame is at 0
+        std::vector<uint8_t> ring;
+        std::mutex ring_mutex;
+        std::condition_variable ring_condition;
+        size_t head;
+        size_t tail;
+        size_t frame_count;
+        uint64_t used_bytes;
+        bool running;
+        // a capture is being written; frames are not removed until it is written
+        bool capturing;
+        // frames up to this sequence number belong to the capture (UINT64_MAX while the post-trigger window is open)
+        uint64_t capture_last_sequence;
+        std::string capture_reason;
+        uint64_t capture_trigger_time;
+        std::thread writer_thread;
+
+        bool checkConditions(const uint8_t *frame, uint32_t size, std::string &reason);
+        bool appendFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us);
+        const FrameHeader* getFrame(size_t &position) const;
+        void removeOldestFrame();
+        void writeLoop();
+        void writeCapture(uint64_t trigger_time, const std::string &reason);
+};
+
+#endif
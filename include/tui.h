@@ -10,6 +10,26 @@
 
 #include "ui.h"
 #include <ncurses.h>
+#include <atomic>
+#include <map>
+
+/**
+ * Fixed-size ring of the most recent values of a field, used to draw sparklines
+ */
+class FieldHistory
+{
+    public:
+        FieldHistory(int capacity);
+        void push(double value);
+        int size() const;
+        // i = 0 is the oldest value
+        double at(int i) const;
+
+    private:
+        std::vector<double> values;
+        int next;
+        int count;
+};
 
 class TUI : public UI
 {
@@ -21,8 +41,11 @@ class TUI : public UI
         void setConfigFile(const std::string &path);
         void setPCAPFile(const std::string &path);
         void enableZMQ(bool enable);
+        void setReplaySpeed(double speed);
+        void setTimeRange(double start_time, double end_time);
         void start();
-        void dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves);
+        void setDisplayRate(double rate);
+        void dataCallback(const ProcessImagePtr &image);
     private:
         std::string network_interface;
         std::string ecat_src;
@@ -33,9 +56,54 @@ class TUI : public UI
         WINDOW *instructions_window;
 
         int selected_slave;
+        // TX variable of the selected slave under the cursor in the detail view
+        int selected_field;
+        bool overview_mode;
+        int detail_scroll;
+        int overview_scroll;
+
+        // the layout (names, headers, cursor) is redrawn only when it is marked dirty
+        bool layout_dirty;
+        uint64_t displayed_sequence;
+        // text currently shown in each cell, keyed by (row, column)
+        std::map<std::pair<int, int>, std::string> drawn_cells;
+
+        // lines of the overview: a header before each group of slaves of the same type, then one line per slave
+        struct OverviewLine
+        {
+            bool is_header;
+            int slave_idx;
+        };
+        std::vector<OverviewLine> overview_lines;
+        // TX indices of the overview variables of each slave
+        std::vector<std::vector<int>> overview_fields;
+        // sampled once per displayed frame, keyed by (slave, TX variable)
+        std::map<std::pair<int, int>, FieldHistory> histories;
+
+        // the data source only replaces the latest image and signals the eventfd;
+        // the main thread waits on it and on stdin, and redraws on fixed frames at the display rate
+        ProcessImagePtr latest_image;
+        int wakeup_fd;
+        std::atomic_bool wakeup_pending;
+        double display_rate;
+        // owned by the metrics registry of the data source
+        Metric *frames_displayed_metric;
 
         void setupWindow();
+        void runEventLoop();
+        void handleKey(int input);
+        bool handleReplayKey(int input);
+        void setupOverview();
+        void drawData();
+        void drawLayout();
+        void drawDetailLayout();
+        void drawOverviewLayout();
+        void drawDetailValues(const ProcessImage &image);
+        void drawOverviewValues(const ProcessImage &image);
+        void drawValue(int row, int end_col, const std::string &value);
+        void drawSparkline(int row, int col, const FieldHistory &history);
         void writeStatus(const std::string &msg);
+        void writeMetricsStatus();
 };
 
 #endif
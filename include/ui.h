@@ -12,23 +12,50 @@
 #include "ethercat_slave.h"
 #include "ethercat_data_source.h"
 #include <memory>
+#include <sstream>
+
+// replay speeds of PCAP files offered by the UIs, as factors of the recorded speed; 0 is as fast as possible
+const double REPLAY_SPEEDS[] = {0.1, 0.25, 0.5, 1.0, 2.0, 5.0, 10.0, 0.0};
+const int REPLAY_SPEED_COUNT = sizeof(REPLAY_SPEEDS) / sizeof(REPLAY_SPEEDS[0]);
+
+inline std::string formatReplaySpeed(double speed)
+{
+    if (speed <= 0.0)
+    {
+        return "max";
+    }
+    std::ostringstream text;
+    text << speed << "x";
+    return text.str();
+}
 
 class UI
 {
     public:
-        UI(std::shared_ptr<ZMQPublisher> zmq_pub) : zmq_pub(zmq_pub) {};
+        UI(std::shared_ptr<ZMQPublisher> zmq_pub) : zmq_pub(zmq_pub), replay_speed(1.0), replay_start_time(0.0), replay_end_time(-1.0) {};
         virtual ~UI() {};
         virtual void selectSource(const std::string &src) = 0;
         virtual void selectNetworkInterface(const std::string &iface) = 0;
         virtual void setConfigFile(const std::string &path) = 0;
         virtual void setPCAPFile(const std::string &path) = 0;
         virtual void enableZMQ(bool enable) = 0;
+        virtual void setReplaySpeed(double speed) = 0;
+        /**
+         * Range of a PCAP file to replay, in seconds since its first frame; a negative end_time replays until the end
+         */
+        virtual void setTimeRange(double start_time, double end_time) = 0;
         virtual void start() = 0;
-        virtual void dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves) = 0;
+        virtual void dataCallback(const ProcessImagePtr &image) = 0;
     protected:
         std::shared_ptr<ZMQPublisher> zmq_pub;
         std::shared_ptr<EthercatDataSource> ecat_data_source;
+        // slaves of the current data source, used to decode the process images
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        ValueCache value_cache;
         std::string config_file_name;
         std::string pcap_file_name;
+        double replay_speed;
+        double replay_start_time;
+        double replay_end_time;
 };
 #endif
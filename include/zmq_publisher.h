@@ -9,6 +9,7 @@
 #define ZMQ_PUBLISHER_H_
 
 #include "zmq.hpp"
+#include <mutex>
 
 class ZMQPublisher
 {
@@ -16,8 +17,12 @@ class ZMQPublisher
     public:
         ZMQPublisher(const std::string &port);
         virtual ~ZMQPublisher();
-        void publishMsg(const std::string &json_string);
+        /**
+         * Can be called from several threads; returns false if the message could not be sent
+         */
+        bool publishMsg(const std::string &json_string);
     private:
+        std::mutex publisher_mutex;
         zmq::context_t ctx;
         zmq::socket_t publisher;
 
@@ -0,0 +1,608 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "columnar_recording.h"
+#include "ethercat_data_source.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const char COLUMNAR_MAGIC[8] = {'K', 'D', 'D', 'V', 'C', 'O', 'L', '2'};
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t schema_length;
+        uint32_t block_rows;
+    };
+
+    struct BlockHeader
+    {
+        uint32_t row_count;
+        uint32_t padding;
+        int64_t start_time;
+        int64_t end_time;
+    };
+
+    const char *FIELD_TYPE_NAMES[] = {"uint16", "uint32", "uint64", "float"};
+    const int FIELD_TYPE_COUNT = 4;
+
+    /**
+     * Whether the column of the schema refers to a slave of the schema and to
+     * a field of that slave, if its slave type is known
+     */
+    bool isValidColumn(const Json::Value &column_json, const Json::Value &slaves_json)
+    {
+        if (!column_json.isObject() or !column_json["slave"].isInt() or !column_json["index"].isInt() or
+            !column_json["direction"].isString() or !column_json["field"].isString() or !column_json["type"].isString())
+        {
+            return false;
+        }
+        int slave_idx = column_json["slave"].asInt();
+        int field_idx = column_json["index"].asInt();
+        if (slave_idx < 0 or slave_idx >= static_cast<int>(slaves_json.size()) or field_idx < 0 or
+            !slaves_json[slave_idx].isObject() or !slaves_json[slave_idx]["slave_type"].isUInt())
+        {
+            return false;
+        }
+        std::shared_ptr<EthercatSlave> slave = createSlave(slaves_json[slave_idx]["slave_type"].asUInt());
+        if (!slave)
+        {
+            return true;
+        }
+        bool is_rx = column_json["direction"].asString() == "commands";
+        return field_idx < (is_rx ? slave->getRxLayout() : slave->getTxLayout()).size();
+    }
+
+    size_t alignToPage(size_t offset)
+    {
+        return (offset + ColumnarLayout::PAGE_ALIGNMENT - 1) / ColumnarLayout::PAGE_ALIGNMENT * ColumnarLayout::PAGE_ALIGNMENT;
+    }
+
+    template <typename T>
+    void getIntegerRange(const uint8_t *data, uint32_t count, ColumnStats &stats)
+    {
+        // columns are aligned to pages, so the values can be read in place
+        const T *values = reinterpret_cast<const T*>(data);
+        T min = values[0];
+        T max = values[0];
+        T bits_or = values[0];
+        T bits_and = values[0];
+        for (uint32_t i = 1; i < count; i++)
+        {
+            min = values[i] < min ? values[i] : min;
+            max = values[i] > max ? values[i] : max;
+            bits_or |= values[i];
+            bits_and &= values[i];
+        }
+        stats.min = min;
+        stats.max = max;
+        stats.bits_or = bits_or;
+        stats.bits_and = bits_and;
+        stats.nan_count = 0;
+    }
+
+    void getFloatRange(const uint8_t *data, uint32_t count, ColumnStats &stats)
+    {
+        const float *values = reinterpret_cast<const float*>(data);
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        uint64_t nan_count = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // comparisons with NaN are false, so NaN is skipped
+            min = values[i] < min ? values[i] : min;
+            max = values[i] > max ? values[i] : max;
+            nan_count += values[i] != values[i];
+        }
+        std::memcpy(&stats.min, &min, sizeof(double));
+        std::memcpy(&stats.max, &max, sizeof(double));
+        stats.bits_or = 0;
+        stats.bits_and = 0;
+        stats.nan_count = nan_count;
+    }
+}
+
+const uint32_t ColumnarLayout::BLOCK_ROWS;
+const size_t ColumnarLayout::PAGE_ALIGNMENT;
+
+void ColumnarLayout::setColumns(const std::vector<ColumnInfo> &columns)
+{
+    this->columns = columns;
+    stats_offset = sizeof(BlockHeader);
+    timestamps_offset = alignToPage(stats_offset + columns.size() * sizeof(ColumnStats));
+    size_t offset = timestamps_offset + BLOCK_ROWS * sizeof(int64_t);
+    for (int i = 0; i < this->columns.size(); i++)
+    {
+        this->columns[i].block_offset = offset;
+        offset = alignToPage(offset + BLOCK_ROWS * getFieldSize(this->columns[i].type));
+    }
+    block_size = alignToPage(offset);
+}
+
+ColumnarRecorder::ColumnarRecorder() : file(NULL), block_row_count(0), record_count(0), write_errors(0)
+{
+}
+
+ColumnarRecorder::~ColumnarRecorder()
+{
+    close();
+}
+
+void ColumnarRecorder::open(const std::string &filename, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, std::string &error)
+{
+    close();
+    file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        error = "Could not open recording file " + filename;
+        return;
+    }
+    // blocks are written at once, so a failed write can be undone without a buffer in between
+    std::setvbuf(file, NULL, _IONBF, 0);
+    this->filename = filename;
+    this->slaves = slaves;
+    write_errors = 0;
+
+    // sensors first, since they are what is usually looked at
+    Json::Value schema;
+    std::vector<ColumnInfo> columns;
+    field_offsets.clear();
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        const SlaveInfo &info = slaves[i]->slave_info;
+        Json::Value slave;
+        slave["name"] = info.name;
+        slave["slave_number"] = info.slave_number;
+        slave["slave_type"] = info.slave_type;
+        slave["eep_man"] = info.eep_man;
+        slave["eep_id"] = info.eep_id;
+        slave["eep_rev"] = info.eep_rev;
+        schema["slaves"].append(slave);
+        for (int direction = 0; direction < 2; direction++)
+        {
+            bool is_rx = direction == 1;
+            const std::vector<std::string> &variables = is_rx ? slaves[i]->getRxVariables() : slaves[i]->getTxVariables();
+            const std::vector<std::string> &units = is_rx ? slaves[i]->getRxUnits() : slaves[i]->getTxUnits();
+            const std::vector<FieldLayout> &fields = is_rx ? slaves[i]->getRxLayout() : slaves[i]->getTxLayout();
+            for (int j = 0; j < fields.size(); j++)
+            {
+                ColumnInfo column;
+                column.name = std::to_string(info.slave_number) + "." + variables[j];
+                column.slave_idx = i;
+                column.is_rx = is_rx;
+                column.field_idx = j;
+                column.type = fields[j].type;
+                columns.push_back(column);
+                field_offsets.push_back(fields[j].offset);
+
+                Json::Value column_json;
+                column_json["slave"] = i;
+                column_json["direction"] = is_rx ? "commands" : "sensors";
+                column_json["field"] = variables[j];
+                column_json["index"] = j;
+                column_json["type"] = FIELD_TYPE_NAMES[fields[j].type];
+                column_json["unit"] = j < units.size() ? units[j] : "";
+                schema["columns"].append(column_json);
+            }
+        }
+    }
+    layout.setColumns(columns);
+
+    Json::StreamWriterBuilder json_stream_builder;
+    json_stream_builder["indentation"] = "";
+    std::string schema_string = Json::writeString(json_stream_builder, schema);
+    FileHeader header;
+    std::memcpy(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    header.schema_length = schema_string.size();
+    header.block_rows = ColumnarLayout::BLOCK_ROWS;
+    std::vector<uint8_t> header_bytes(alignToPage(sizeof(header) + schema_string.size()), 0);
+    std::memcpy(&header_bytes[0], &header, sizeof(header));
+    std::memcpy(&header_bytes[sizeof(header)], schema_string.data(), schema_string.size());
+    if (std::fwrite(&header_bytes[0], 1, header_bytes.size(), file) != header_bytes.size())
+    {
+        error = "Could not write recording file " + filename;
+        close();
+        return;
+    }
+
+    block.assign(layout.block_size, 0);
+    block_row_count = 0;
+    record_count = 0;
+    rx_data.assign(slaves.size(), NULL);
+    tx_data.assign(slaves.size(), NULL);
+}
+
+void ColumnarRecorder::close()
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    writeBlock();
+    // a failed write may have closed the file already
+    if (file != NULL and std::fclose(file) != 0)
+    {
+        write_errors++;
+        std::cerr << "Could not close recording file " << filename << std::endl;
+    }
+    file = NULL;
+}
+
+void ColumnarRecorder::record(const ProcessImage &image)
+{
+    TraceScope trace("record", "ColumnarRecorder::record");
+    if (file == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        rx_data[i] = image.getRxData(i);
+        tx_data[i] = image.getTxData(i);
+    }
+    addRow(std::llround(image.timestamp * 1000000));
+}
+
+std::shared_ptr<ImageEncoder> ColumnarRecorder::createEncoder() const
+{
+    return std::make_shared<ColumnarRowEncoder>(slaves);
+}
+
+void ColumnarRecorder::recordEncoded(const std::string &output, uint64_t image_count)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    const uint8_t *row = reinterpret_cast<const uint8_t*>(output.data());
+    for (uint64_t n = 0; n < image_count; n++)
+    {
+        int64_t timestamp_us;
+        std::memcpy(&timestamp_us, row, sizeof(timestamp_us));
+        row += sizeof(timestamp_us);
+        for (int i = 0; i < slaves.size(); i++)
+        {
+            rx_data[i] = row;
+            row += slaves[i]->getRxSize();
+            tx_data[i] = row;
+            row += slaves[i]->getTxSize();
+        }
+        addRow(timestamp_us);
+    }
+}
+
+uint64_t ColumnarRecorder::getRecordCount() const
+{
+    return record_count;
+}
+
+uint64_t ColumnarRecorder::getWriteErrors() const
+{
+    return write_errors;
+}
+
+void ColumnarRecorder::addRow(int64_t timestamp_us)
+{
+    std::memcpy(&block[layout.timestamps_offset + block_row_count * sizeof(int64_t)], &timestamp_us, sizeof(int64_t));
+    for (int i = 0; i < layout.columns.size(); i++)
+    {
+        const ColumnInfo &column = layout.columns[i];
+        const uint8_t *data = column.is_rx ? rx_data[column.slave_idx] : tx_data[column.slave_idx];
+        size_t size = getFieldSize(column.type);
+        std::memcpy(&block[column.block_offset + block_row_count * size], data + field_offsets[i], size);
+    }
+    block_row_count++;
+    record_count++;
+    if (block_row_count == ColumnarLayout::BLOCK_ROWS)
+    {
+        writeBlock();
+    }
+}
+
+void ColumnarRecorder::writeBlock()
+{
+    if (block_row_count == 0)
+    {
+        return;
+    }
+    BlockHeader header;
+    header.row_count = block_row_count;
+    header.padding = 0;
+    const int64_t *timestamps = reinterpret_cast<const int64_t*>(&block[layout.timestamps_offset]);
+    header.start_time = timestamps[0];
+    header.end_time = timestamps[0];
+    for (uint32_t i = 1; i < block_row_count; i++)
+    {
+        header.start_time = std::min(header.start_time, timestamps[i]);
+        header.end_time = std::max(header.end_time, timestamps[i]);
+    }
+    std::memcpy(&block[0], &header, sizeof(header));
+    for (int i = 0; i < layout.columns.size(); i++)
+    {
+        const uint8_t *values = &block[layout.columns[i].block_offset];
+        ColumnStats stats;
+        switch (layout.columns[i].type)
+        {
+            case FIELD_UINT16:
+                getIntegerRange<uint16_t>(values, block_row_count, stats);
+                break;
+            case FIELD_UINT32:
+                getIntegerRange<uint32_t>(values, block_row_count, stats);
+                break;
+            case FIELD_UINT64:
+                getIntegerRange<uint64_t>(values, block_row_count, stats);
+                break;
+            case FIELD_FLOAT:
+                getFloatRange(values, block_row_count, stats);
+                break;
+        }
+        std::memcpy(&block[layout.stats_offset + i * sizeof(ColumnStats)], &stats, sizeof(stats));
+    }
+    off_t position = ftello(file);
+    if (std::fwrite(&block[0], 1, block.size(), file) != block.size())
+    {
+        // the partially written block is removed, so the next block is written in its place
+        // and the blocks stay aligned; the rows of this block are lost
+        std::cerr << "Could not write recording file " << filename << ", " << block_row_count << " rows are lost" << std::endl;
+        write_errors++;
+        record_count -= block_row_count;
+        std::clearerr(file);
+        if (position < 0 or ftruncate(fileno(file), position) != 0 or fseeko(file, position, SEEK_SET) != 0)
+        {
+            // without knowing where the block started, further blocks would not be readable
+            std::fclose(file);
+            file = NULL;
+        }
+    }
+    std::fill(block.begin(), block.end(), 0);
+    block_row_count = 0;
+}
+
+ColumnarRowEncoder::ColumnarRowEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves) : slaves(slaves)
+{
+}
+
+void ColumnarRowEncoder::startChunk()
+{
+}
+
+void ColumnarRowEncoder::encode(const ProcessImage &image, std::string &output)
+{
+    int64_t timestamp_us = std::llround(image.timestamp * 1000000);
+    output.append(reinterpret_cast<const char*>(&timestamp_us), sizeof(timestamp_us));
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        output.append(reinterpret_cast<const char*>(image.getRxData(i)), slaves[i]->getRxSize());
+        output.append(reinterpret_cast<const char*>(image.getTxData(i)), slaves[i]->getTxSize());
+    }
+}
+
+ColumnarReader::ColumnarReader() : mapping(NULL), file_size(0), data_offset(0), block_count(0)
+{
+}
+
+ColumnarReader::~ColumnarReader()
+{
+    close();
+}
+
+void ColumnarReader::open(const std::string &filename, std::string &error)
+{
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 and file_stat.st_size >= static_cast<off_t>(sizeof(FileHeader)))
+    {
+        void *address = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            mapping = static_cast<const uint8_t*>(address);
+            file_size = file_stat.st_size;
+            // reading ahead would read the other columns
+            madvise(address, file_size, MADV_RANDOM);
+        }
+        else
+        {
+            error = "Could not map file " + filename;
+        }
+    }
+    else
+    {
+        error = filename + " is not a columnar recording";
+    }
+    // the mapping keeps the file open
+    ::close(fd);
+    if (!error.empty())
+    {
+        return;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    Json::CharReaderBuilder reader_builder;
+    std::unique_ptr<Json::CharReader> json_reader(reader_builder.newCharReader());
+    const char *schema_start = reinterpret_cast<const char*>(mapping) + sizeof(header);
+    if (std::memcmp(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC) - 1) == 0 and
+        std::memcmp(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0)
+    {
+        error = filename + " was written by an incompatible version";
+        close();
+        return;
+    }
+    if (std::memcmp(header.magic, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) != 0 or
+        header.schema_length > file_size - sizeof(header) or
+        !json_reader->parse(schema_start, schema_start + header.schema_length, &schema, NULL))
+    {
+        error = filename + " is not a columnar recording";
+        close();
+        return;
+    }
+    if (header.block_rows != ColumnarLayout::BLOCK_ROWS)
+    {
+        error = filename + " has an unsupported block size";
+        close();
+        return;
+    }
+    if (!schema.isObject() or !schema["columns"].isArray() or !schema["slaves"].isArray())
+    {
+        error = filename + " is not a columnar recording";
+        close();
+        return;
+    }
+    std::vector<ColumnInfo> columns;
+    for (int i = 0; i < schema["columns"].size(); i++)
+    {
+        const Json::Value &column_json = schema["columns"][i];
+        if (!isValidColumn(column_json, schema["slaves"]))
+        {
+            error = filename + " has a malformed column";
+            close();
+            return;
+        }
+        ColumnInfo column;
+        column.slave_idx = column_json["slave"].asInt();
+        column.is_rx = column_json["direction"].asString() == "commands";
+        column.field_idx = column_json["index"].asInt();
+        column.name = schema["slaves"][column.slave_idx]["slave_number"].asString() + "." + column_json["field"].asString();
+        int type = 0;
+        while (type < FIELD_TYPE_COUNT and column_json["type"].asString() != FIELD_TYPE_NAMES[type])
+        {
+            type++;
+        }
+        if (type == FIELD_TYPE_COUNT)
+        {
+            error = filename + " has a column of unknown type " + column_json["type"].asString();
+            close();
+            return;
+        }
+        column.type = static_cast<FieldType>(type);
+        columns.push_back(column);
+    }
+    layout.setColumns(columns);
+    data_offset = alignToPage(sizeof(header) + header.schema_length);
+    // a block which is only partially written (e.g. by a recorder that is still running) is ignored
+    block_count = file_size > data_offset ? (file_size - data_offset) / layout.block_size : 0;
+    for (int i = 0; i < block_count; i++)
+    {
+        if (getRowCount(i) > ColumnarLayout::BLOCK_ROWS)
+        {
+            error = filename + " has a malformed block";
+            close();
+            return;
+        }
+    }
+}
+
+void ColumnarReader::close()
+{
+    if (mapping != NULL)
+    {
+        munmap(const_cast<uint8_t*>(mapping), file_size);
+        mapping = NULL;
+    }
+    file_size = 0;
+    block_count = 0;
+}
+
+const Json::Value& ColumnarReader::getSchema() const
+{
+    return schema;
+}
+
+int ColumnarReader::getColumnCount() const
+{
+    return layout.columns.size();
+}
+
+const ColumnInfo& ColumnarReader::getColumn(int column_idx) const
+{
+    return layout.columns[column_idx];
+}
+
+int ColumnarReader::findColumn(const std::string &name) const
+{
+    for (int i = 0; i < layout.columns.size(); i++)
+    {
+        if (layout.columns[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int ColumnarReader::getBlockCount() const
+{
+    return block_count;
+}
+
+uint32_t ColumnarReader::getRowCount(int block_idx) const
+{
+    return reinterpret_cast<const BlockHeader*>(getBlock(block_idx))->row_count;
+}
+
+int64_t ColumnarReader::getStartTime(int block_idx) const
+{
+    return reinterpret_cast<const BlockHeader*>(getBlock(block_idx))->start_time;
+}
+
+int64_t ColumnarReader::getEndTime(int block_idx) const
+{
+    return reinterpret_cast<const BlockHeader*>(getBlock(block_idx))->end_time;
+}
+
+const ColumnStats& ColumnarReader::getStats(int block_idx, int column_idx) const
+{
+    return reinterpret_cast<const ColumnStats*>(getBlock(block_idx) + layout.stats_offset)[column_idx];
+}
+
+const int64_t* ColumnarReader::getTimestamps(int block_idx) const
+{
+    return reinterpret_cast<const int64_t*>(getBlock(block_idx) + layout.timestamps_offset);
+}
+
+const uint8_t* ColumnarReader::getColumnData(int block_idx, int column_idx) const
+{
+    return getBlock(block_idx) + layout.columns[column_idx].block_offset;
+}
+
+double ColumnarReader::getValue(int block_idx, int column_idx, uint32_t row) const
+{
+    const uint8_t *data = getColumnData(block_idx, column_idx);
+    switch (layout.columns[column_idx].type)
+    {
+        case FIELD_UINT16:
+            return reinterpret_cast<const uint16_t*>(data)[row];
+        case FIELD_UINT32:
+            return reinterpret_cast<const uint32_t*>(data)[row];
+        case FIELD_UINT64:
+            return static_cast<double>(reinterpret_cast<const uint64_t*>(data)[row]);
+        case FIELD_FLOAT:
+            return reinterpret_cast<const float*>(data)[row];
+    }
+    return 0.0;
+}
+
+const uint8_t* ColumnarReader::getBlock(int block_idx) const
+{
+    return mapping + data_offset + static_cast<size_t>(block_idx) * layout.block_size;
+}
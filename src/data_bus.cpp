@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "data_bus.h"
+#include "tracer.h"
+#include <chrono>
+
+DataBus::DataBus() : next_id(0)
+{
+}
+
+DataBus::~DataBus()
+{
+    std::vector<std::shared_ptr<Subscriber>> stopped;
+    {
+        std::lock_guard<std::mutex> guard(subscribers_mutex);
+        stopped.swap(subscribers);
+    }
+    for (int i = 0; i < stopped.size(); i++)
+    {
+        stopSubscriber(stopped[i].get());
+    }
+}
+
+int DataBus::subscribe(const std::string &name, const DataCallback &callback, const SubscriberOptions &options)
+{
+    std::shared_ptr<Subscriber> subscriber = std::make_shared<Subscriber>();
+    subscriber->name = name;
+    subscriber->callback = callback;
+    subscriber->options = options;
+    if (subscriber->options.queue_size == 0)
+    {
+        subscriber->options.queue_size = 1;
+    }
+    subscriber->running = true;
+    subscriber->delivered = 0;
+    subscriber->dropped = 0;
+    subscriber->thread = std::thread(&DataBus::runSubscriber, subscriber.get());
+
+    std::lock_guard<std::mutex> guard(subscribers_mutex);
+    subscriber->id = next_id++;
+    subscribers.push_back(subscriber);
+    return subscriber->id;
+}
+
+void DataBus::unsubscribe(int id)
+{
+    std::shared_ptr<Subscriber> subscriber;
+    {
+        std::lock_guard<std::mutex> guard(subscribers_mutex);
+        for (int i = 0; i < subscribers.size(); i++)
+        {
+            if (subscribers[i]->id == id)
+            {
+                subscriber = subscribers[i];
+                subscribers.erase(subscribers.begin() + i);
+                break;
+            }
+        }
+    }
+    if (subscriber)
+    {
+        stopSubscriber(subscriber.get());
+    }
+}
+
+void DataBus::publish(const ProcessImagePtr &image)
+{
+    std::lock_guard<std::mutex> guard(subscribers_mutex);
+    for (int i = 0; i < subscribers.size(); i++)
+    {
+        Subscriber *subscriber = subscribers[i].get();
+        {
+            std::lock_guard<std::mutex> subscriber_guard(subscriber->mutex);
+            if (subscriber->queue.size() >= subscriber->options.queue_size)
+            {
+                subscriber->dropped++;
+                if (subscriber->options.overflow_policy == DROP_NEWEST)
+                {
+                    continue;
+                }
+                subscriber->queue.pop_front();
+            }
+            subscriber->queue.push_back(image);
+        }
+        subscriber->condition.notify_one();
+    }
+}
+
+std::vector<SubscriberStats> DataBus::getStats() const
+{
+    std::vector<SubscriberStats> stats;
+    std::lock_guard<std::mutex> guard(subscribers_mutex);
+    for (int i = 0; i < subscribers.size(); i++)
+    {
+        std::lock_guard<std::mutex> subscriber_guard(subscribers[i]->mutex);
+        SubscriberStats subscriber_stats;
+        subscriber_stats.name = subscribers[i]->name;
+        subscriber_stats.delivered = subscribers[i]->delivered;
+        subscriber_stats.dropped = subscribers[i]->dropped;
+        subscriber_stats.queued = subscribers[i]->queue.size();
+        subscriber_stats.queue_size = subscribers[i]->options.queue_size;
+        stats.push_back(subscriber_stats);
+    }
+    return stats;
+}
+
+void DataBus::runSubscriber(Subscriber *subscriber)
+{
+    Tracer::setThreadName("subscriber " + subscriber->name);
+    std::chrono::steady_clock::duration min_interval(0);
+    if (subscriber->options.max_rate > 0.0)
+    {
+        min_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / subscriber->options.max_rate));
+    }
+    std::chrono::steady_clock::time_point next_delivery = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(subscriber->mutex);
+    while (true)
+    {
+        subscriber->condition.wait(lock, [subscriber] { return !subscriber->running or !subscriber->queue.empty(); });
+        // while waiting for the next slot, new images are queued according to the overflow policy
+        subscriber->condition.wait_until(lock, next_delivery, [subscriber] { return !subscriber->running; });
+        // when stopped, the remaining images are delivered without rate limit
+        if (subscriber->queue.empty())
+        {
+            break;
+        }
+        ProcessImagePtr image = subscriber->queue.front();
+        subscriber->queue.pop_front();
+
+        lock.unlock();
+        subscriber->callback(image);
+        image.reset();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        lock.lock();
+
+        subscriber->delivered++;
+        next_delivery = now + min_interval;
+    }
+}
+
+void DataBus::stopSubscriber(Subscriber *subscriber)
+{
+    {
+        std::lock_guard<std::mutex> guard(subscriber->mutex);
+        subscriber->running = false;
+    }
+    subscriber->condition.notify_one();
+    if (subscriber->thread.joinable())
+    {
+        subscriber->thread.join();
+    }
+}
@@ -6,23 +6,79 @@
  */
 
 #include "ethercat_data_source.h"
+#include "tracer.h"
+#include "kelo_drive_slave.h"
+#include "robile_battery_slave.h"
+#include "kelo_bms_slave.h"
 #include <iostream>
 #include <net/if.h>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <sstream>
 
-EthercatDataSource::EthercatDataSource(std::shared_ptr<ZMQPublisher> zmq_pub) : zmq_pub(zmq_pub)
+EthercatDataSource::EthercatDataSource(std::shared_ptr<ZMQPublisher> zmq_pub) : zmq_pub(zmq_pub),
+    frames_seen_metric(metrics.getMetric("kddv_frames_seen_total", METRIC_COUNTER, "EtherCAT frames received by the data source")),
+    frames_filtered_metric(metrics.getMetric("kddv_frames_filtered_total", METRIC_COUNTER, "Frames which were ignored because they do not contain the process data")),
+    working_counter_errors_metric(metrics.getMetric("kddv_working_counter_errors_total", METRIC_COUNTER, "Frames with an unexpected working counter")),
+    zmq_subscription(-1),
+    frames_decoded_metric(metrics.getMetric("kddv_frames_decoded_total", METRIC_COUNTER, "Process images created from frames")),
+    metrics_running(false),
+    image_sequence(0)
 {
     zmq_publish_enabled = false;
-    json_stream_builder["indentation"] = "";
 }
 
 EthercatDataSource::~EthercatDataSource()
 {
+    if (metrics_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> guard(metrics_mutex);
+            metrics_running = false;
+        }
+        metrics_condition.notify_one();
+        metrics_thread.join();
+    }
 }
 
-void EthercatDataSource::setDataCallback(DataCallbackFunction callback_fn, UI *ui_obj)
+DataBus& EthercatDataSource::getDataBus()
 {
-    ui = ui_obj;
-    this->callback_fn = callback_fn;
+    return data_bus;
+}
+
+MetricsRegistry& EthercatDataSource::getMetrics()
+{
+    return metrics;
+}
+
+void EthercatDataSource::setMetricsFile(const std::string &filename)
+{
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+    metrics_file = filename;
+}
+
+std::string EthercatDataSource::getMetricsSummary() const
+{
+    std::vector<SubscriberStats> stats = data_bus.getStats();
+    size_t max_queued = 0;
+    uint64_t dropped = 0;
+    for (int i = 0; i < stats.size(); i++)
+    {
+        max_queued = std::max(max_queued, stats[i].queued);
+        dropped += stats[i].dropped;
+    }
+    std::ostringstream summary;
+    summary << "frames: " << metrics.getValue("kddv_frames_seen_total")
+            << ", decoded: " << metrics.getValue("kddv_frames_decoded_total")
+            << ", kernel drops: " << metrics.getValue("kddv_kernel_dropped_frames_total")
+            << ", index gaps: " << metrics.getValue("kddv_datagram_index_gaps_total")
+            << ", late/missing responses: " << metrics.getValue("kddv_late_responses_total")
+            << "/" << metrics.getValue("kddv_missing_responses_total")
+            << ", max queue: " << max_queued
+            << ", queue drops: " << dropped
+            << ", ZMQ failures: " << metrics.getValue("kddv_zmq_send_failures_total");
+    return summary.str();
 }
 
 void EthercatDataSource::setZMQPublish(bool value)
@@ -30,21 +86,141 @@ void EthercatDataSource::setZMQPublish(bool value)
     this->zmq_publish_enabled = value;
 }
 
-std::string EthercatDataSource::convertToJson(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+void EthercatDataSource::prepareRun()
 {
+    image_pool = std::make_shared<ProcessImagePool>(slaves);
+    std::atomic_store(&latest_image, ProcessImagePtr());
+    image_sequence = 0;
 
-    auto millisec_since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    double secs_since_epoch = millisec_since_epoch / 1000.0;
-    Json::Value root;
-    root["timestamp"] = secs_since_epoch;
-    for (int i = 0; i < slaves.size(); i++)
+    if (zmq_subscription >= 0)
     {
-        Json::Value slaveData;
-        slaves[i]->convertToJson(slaveData);
-        root[slaves[i]->slave_info.name + " " + std::to_string(slaves[i]->slave_info.slave_number)] = slaveData;
+        data_bus.unsubscribe(zmq_subscription);
+        zmq_subscription = -1;
+    }
+    if (zmq_pub)
+    {
+        // the encoder is only used in the publisher's thread; publishing can be enabled and disabled while running
+        std::shared_ptr<JsonEncoder> json_encoder = std::make_shared<JsonEncoder>();
+        json_encoder->setSlaves(slaves);
+        Metric *messages_metric = &metrics.getMetric("kddv_zmq_messages_total", METRIC_COUNTER, "Messages sent on the ZMQ socket");
+        Metric *failures_metric = &metrics.getMetric("kddv_zmq_send_failures_total", METRIC_COUNTER, "Messages which could not be sent on the ZMQ socket");
+        Metric *serialization_metric = &metrics.getMetric("kddv_zmq_serialization_microseconds_total", METRIC_COUNTER,
+                                                          "Time spent converting process images to JSON");
+        // only the latest image is published, like the UIs display it, rather than every cycle
+        SubscriberOptions options;
+        options.max_rate = ZMQ_PUBLISH_RATE;
+        zmq_subscription = data_bus.subscribe("zmq", [this, json_encoder, messages_metric, failures_metric, serialization_metric](const ProcessImagePtr &image)
+        {
+            if (!zmq_publish_enabled)
+            {
+                return;
+            }
+            std::chrono::steady_clock::time_point encode_start = std::chrono::steady_clock::now();
+            auto millisec_since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            double secs_since_epoch = millisec_since_epoch / 1000.0;
+            std::string msg = json_encoder->encode(*image, secs_since_epoch);
+            serialization_metric->add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - encode_start).count());
+            if (zmq_pub->publishMsg(msg))
+            {
+                messages_metric->add();
+            }
+            else
+            {
+                failures_metric->add();
+            }
+        }, options);
+    }
+
+    if (!metrics_thread.joinable())
+    {
+        metrics_running = true;
+        metrics_thread = std::thread(&EthercatDataSource::metricsLoop, this);
+    }
+}
+
+void EthercatDataSource::metricsLoop()
+{
+    Tracer::setThreadName("metrics");
+    std::unique_lock<std::mutex> lock(metrics_mutex);
+    while (metrics_running)
+    {
+        metrics_condition.wait_for(lock, std::chrono::seconds(1));
+        if (!metrics_running)
+        {
+            break;
+        }
+        lock.unlock();
+        reportMetrics();
+        lock.lock();
     }
-    std::string json_string = Json::writeString(json_stream_builder, root);
-    return json_string;
+}
+
+void EthercatDataSource::reportMetrics()
+{
+    std::vector<SubscriberStats> stats = data_bus.getStats();
+    for (int i = 0; i < stats.size(); i++)
+    {
+        std::string labels = "subscriber=\"" + stats[i].name + "\"";
+        metrics.getMetric("kddv_subscriber_queued_images", METRIC_GAUGE, "Images waiting in the queue of a subscriber", labels).set(stats[i].queued);
+        metrics.getMetric("kddv_subscriber_delivered_images_total", METRIC_COUNTER, "Images handled by a subscriber", labels).set(stats[i].delivered);
+        metrics.getMetric("kddv_subscriber_dropped_images_total", METRIC_COUNTER, "Images dropped because the queue of a subscriber was full", labels).set(stats[i].dropped);
+    }
+    struct timespec cpu_time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time) == 0)
+    {
+        metrics.getMetric("kddv_cpu_microseconds_total", METRIC_COUNTER, "CPU time used by the process").set(
+                static_cast<uint64_t>(cpu_time.tv_sec) * 1000000 + cpu_time.tv_nsec / 1000);
+    }
+
+    std::string filename;
+    {
+        std::lock_guard<std::mutex> guard(metrics_mutex);
+        filename = metrics_file;
+    }
+    if (!filename.empty())
+    {
+        std::string error;
+        metrics.writePrometheusFile(filename, error);
+        if (!error.empty())
+        {
+            std::cerr << error << std::endl;
+        }
+    }
+    if (zmq_pub and zmq_publish_enabled)
+    {
+        // published on the data socket, so that the metrics can be plotted next to the data
+        auto millisec_since_epoch = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        Json::Value root;
+        root["timestamp"] = millisec_since_epoch / 1000.0;
+        root["kddv_metrics"] = metrics.toJson();
+        Json::StreamWriterBuilder json_stream_builder;
+        json_stream_builder["indentation"] = "";
+        zmq_pub->publishMsg(Json::writeString(json_stream_builder, root));
+    }
+}
+
+std::shared_ptr<ProcessImage> EthercatDataSource::createImage()
+{
+    return image_pool->acquire();
+}
+
+ProcessImagePtr EthercatDataSource::commitImage(const std::shared_ptr<ProcessImage> &image)
+{
+    image->sequence = ++image_sequence;
+    frames_decoded_metric.add();
+    ProcessImagePtr committed = image;
+    std::atomic_store(&latest_image, committed);
+    return committed;
+}
+
+ProcessImagePtr EthercatDataSource::getLatestImage() const
+{
+    return std::atomic_load(&latest_image);
+}
+
+void EthercatDataSource::publishImage(const ProcessImagePtr &image)
+{
+    data_bus.publish(image);
 }
 
 uint8_t getSlaveType(const std::string &name)
@@ -64,6 +240,23 @@ uint8_t getSlaveType(const std::string &name)
     return -1;
 }
 
+std::shared_ptr<EthercatSlave> createSlave(uint8_t slave_type)
+{
+    if (slave_type == ROBILE_BATTERY_SLAVE)
+    {
+        return std::make_shared<RobileBatterySlave>();
+    }
+    if (slave_type == KELO_DRIVE_SLAVE)
+    {
+        return std::make_shared<KeloDriveSlave>();
+    }
+    if (slave_type == KELO_BMS_SLAVE)
+    {
+        return std::make_shared<KeloBMSSlave>();
+    }
+    return std::shared_ptr<EthercatSlave>();
+}
+
 std::vector<std::string> getNetworkInterfaces()
 {
     std::vector<std::string> interfaces;
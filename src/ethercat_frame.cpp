@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "ethercat_frame.h"
+#include <cstring>
+
+extern "C" {
+#include "ethercat.h"
+}
+
+bool parseEthercatFrame(const uint8_t *frame, uint32_t size, EthercatFrame &result)
+{
+    if (size < ETHERNET_HEADER_SIZE + sizeof(ec_comt))
+    {
+        return false;
+    }
+    ec_comt ethercat_header;
+    std::memcpy(&ethercat_header, frame + ETHERNET_HEADER_SIZE, sizeof(ec_comt));
+    // the first slave sets the locally administered bit of the source address of the frames sent by the master
+    result.returned = (frame[6] & 0x02) != 0;
+    result.command = ethercat_header.command;
+    result.index = ethercat_header.index;
+    result.datagram = frame + ETHERNET_HEADER_SIZE + sizeof(ec_comt);
+    result.datagram_size = ((int)(ethercat_header.dlength) & 0x0fff);
+    if (ETHERNET_HEADER_SIZE + sizeof(ec_comt) + result.datagram_size + 2 > size)
+    {
+        return false;
+    }
+    result.working_counter = 0;
+    std::memcpy(&result.working_counter, result.datagram + result.datagram_size, 2);
+    return true;
+}
+
+bool copyFrameData(const EthercatFrame &frame, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                   ProcessImage &image, const ProcessImage *previous)
+{
+    // the frame may point into a mapped file, so nothing outside the datagram is read
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        const SlaveInfo &slave_info = slaves[i]->slave_info;
+        if (slave_info.rx_start_offset < 0 or slave_info.tx_start_offset < 0 or
+            slave_info.rx_start_offset + slaves[i]->getRxSize() > frame.datagram_size or
+            slave_info.tx_start_offset + slaves[i]->getTxSize() > frame.datagram_size)
+        {
+            return false;
+        }
+    }
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        const uint8_t *rx_data = frame.datagram + slaves[i]->slave_info.rx_start_offset;
+        const uint8_t *tx_data = frame.datagram + slaves[i]->slave_info.tx_start_offset;
+        image.copySlaveData(i, rx_data, tx_data, previous);
+    }
+    return true;
+}
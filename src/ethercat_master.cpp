@@ -17,6 +17,7 @@
 #include "robile_battery_slave.h"
 #include "kelo_drive_slave.h"
 #include "kelo_bms_slave.h"
+#include "tracer.h"
 #include <ctime>
 
 EthercatMaster::EthercatMaster(const std::string &ifname, std::shared_ptr<ZMQPublisher> zmq_pub) : EthercatDataSource(zmq_pub), ifname(ifname), ethercat_running(false)
@@ -29,7 +30,6 @@ EthercatMaster::~EthercatMaster()
     {
         ethercat_running = false;
         if (ethercat_thread.joinable()) ethercat_thread.join();
-        if (data_copy_thread.joinable()) data_copy_thread.join();
     }
 }
 
@@ -54,19 +54,7 @@ std::vector<std::shared_ptr<EthercatSlave>>& EthercatMaster::getSlaves(std::stri
                 uint8_t slave_type = getSlaveType(std::string(ec_slave[cnt].name));
                 if (slave_type == KELO_DRIVE_SLAVE or slave_type == ROBILE_BATTERY_SLAVE)
                 {
-                    std::shared_ptr<EthercatSlave> slave;
-                    if (slave_type == ROBILE_BATTERY_SLAVE)
-                    {
-                        slave = std::make_shared<RobileBatterySlave>();
-                    }
-                    else if (slave_type == KELO_DRIVE_SLAVE)
-                    {
-                        slave = std::make_shared<KeloDriveSlave>();
-                    }
-                    else if (slave_type == KELO_BMS_SLAVE)
-                    {
-                        slave = std::make_shared<KeloBMSSlave>();
-                    }
+                    std::shared_ptr<EthercatSlave> slave = createSlave(slave_type);
                     slave->slave_info.slave_type = slave_type;
                     slave->slave_info.name = std::string(ec_slave[cnt].name);
                     slave->slave_info.slave_number = cnt;
@@ -98,6 +86,7 @@ std::vector<std::shared_ptr<EthercatSlave>>& EthercatMaster::getSlaves(std::stri
 
 void EthercatMaster::start(std::string &error)
 {
+    prepareRun();
     if (ec_init(ifname.c_str()))
     {
         if (ec_config_init(FALSE) > 0)
@@ -124,7 +113,6 @@ void EthercatMaster::start(std::string &error)
             {
                 ethercat_running = true;
                 ethercat_thread = std::thread(&EthercatMaster::ethercatLoop, this);
-                data_copy_thread = std::thread(&EthercatMaster::dataCopyLoop, this);
             }
             if (expected_wkcnt != wkcnt)
             {
@@ -149,7 +137,6 @@ void EthercatMaster::stop()
     {
         ethercat_running = false;
         if (ethercat_thread.joinable()) ethercat_thread.join();
-        if (data_copy_thread.joinable()) data_copy_thread.join();
     }
 }
 
@@ -158,16 +145,22 @@ void EthercatMaster::ethercatLoop()
     int wkcnt = 0;
     // each slave gets +3 for read/write: https://infosys.beckhoff.com/english.php?content=../content/1033/tc3_io_intro/1446515467.html&id= 
     int expected_wkcnt = slaves.size() * 3;
+    Tracer::setThreadName("ethercat");
     while (1)
     {
         if (!ethercat_running)
         {
             break;
         }
-        ec_send_processdata();
-        wkcnt = ec_receive_processdata(EC_TIMEOUTRET);
+        {
+            TraceScope trace("capture", "EthercatMaster::ethercatLoop");
+            ec_send_processdata();
+            wkcnt = ec_receive_processdata(EC_TIMEOUTRET);
+        }
+        frames_seen_metric.add();
         if (expected_wkcnt != wkcnt)
         {
+            working_counter_errors_metric.add();
             // TODO: add a callback to the UI to display errors
             std::cout << "Working counter is " << wkcnt << " but expected " << expected_wkcnt << std::endl;
         }
@@ -179,39 +172,16 @@ void EthercatMaster::ethercatLoop()
 
 void EthercatMaster::copyData()
 {
-    // only copy if we can get ownership of the lock
-    // https://stackoverflow.com/questions/33980860/use-stdlock-guard-with-try-lock/
-    if (auto lock = std::unique_lock<std::mutex>(data_mutex, std::try_to_lock))
+    TraceScope trace("decode", "EthercatMaster::copyData");
+    std::shared_ptr<ProcessImage> image = createImage();
+    ProcessImagePtr previous = getLatestImage();
+    auto microsec_since_epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    image->timestamp = microsec_since_epoch / 1000000.0;
+    for (int i = 0; i < slaves.size(); i++)
     {
-        for (int i = 0; i < slaves.size(); i++)
-        {
-            slaves[i]->copyData(ec_slave[slaves[i]->slave_info.slave_number].outputs,
-                                ec_slave[slaves[i]->slave_info.slave_number].inputs);
-        }
+        image->copySlaveData(i, ec_slave[slaves[i]->slave_info.slave_number].outputs,
+                             ec_slave[slaves[i]->slave_info.slave_number].inputs, previous.get());
     }
+    // the subscribers of the data bus each handle the image in their own thread
+    publishImage(commitImage(image));
 }
-void EthercatMaster::dataCopyLoop()
-{
-    while (1)
-    {
-        if (!ethercat_running)
-        {
-            break;
-        }
-
-        // lock mutex within this scope
-        {
-            std::lock_guard<std::mutex> guard(data_mutex);
-            // TODO: consider only creating a copy within this lock,
-            // and publish the copied data outside the lock
-            (ui->*callback_fn)(slaves);
-            if (zmq_publish_enabled)
-            {
-                zmq_pub->publishMsg(convertToJson(slaves));
-            }
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    }
-    ec_close();
-}
-
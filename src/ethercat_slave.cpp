@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "ethercat_slave.h"
+#include <cstring>
+
+size_t getFieldSize(FieldType type)
+{
+    switch (type)
+    {
+        case FIELD_UINT16:
+            return sizeof(uint16_t);
+        case FIELD_UINT32:
+            return sizeof(uint32_t);
+        case FIELD_UINT64:
+            return sizeof(uint64_t);
+        case FIELD_FLOAT:
+            return sizeof(float);
+    }
+    return 0;
+}
+
+EthercatSlave::EthercatSlave(const std::vector<FieldLayout> &rx_layout, const std::vector<FieldLayout> &tx_layout,
+                             size_t rx_size, size_t tx_size)
+    : rx_layout(rx_layout), tx_layout(tx_layout), rx_size(rx_size), tx_size(tx_size)
+{
+}
+
+size_t EthercatSlave::getRxSize() const
+{
+    return rx_size;
+}
+
+size_t EthercatSlave::getTxSize() const
+{
+    return tx_size;
+}
+
+const std::vector<FieldLayout>& EthercatSlave::getRxLayout() const
+{
+    return rx_layout;
+}
+
+const std::vector<FieldLayout>& EthercatSlave::getTxLayout() const
+{
+    return tx_layout;
+}
+
+std::string EthercatSlave::formatRxValue(const uint8_t *rx_data, int idx) const
+{
+    return formatField(rx_layout[idx], rx_data);
+}
+
+std::string EthercatSlave::formatTxValue(const uint8_t *tx_data, int idx) const
+{
+    return formatField(tx_layout[idx], tx_data);
+}
+
+uint64_t EthercatSlave::decodeRxInteger(const uint8_t *rx_data, int idx) const
+{
+    return decodeInteger(rx_layout[idx], rx_data);
+}
+
+uint64_t EthercatSlave::decodeTxInteger(const uint8_t *tx_data, int idx) const
+{
+    return decodeInteger(tx_layout[idx], tx_data);
+}
+
+double EthercatSlave::decodeRxDouble(const uint8_t *rx_data, int idx) const
+{
+    return decodeDouble(rx_layout[idx], rx_data);
+}
+
+double EthercatSlave::decodeTxDouble(const uint8_t *tx_data, int idx) const
+{
+    return decodeDouble(tx_layout[idx], tx_data);
+}
+
+void EthercatSlave::convertToJson(const uint8_t *rx_data, const uint8_t *tx_data, Json::Value &data) const
+{
+    const std::vector<std::string> &rx_vars = getRxVariables();
+    const std::vector<std::string> &tx_vars = getTxVariables();
+    for (int i = 0; i < rx_layout.size(); i++)
+    {
+        data["commands"][rx_vars[i]] = decodeJson(rx_layout[i], rx_data);
+    }
+    for (int i = 0; i < tx_layout.size(); i++)
+    {
+        data["sensors"][tx_vars[i]] = decodeJson(tx_layout[i], tx_data);
+    }
+}
+
+std::string EthercatSlave::formatField(const FieldLayout &field, const uint8_t *data)
+{
+    if (field.type == FIELD_FLOAT)
+    {
+        float val;
+        std::memcpy(&val, data + field.offset, sizeof(float));
+        return std::to_string(val);
+    }
+    return std::to_string(decodeInteger(field, data));
+}
+
+uint64_t EthercatSlave::decodeInteger(const FieldLayout &field, const uint8_t *data)
+{
+    // PDO structs are packed, so copy instead of casting to avoid unaligned reads
+    switch (field.type)
+    {
+        case FIELD_UINT16:
+        {
+            uint16_t val;
+            std::memcpy(&val, data + field.offset, sizeof(uint16_t));
+            return val;
+        }
+        case FIELD_UINT32:
+        {
+            uint32_t val;
+            std::memcpy(&val, data + field.offset, sizeof(uint32_t));
+            return val;
+        }
+        case FIELD_UINT64:
+        {
+            uint64_t val;
+            std::memcpy(&val, data + field.offset, sizeof(uint64_t));
+            return val;
+        }
+        case FIELD_FLOAT:
+        {
+            float val;
+            std::memcpy(&val, data + field.offset, sizeof(float));
+            return static_cast<uint64_t>(val);
+        }
+    }
+    return 0;
+}
+
+double EthercatSlave::decodeDouble(const FieldLayout &field, const uint8_t *data)
+{
+    if (field.type == FIELD_FLOAT)
+    {
+        float val;
+        std::memcpy(&val, data + field.offset, sizeof(float));
+        return val;
+    }
+    return static_cast<double>(decodeInteger(field, data));
+}
+
+Json::Value EthercatSlave::decodeJson(const FieldLayout &field, const uint8_t *data)
+{
+    switch (field.type)
+    {
+        case FIELD_UINT16:
+            return Json::Value(static_cast<Json::UInt>(decodeInteger(field, data)));
+        case FIELD_UINT32:
+            return Json::Value(static_cast<Json::UInt>(decodeInteger(field, data)));
+        case FIELD_UINT64:
+            return Json::Value(static_cast<Json::UInt64>(decodeInteger(field, data)));
+        case FIELD_FLOAT:
+        {
+            float val;
+            std::memcpy(&val, data + field.offset, sizeof(float));
+            return Json::Value(val);
+        }
+    }
+    return Json::Value();
+}
+
+bool EthercatSlave::findBit(const std::string &var_name, const std::string &bit_name, uint16_t &mask)
+{
+    if (!areBitsParsable(var_name))
+    {
+        return false;
+    }
+    // the slaves only format bit fields, so the bit is found by formatting values
+    std::vector<std::string> vars;
+    std::vector<std::string> vals;
+    auto isSet = [&](uint16_t data)
+    {
+        parseBits(data, var_name, vars, vals);
+        for (int i = 0; i < vars.size(); i++)
+        {
+            if (vars[i] == bit_name)
+            {
+                return i < vals.size() and vals[i] != "0";
+            }
+        }
+        return false;
+    };
+    for (int k = 0; k < 16; k++)
+    {
+        uint16_t bit = 1 << k;
+        if (isSet(bit) and !isSet(0) and isSet(0xffff) and !isSet(0xffff & ~bit))
+        {
+            mask = bit;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "packet_sniffer.h"
+#include "field_extractor.h"
+#include "offline_decoder.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+void print_usage(const std::string &exec_name)
+{
+    std::cerr << std::endl << "---------------------------------------" << std::endl;
+    std::cerr << "Usage: " << std::endl;
+    std::cerr << exec_name
+              << std::endl
+              << "\t--config CONFIG_FILE"
+              << std::endl
+              << "\t--pcap PCAP_FILE"
+              << std::endl
+              << "\t--fields FIELDS"
+              << std::endl
+              << "\t[--format FORMAT]"
+              << std::endl
+              << "\t[--output OUTPUT_FILE]"
+              << std::endl
+              << "\t[--start_time START_TIME]"
+              << std::endl
+              << "\t[--end_time END_TIME]"
+              << std::endl
+              << "\t[--jobs JOBS]"
+              << std::endl
+              << "\t[--list_fields]"
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "FIELDS: comma separated list of SLAVE.FIELD, where SLAVE is the slave number or its name, e.g. 5.current_1_q" << std::endl;
+    std::cerr << "FORMAT: csv (default), ndjson or binary" << std::endl;
+    std::cerr << "OUTPUT_FILE: file to write to (default: standard output)" << std::endl;
+    std::cerr << "START_TIME, END_TIME: range of the PCAP file to extract, in seconds since its first frame" << std::endl;
+    std::cerr << "JOBS: number of decoding threads (default: 0, one per core)" << std::endl;
+    std::cerr << "--list_fields: print the fields of the slaves in the config file and exit" << std::endl;
+    std::cerr << "---------------------------------------" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::string config_file;
+    std::string pcap_file;
+    std::string field_list;
+    std::string format_name = "csv";
+    std::string output_file;
+    double start_time = 0.0;
+    double end_time = -1.0;
+    int jobs = 0;
+    bool list_fields = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--list_fields") == 0)
+        {
+            list_fields = true;
+            continue;
+        }
+        if (argc <= i+1)
+        {
+            std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        if (strcmp(argv[i], "--config") == 0)
+        {
+            config_file = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--pcap") == 0)
+        {
+            pcap_file = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--fields") == 0)
+        {
+            field_list = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--format") == 0)
+        {
+            format_name = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--output") == 0)
+        {
+            output_file = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--start_time") == 0)
+        {
+            start_time = atof(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--end_time") == 0)
+        {
+            end_time = atof(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--jobs") == 0)
+        {
+            jobs = atoi(argv[i+1]);
+        }
+        else
+        {
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        i += 1;
+    }
+
+    ExtractFormat format;
+    if (!parseExtractFormat(format_name, format))
+    {
+        std::cerr << "Invalid format '" << format_name << "'" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (config_file.empty() or pcap_file.empty())
+    {
+        std::cerr << "A config file and a PCAP file are required" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+
+    // the slaves are created like for replaying the file, so that they decode the data the same way
+    std::string error_msg;
+    std::vector<std::shared_ptr<EthercatSlave>> slaves = readSlaveConfig(config_file, error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    if (list_fields)
+    {
+        std::vector<std::string> selectors = getFieldSelectors(slaves);
+        for (int i = 0; i < selectors.size(); i++)
+        {
+            std::cout << selectors[i] << std::endl;
+        }
+        return 0;
+    }
+
+    std::vector<FieldSelector> fields;
+    parseFieldSelectors(field_list, slaves, fields, error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+
+    std::ofstream outfile;
+    std::ostream *out = &std::cout;
+    if (!output_file.empty())
+    {
+        outfile.open(output_file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!outfile.is_open())
+        {
+            std::cerr << "Could not open output file " << output_file << std::endl;
+            return 1;
+        }
+        out = &outfile;
+    }
+    std::string header;
+    FieldEncoder::writeHeader(fields, format, header);
+    out->write(header.data(), header.size());
+
+    OfflineDecoder decoder(slaves);
+    decoder.setThreadCount(jobs);
+    decoder.setTimeRange(start_time, end_time);
+    decoder.decode(pcap_file, [&slaves, &fields, format]()
+    {
+        return std::make_shared<FieldEncoder>(slaves, fields, format);
+    }, [out](const std::string &output, uint64_t image_count)
+    {
+        out->write(output.data(), output.size());
+    }, error_msg);
+    out->flush();
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    if (!*out)
+    {
+        std::cerr << "Could not write the output" << std::endl;
+        return 1;
+    }
+    const OfflineDecodeStats &stats = decoder.getStats();
+    std::cerr << "Extracted " << fields.size() << " fields from " << stats.images << " images ("
+              << stats.working_counter_errors << " working counter errors)" << std::endl;
+    return 0;
+}
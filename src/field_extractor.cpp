@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "field_extractor.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+    const char BINARY_MAGIC[8] = {'K', 'D', 'D', 'V', 'E', 'X', 'T', '1'};
+
+    void appendLittleEndian(std::string &output, uint64_t value, int size)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            output += static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    void appendDouble(std::string &output, double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        appendLittleEndian(output, bits, 8);
+    }
+
+    int findVariable(const std::vector<std::string> &variables, const std::string &name)
+    {
+        for (int i = 0; i < variables.size(); i++)
+        {
+            if (variables[i] == name)
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+}
+
+void parseFieldSelectors(const std::string &selectors, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                         std::vector<FieldSelector> &fields, std::string &error)
+{
+    std::stringstream stream(selectors);
+    std::string selector;
+    while (std::getline(stream, selector, ','))
+    {
+        if (selector.empty())
+        {
+            continue;
+        }
+        size_t separator = selector.find('.');
+        if (separator == std::string::npos)
+        {
+            error = "Invalid field " + selector + ", expected SLAVE.FIELD";
+            return;
+        }
+        std::string slave_name = selector.substr(0, separator);
+        std::string field_name = selector.substr(separator + 1);
+        char *end = NULL;
+        long slave_number = std::strtol(slave_name.c_str(), &end, 10);
+        bool is_number = !slave_name.empty() and *end == '\0';
+        FieldSelector field;
+        field.name = selector;
+        field.slave_idx = -1;
+        for (int i = 0; i < slaves.size(); i++)
+        {
+            if ((is_number and slaves[i]->slave_info.slave_number == slave_number) or
+                (!is_number and slaves[i]->slave_info.name == slave_name))
+            {
+                if (field.slave_idx >= 0)
+                {
+                    error = "There are several slaves named " + slave_name + ", use the slave number in " + selector;
+                    return;
+                }
+                field.slave_idx = i;
+            }
+        }
+        if (field.slave_idx < 0)
+        {
+            error = "No slave " + slave_name + " for field " + selector;
+            return;
+        }
+        const EthercatSlave &slave = *slaves[field.slave_idx];
+        field.is_rx = false;
+        field.field_idx = findVariable(slave.getTxVariables(), field_name);
+        if (field.field_idx < 0)
+        {
+            field.is_rx = true;
+            field.field_idx = findVariable(slave.getRxVariables(), field_name);
+        }
+        if (field.field_idx < 0)
+        {
+            error = "Slave " + slave_name + " has no field " + field_name;
+            return;
+        }
+        field.type = field.is_rx ? slave.getRxLayout()[field.field_idx].type : slave.getTxLayout()[field.field_idx].type;
+        fields.push_back(field);
+    }
+    if (fields.empty())
+    {
+        error = "No fields specified";
+    }
+}
+
+std::vector<std::string> getFieldSelectors(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+{
+    std::vector<std::string> selectors;
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        std::string prefix = std::to_string(slaves[i]->slave_info.slave_number) + ".";
+        const std::vector<std::string> &tx_vars = slaves[i]->getTxVariables();
+        for (int j = 0; j < tx_vars.size(); j++)
+        {
+            selectors.push_back(prefix + tx_vars[j]);
+        }
+        const std::vector<std::string> &rx_vars = slaves[i]->getRxVariables();
+        for (int j = 0; j < rx_vars.size(); j++)
+        {
+            selectors.push_back(prefix + rx_vars[j]);
+        }
+    }
+    return selectors;
+}
+
+bool parseExtractFormat(const std::string &name, ExtractFormat &format)
+{
+    if (name == "csv")
+    {
+        format = EXTRACT_CSV;
+    }
+    else if (name == "ndjson")
+    {
+        format = EXTRACT_NDJSON;
+    }
+    else if (name == "binary")
+    {
+        format = EXTRACT_BINARY;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+FieldEncoder::FieldEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves, const std::vector<FieldSelector> &fields,
+                           ExtractFormat format)
+    : slaves(slaves), fields(fields), format(format), row_count(0), columns(fields.size())
+{
+}
+
+void FieldEncoder::writeHeader(const std::vector<FieldSelector> &fields, ExtractFormat format, std::string &output)
+{
+    if (format == EXTRACT_CSV)
+    {
+        output += "timestamp";
+        for (int i = 0; i < fields.size(); i++)
+        {
+            output += "," + fields[i].name;
+        }
+        output += '\n';
+    }
+    else if (format == EXTRACT_BINARY)
+    {
+        output.append(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        appendLittleEndian(output, fields.size(), 4);
+        for (int i = 0; i < fields.size(); i++)
+        {
+            appendLittleEndian(output, fields[i].type == FIELD_FLOAT ? 1 : 0, 1);
+            appendLittleEndian(output, fields[i].name.size(), 2);
+            output += fields[i].name;
+        }
+    }
+}
+
+void FieldEncoder::startChunk()
+{
+    row_count = 0;
+    timestamp_column.clear();
+    for (int i = 0; i < columns.size(); i++)
+    {
+        columns[i].clear();
+    }
+}
+
+void FieldEncoder::encode(const ProcessImage &image, std::string &output)
+{
+    char buffer[32];
+    if (format == EXTRACT_BINARY)
+    {
+        appendDouble(timestamp_column, image.timestamp);
+        for (int i = 0; i < fields.size(); i++)
+        {
+            appendValue(image, fields[i], columns[i]);
+        }
+        row_count++;
+        return;
+    }
+    std::snprintf(buffer, sizeof(buffer), "%.6f", image.timestamp);
+    if (format == EXTRACT_CSV)
+    {
+        output += buffer;
+        for (int i = 0; i < fields.size(); i++)
+        {
+            output += ',';
+            appendValue(image, fields[i], output);
+        }
+    }
+    else
+    {
+        output += "{\"timestamp\":";
+        output += buffer;
+        for (int i = 0; i < fields.size(); i++)
+        {
+            output += ",\"" + fields[i].name + "\":";
+            appendValue(image, fields[i], output);
+        }
+        output += '}';
+    }
+    output += '\n';
+}
+
+void FieldEncoder::finishChunk(std::string &output)
+{
+    if (format != EXTRACT_BINARY or row_count == 0)
+    {
+        return;
+    }
+    appendLittleEndian(output, row_count, 4);
+    output += timestamp_column;
+    for (int i = 0; i < columns.size(); i++)
+    {
+        output += columns[i];
+    }
+}
+
+void FieldEncoder::appendValue(const ProcessImage &image, const FieldSelector &field, std::string &output) const
+{
+    const EthercatSlave &slave = *slaves[field.slave_idx];
+    const uint8_t *data = field.is_rx ? image.getRxData(field.slave_idx) : image.getTxData(field.slave_idx);
+    if (field.type != FIELD_FLOAT)
+    {
+        uint64_t value = field.is_rx ? slave.decodeRxInteger(data, field.field_idx) : slave.decodeTxInteger(data, field.field_idx);
+        if (format == EXTRACT_BINARY)
+        {
+            appendLittleEndian(output, value, 8);
+        }
+        else
+        {
+            output += std::to_string(value);
+        }
+        return;
+    }
+    double value = field.is_rx ? slave.decodeRxDouble(data, field.field_idx) : slave.decodeTxDouble(data, field.field_idx);
+    if (format == EXTRACT_BINARY)
+    {
+        appendDouble(output, value);
+    }
+    else if (format == EXTRACT_NDJSON and !std::isfinite(value))
+    {
+        // JSON has no representation for NaN and infinity
+        output += "null";
+    }
+    else
+    {
+        // enough digits to represent any float exactly
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        output += buffer;
+    }
+}
@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "frame_recorder.h"
+#include "tracer.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+FrameRecorder::FrameRecorder(const FrameRecorderOptions &options, MetricsRegistry &metrics)
+    : options(options),
+      recorded_frames_metric(metrics.getMetric("kddv_pcap_recorder_frames_total", METRIC_COUNTER, "Frames written to the PCAP recording")),
+      dropped_frames_metric(metrics.getMetric("kddv_pcap_recorder_dropped_frames_total", METRIC_COUNTER,
+                                              "Frames which were not recorded because the disk could not keep up or a write failed")),
+      written_bytes_metric(metrics.getMetric("kddv_pcap_recorder_written_bytes_total", METRIC_COUNTER, "Bytes written to the PCAP recording, after compression")),
+      files_metric(metrics.getMetric("kddv_pcap_recorder_files_total", METRIC_COUNTER, "Files of the PCAP recording which were started")),
+      write_errors_metric(metrics.getMetric("kddv_pcap_recorder_write_errors_total", METRIC_COUNTER, "Failed writes to the PCAP recording")),
+      buffered_bytes_metric(metrics.getMetric("kddv_pcap_recorder_buffered_bytes", METRIC_GAUGE, "Bytes of frames waiting to be written to the PCAP recording")),
+      running(false), file_number(0), file_start_time(0), has_write_error(false)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    stop();
+}
+
+void FrameRecorder::start(std::string &error)
+{
+    if (!isCompressionSupported(options.compression))
+    {
+        error = "kddv was built without support for " + getCompressionExtension(options.compression).substr(1) + " compression";
+        return;
+    }
+    std::lock_guard<std::mutex> guard(buffer_mutex);
+    if (running)
+    {
+        return;
+    }
+    // both buffers are allocated up front, so adding a frame never allocates
+    buffer.clear();
+    buffer.reserve(options.buffer_size);
+    write_buffer.clear();
+    write_buffer.reserve(options.buffer_size);
+    running = true;
+    writer_thread = std::thread(&FrameRecorder::writeLoop, this);
+}
+
+void FrameRecorder::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(buffer_mutex);
+        running = false;
+    }
+    buffer_condition.notify_one();
+    if (writer_thread.joinable())
+    {
+        writer_thread.join();
+    }
+}
+
+void FrameRecorder::addFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us)
+{
+    bool was_empty;
+    {
+        std::lock_guard<std::mutex> guard(buffer_mutex);
+        if (!running or buffer.size() + sizeof(FrameHeader) + size > options.buffer_size)
+        {
+            dropped_frames_metric.add();
+            return;
+        }
+        was_empty = buffer.empty();
+        FrameHeader header;
+        header.timestamp_us = timestamp_us;
+        header.size = size;
+        const uint8_t *header_bytes = reinterpret_cast<const uint8_t*>(&header);
+        buffer.insert(buffer.end(), header_bytes, header_bytes + sizeof(header));
+        buffer.insert(buffer.end(), frame, frame + size);
+        buffered_bytes_metric.set(buffer.size());
+    }
+    // the writer only waits while the buffer is empty
+    if (was_empty)
+    {
+        buffer_condition.notify_one();
+    }
+}
+
+uint64_t FrameRecorder::getRecordedFrames() const
+{
+    return recorded_frames_metric.get();
+}
+
+uint64_t FrameRecorder::getDroppedFrames() const
+{
+    return dropped_frames_metric.get();
+}
+
+int FrameRecorder::getFileCount() const
+{
+    return files_metric.get();
+}
+
+void FrameRecorder::writeLoop()
+{
+    Tracer::setThreadName("pcap recorder");
+    std::unique_lock<std::mutex> lock(buffer_mutex);
+    while (true)
+    {
+        buffer_condition.wait(lock, [this] { return !running or !buffer.empty(); });
+        // when stopped, the frames still in the buffer are written
+        if (buffer.empty())
+        {
+            break;
+        }
+        write_buffer.swap(buffer);
+        buffered_bytes_metric.set(0);
+        lock.unlock();
+        writeFrames();
+        write_buffer.clear();
+        lock.lock();
+    }
+    lock.unlock();
+    closeFile();
+}
+
+void FrameRecorder::writeFrames()
+{
+    TraceScope trace("record", "FrameRecorder::writeFrames");
+    uint64_t max_duration_us = static_cast<uint64_t>(options.max_file_duration * 1000000);
+    size_t position = 0;
+    while (position < write_buffer.size())
+    {
+        FrameHeader header;
+        std::memcpy(&header, &write_buffer[position], sizeof(header));
+        const uint8_t *frame = &write_buffer[position + sizeof(header)];
+        position += sizeof(header) + header.size;
+
+        // after a failed write, the disk is given some time before the next attempt
+        if (has_write_error)
+        {
+            if (std::chrono::steady_clock::now() < retry_time)
+            {
+                dropped_frames_metric.add();
+                continue;
+            }
+            has_write_error = false;
+        }
+        if (writer.isOpen() and ((options.max_file_size > 0 and writer.getFileSize() >= options.max_file_size) or
+                                 (max_duration_us > 0 and header.timestamp_us >= file_start_time + max_duration_us)))
+        {
+            closeFile();
+        }
+        if (!writer.isOpen())
+        {
+            openFile(header.timestamp_us);
+            if (!writer.isOpen())
+            {
+                dropped_frames_metric.add();
+                continue;
+            }
+        }
+
+        std::string error;
+        uint64_t file_size = writer.getFileSize();
+        uint64_t written_frames = writer.getWrittenFrames();
+        uint64_t lost_frames = writer.getLostFrames();
+        writer.writeFrame(frame, header.size, header.timestamp_us, error);
+        countWrite(file_size, written_frames, lost_frames);
+        if (!error.empty())
+        {
+            handleWriteError(error);
+        }
+    }
+}
+
+void FrameRecorder::openFile(uint64_t timestamp_us)
+{
+    file_number++;
+    std::string filename = getFilename(timestamp_us);
+    std::string error;
+    writer.open(filename, options.compression, error);
+    if (!error.empty())
+    {
+        handleWriteError(error);
+        return;
+    }
+    files_metric.add();
+    file_start_time = timestamp_us;
+    written_files.push_back(filename);
+    while (options.max_files > 0 and written_files.size() > options.max_files)
+    {
+        std::remove(written_files.front().c_str());
+        written_files.pop_front();
+    }
+}
+
+void FrameRecorder::closeFile()
+{
+    if (!writer.isOpen())
+    {
+        return;
+    }
+    std::string error;
+    uint64_t file_size = writer.getFileSize();
+    uint64_t written_frames = writer.getWrittenFrames();
+    uint64_t lost_frames = writer.getLostFrames();
+    writer.close(error);
+    countWrite(file_size, written_frames, lost_frames);
+    if (!error.empty())
+    {
+        write_errors_metric.add();
+        std::cerr << error << std::endl;
+    }
+}
+
+void FrameRecorder::countWrite(uint64_t file_size, uint64_t written_frames, uint64_t lost_frames)
+{
+    // frames only count as recorded once the writer wrote their chunk
+    written_bytes_metric.add(writer.getFileSize() - file_size);
+    recorded_frames_metric.add(writer.getWrittenFrames() - written_frames);
+    dropped_frames_metric.add(writer.getLostFrames() - lost_frames);
+}
+
+void FrameRecorder::handleWriteError(const std::string &error)
+{
+    std::cerr << error << std::endl;
+    write_errors_metric.add();
+    // the next file is started after the pause
+    closeFile();
+    has_write_error = true;
+    retry_time = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+}
+
+std::string FrameRecorder::getFilename(uint64_t timestamp_us) const
+{
+    std::string extension = getCompressionExtension(options.compression);
+    std::string filename = options.filename;
+    // the first file of an unlimited recording is the given file; numbering
+    // the files after a write error keeps the file from being replaced
+    if (options.max_file_size > 0 or options.max_file_duration > 0.0 or file_number > 1)
+    {
+        filename = getNumberedFilename(filename, file_number, timestamp_us);
+    }
+    if (filename.size() < extension.size() or filename.compare(filename.size() - extension.size(), extension.size(), extension) != 0)
+    {
+        filename += extension;
+    }
+    return filename;
+}
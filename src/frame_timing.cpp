@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "frame_timing.h"
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    const uint64_t ROUND_TRIP_TIME_BOUNDS[] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+    const uint64_t CYCLE_PERIOD_BOUNDS[] = {100, 250, 500, 1000, 2000, 4000, 8000, 10000, 20000, 50000, 100000};
+    const uint64_t CYCLE_JITTER_BOUNDS[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+    // weight of the latest period in the average period
+    const double PERIOD_SMOOTHING = 0.01;
+}
+
+FrameTimingAnalyzer::FrameTimingAnalyzer(MetricsRegistry &metrics)
+    : round_trip_time_histogram(metrics.getHistogram("kddv_bus_round_trip_microseconds", "Time from sending a process data frame until it returns from the slaves",
+                                                     std::vector<uint64_t>(std::begin(ROUND_TRIP_TIME_BOUNDS), std::end(ROUND_TRIP_TIME_BOUNDS)))),
+      cycle_period_histogram(metrics.getHistogram("kddv_cycle_period_microseconds", "Time between consecutive process data frames sent by the master",
+                                                  std::vector<uint64_t>(std::begin(CYCLE_PERIOD_BOUNDS), std::end(CYCLE_PERIOD_BOUNDS)))),
+      cycle_jitter_histogram(metrics.getHistogram("kddv_cycle_jitter_microseconds", "Deviation of the cycle period from the average period",
+                                                  std::vector<uint64_t>(std::begin(CYCLE_JITTER_BOUNDS), std::end(CYCLE_JITTER_BOUNDS)))),
+      late_responses_metric(metrics.getMetric("kddv_late_responses_total", METRIC_COUNTER, "Process data frames which returned later than the average cycle period")),
+      missing_responses_metric(metrics.getMetric("kddv_missing_responses_total", METRIC_COUNTER, "Process data frames which did not return before their index was reused")),
+      has_last_sent(false), last_sent_timestamp(0), average_period(0.0)
+{
+    reset();
+}
+
+void FrameTimingAnalyzer::reset()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        pending[i] = false;
+        sent_timestamps[i] = 0;
+    }
+    has_last_sent = false;
+}
+
+void FrameTimingAnalyzer::addOutgoingFrame(uint8_t index, uint64_t timestamp_us)
+{
+    if (pending[index])
+    {
+        missing_responses_metric.add();
+    }
+    pending[index] = true;
+    sent_timestamps[index] = timestamp_us;
+
+    if (has_last_sent and timestamp_us >= last_sent_timestamp)
+    {
+        uint64_t period = timestamp_us - last_sent_timestamp;
+        cycle_period_histogram.observe(period);
+        if (average_period > 0.0)
+        {
+            cycle_jitter_histogram.observe(static_cast<uint64_t>(std::fabs(period - average_period) + 0.5));
+            average_period += PERIOD_SMOOTHING * (period - average_period);
+        }
+        else
+        {
+            average_period = period;
+        }
+    }
+    has_last_sent = true;
+    last_sent_timestamp = timestamp_us;
+}
+
+void FrameTimingAnalyzer::addReturnedFrame(uint8_t index, uint64_t timestamp_us)
+{
+    // frames sent before the capture started are not matched
+    if (!pending[index])
+    {
+        return;
+    }
+    pending[index] = false;
+    uint64_t round_trip_time = timestamp_us >= sent_timestamps[index] ? timestamp_us - sent_timestamps[index] : 0;
+    round_trip_time_histogram.observe(round_trip_time);
+    if (average_period > 0.0 and round_trip_time > average_period)
+    {
+        late_responses_metric.add();
+    }
+}
+
+double FrameTimingAnalyzer::getAveragePeriod() const
+{
+    return average_period;
+}
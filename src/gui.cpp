@@ -8,11 +8,14 @@
 #include <QtWidgets>
 #include <QFileInfo>
 #include "gui.h"
+#include "tracer.h"
 #include "ethercat_master.h"
 #include "packet_sniffer.h"
+#include <cmath>
 #include <iostream>
 
-GUI::GUI(std::shared_ptr<ZMQPublisher> zmq_pub) : UI(zmq_pub)
+GUI::GUI(std::shared_ptr<ZMQPublisher> zmq_pub) : UI(zmq_pub), frames_received(0), frames_displayed(0), displayed_sequence(0),
+    frames_displayed_metric(NULL)
 {
     QGridLayout *top_bar_layout = new QGridLayout;
     input_data_button_group = new QButtonGroup;
@@ -61,36 +64,80 @@ GUI::GUI(std::shared_ptr<ZMQPublisher> zmq_pub) : UI(zmq_pub)
     discover_button = new QPushButton("Discover Slaves", this);
     connect(discover_button, SIGNAL(clicked()), this, SLOT(handleDiscoverButton()));
     connect(start_button, SIGNAL(clicked()), this, SLOT(handleStart()));
+    frame_counter_lbl = new QLabel;
+    QVBoxLayout *start_layout = new QVBoxLayout;
+    start_layout->addWidget(start_button);
+    start_layout->addWidget(frame_counter_lbl);
 
 
     publish_zmq_checkbox = new QCheckBox("Publish via ZMQ");
     connect(publish_zmq_checkbox, SIGNAL(stateChanged(int)), this, SLOT(handleZMQCheckBox(int)));
     show_units_checkbox = new QCheckBox("Show Units");
+    connect(show_units_checkbox, SIGNAL(stateChanged(int)), this, SLOT(handleShowUnitsCheckBox(int)));
     QVBoxLayout *checkbox_layout = new QVBoxLayout;
     checkbox_layout->addWidget(publish_zmq_checkbox);
     checkbox_layout->addWidget(show_units_checkbox);
 
+    replay_speed_combo_box = new QComboBox;
+    for (int i = 0; i < REPLAY_SPEED_COUNT; i++)
+    {
+        replay_speed_combo_box->addItem(QString::fromStdString("Replay " + formatReplaySpeed(REPLAY_SPEEDS[i])));
+    }
+    replay_speed_combo_box->setEnabled(false);
+    connect(replay_speed_combo_box, SIGNAL(currentIndexChanged(int)), this, SLOT(handleReplaySpeedChanged(int)));
+    pause_button = new QPushButton("Pause", this);
+    pause_button->setEnabled(false);
+    connect(pause_button, SIGNAL(clicked()), this, SLOT(handlePauseButton()));
+    step_button = new QPushButton("Step", this);
+    step_button->setEnabled(false);
+    connect(step_button, SIGNAL(clicked()), this, SLOT(handleStepButton()));
+    timeline_slider = new QSlider(Qt::Horizontal);
+    timeline_slider->setRange(0, 0);
+    timeline_slider->setEnabled(false);
+    connect(timeline_slider, SIGNAL(valueChanged(int)), this, SLOT(handleTimelineChanged(int)));
+    replay_position_lbl = new QLabel;
+    QHBoxLayout *replay_layout = new QHBoxLayout;
+    replay_layout->addWidget(pause_button);
+    replay_layout->addWidget(step_button);
+    replay_layout->addWidget(replay_speed_combo_box);
+    replay_layout->addWidget(timeline_slider, 1);
+    replay_layout->addWidget(replay_position_lbl);
+    setReplaySpeed(1.0);
+
     top_bar_layout->addLayout(button_group_layout, 0, 0);
     top_bar_layout->addLayout(source_config_layout, 0, 1);
     top_bar_layout->addWidget(discover_button, 0, 2);
-    top_bar_layout->addWidget(start_button, 0, 3);
+    top_bar_layout->addLayout(start_layout, 0, 3);
     top_bar_layout->addLayout(checkbox_layout, 0, 4);
-
-    wheel_data_layout = new QHBoxLayout;
+    top_bar_layout->addLayout(replay_layout, 1, 0, 1, 5);
+
+    data_model = new SlaveDataModel(this);
+    data_table_view = new QTableView;
+    data_table_view->setModel(data_model);
+    data_table_view->setMinimumSize(800, 600);
+    data_table_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    data_table_view->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     wheel_list_widget = new QListWidget;
     wheel_list_widget->setMaximumWidth(100);
     connect(wheel_list_widget, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(handleWheelListChanged(QListWidgetItem*)));
 
-    qRegisterMetaType<std::vector<std::shared_ptr<EthercatSlave>>>();
-    connect(this, &GUI::dataChanged, this, &GUI::handleDataChanged, Qt::QueuedConnection);
+    refresh_timer = new QTimer(this);
+    connect(refresh_timer, SIGNAL(timeout()), this, SLOT(handleRefreshTimer()));
+    setDisplayRate(30.0);
 
     main_layout = new QGridLayout;
     main_layout->addLayout(top_bar_layout, 0, 0, 1, 2);
     main_layout->addWidget(wheel_list_widget, 1, 0);
-    main_layout->addLayout(wheel_data_layout, 1, 1);
+    main_layout->addWidget(data_table_view, 1, 1);
     setLayout(main_layout);
 }
 
+GUI::~GUI()
+{
+    // stop the data source and its subscriber threads before the members they use are destroyed
+    ecat_data_source.reset();
+}
+
 void GUI::closeEvent(QCloseEvent *event)
 {
     event->accept();
@@ -110,11 +157,22 @@ void GUI::handleStart()
         {
             discover_button->setEnabled(false);
             start_button->setText("Stop");
+            refresh_timer->start();
+            PacketSniffer *replay = getReplaySource();
+            pause_button->setEnabled(replay != NULL);
+            step_button->setEnabled(replay != NULL and replay->isPaused());
+            timeline_slider->setEnabled(replay != NULL);
         }
     }
     else if (start_button->text().toStdString() == "Stop")
     {
         ecat_data_source->stop();
+        refresh_timer->stop();
+        pause_button->setEnabled(false);
+        step_button->setEnabled(false);
+        timeline_slider->setEnabled(false);
+        // show the last image received before stopping
+        handleRefreshTimer();
         discover_button->setEnabled(true);
         start_button->setText("Start");
     }
@@ -123,18 +181,19 @@ void GUI::handleStart()
 void GUI::handleDiscoverButton()
 {
     start_button->setEnabled(false);
-    wheel_group_boxes.clear();
-    QLayoutItem *item;
-    while((item = wheel_data_layout->takeAt(0)) != NULL)
-    {
-        delete item->widget();
-        delete item;
-    }
+    std::atomic_store(&latest_image, ProcessImagePtr());
+    frames_received = 0;
+    frames_displayed = 0;
+    displayed_sequence = 0;
+    frame_counter_lbl->clear();
+    slaves.clear();
+    data_model->setSlaves(slaves);
 
     wheel_list_widget->clear();
 
     std::string interface = if_combo_box->currentText().toStdString();
 
+    frames_displayed_metric = NULL;
     ecat_data_source.reset();
     if (input_data_ethercat_button->isChecked())
     {
@@ -199,6 +258,14 @@ void GUI::handleDiscoverButton()
             ecat_data_source.reset();
             return;
         }
+        std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setReplaySpeed(replay_speed);
+        std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setTimeRange(replay_start_time, replay_end_time);
+        pause_button->setText("Pause");
+        timeline_slider->blockSignals(true);
+        timeline_slider->setRange(0, static_cast<int>(std::static_pointer_cast<PacketSniffer>(ecat_data_source)->getDuration() * 1000));
+        timeline_slider->setValue(static_cast<int>(replay_start_time * 1000));
+        timeline_slider->blockSignals(false);
+        updateTimeline();
         std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setConfigFile(config_file_name, error_msg);
         if (!error_msg.empty())
         {
@@ -220,10 +287,13 @@ void GUI::handleDiscoverButton()
     {
         ecat_data_source->setZMQPublish(false);
     }
-    ecat_data_source->setDataCallback(&UI::dataCallback, this);
+    // the callback only hands over the latest image, so a queue of one is enough
+    ecat_data_source->getDataBus().subscribe("gui", std::bind(&UI::dataCallback, this, std::placeholders::_1), SubscriberOptions());
+    frames_displayed_metric = &ecat_data_source->getMetrics().getMetric("kddv_ui_frames_displayed_total", METRIC_COUNTER,
+                                                                        "Frames displayed by the UI", "ui=\"gui\"");
 
     std::string error_msg;
-    std::vector<std::shared_ptr<EthercatSlave>> slaves = ecat_data_source->getSlaves(error_msg);
+    slaves = ecat_data_source->getSlaves(error_msg);
     if (!error_msg.empty())
     {
         QMessageBox::critical(this, tr("Error"), QString::fromStdString(error_msg));
@@ -239,38 +309,10 @@ void GUI::handleDiscoverButton()
             list_item->setCheckState(Qt::Checked);
             wheel_list_widget->addItem(list_item);
 
-            QGroupBox *box = new QGroupBox(QString::fromStdString(wheel_id));
-            box->setObjectName(QString::fromStdString(wheel_id));
-            QGridLayout *grid_layout = new QGridLayout;
-
-            for (int j = 0; j < slaves[i]->getRxVariables().size(); j++)
-            {
-                QLabel *lbl = new QLabel(QString::fromStdString(slaves[i]->getRxVariables()[j]));
-                grid_layout->addWidget(lbl, j, 0);
-                QLabel *line = new QLabel;
-                line->setObjectName(QString::fromStdString("RX" + slaves[i]->getRxVariables()[j]));
-                line->setAlignment(Qt::AlignRight);
-                grid_layout->addWidget(line, j, 1);
-            }
-            for (int j = 0; j < slaves[i]->getTxVariables().size(); j++)
-            {
-                QLabel *lbl = new QLabel(QString::fromStdString(slaves[i]->getTxVariables()[j]));
-                grid_layout->addWidget(lbl, j, 2);
-                QLabel *line = new QLabel;
-                line->setObjectName(QString::fromStdString("TX" + slaves[i]->getTxVariables()[j]));
-                line->setAlignment(Qt::AlignRight);
-                grid_layout->addWidget(line, j, 3);
-            }
-            int last_row = std::max(slaves[i]->getRxVariables().size(), slaves[i]->getTxVariables().size());
-            QSpacerItem * spacer = new QSpacerItem(1,1,QSizePolicy::Expanding, QSizePolicy::Expanding);
-            grid_layout->addItem(spacer, last_row, 0, 1, 4);
-            box->setLayout(grid_layout);
-            box->setVisible(true);
-            box->setMaximumWidth(600);
-            wheel_data_layout->addWidget(box);
-            wheel_group_boxes.push_back(box);
         }
         wheel_list_widget->setMinimumWidth(wheel_list_widget->sizeHintForColumn(0));
+        data_model->setSlaves(slaves);
+        data_table_view->resizeColumnsToContents();
     }
     start_button->setEnabled(true);
 }
@@ -323,6 +365,69 @@ void GUI::handleInputButtonChanged()
         select_pcap_file_button->setEnabled(false);
         if_combo_box->setEnabled(false);
     }
+    replay_speed_combo_box->setEnabled(input_data_file_button->isChecked());
+}
+
+void GUI::handleReplaySpeedChanged(int index)
+{
+    if (index < 0 or index >= REPLAY_SPEED_COUNT)
+    {
+        return;
+    }
+    replay_speed = REPLAY_SPEEDS[index];
+    PacketSniffer *replay = getReplaySource();
+    if (replay != NULL)
+    {
+        replay->setReplaySpeed(replay_speed);
+    }
+}
+
+void GUI::handlePauseButton()
+{
+    PacketSniffer *replay = getReplaySource();
+    if (replay == NULL)
+    {
+        return;
+    }
+    bool paused = !replay->isPaused();
+    replay->setPaused(paused);
+    pause_button->setText(paused ? "Resume" : "Pause");
+    step_button->setEnabled(paused);
+}
+
+void GUI::handleStepButton()
+{
+    PacketSniffer *replay = getReplaySource();
+    if (replay != NULL)
+    {
+        replay->step();
+    }
+}
+
+void GUI::handleTimelineChanged(int value)
+{
+    // only called when the user moves the slider; each position is a complete process image,
+    // so the index of the recording is enough to show the state at that time
+    PacketSniffer *replay = getReplaySource();
+    if (replay != NULL)
+    {
+        replay->seek(value / 1000.0);
+    }
+    replay_position_lbl->setText(QString("%1 / %2 s").arg(value / 1000.0, 0, 'f', 3).arg(timeline_slider->maximum() / 1000.0, 0, 'f', 3));
+}
+
+void GUI::updateTimeline()
+{
+    PacketSniffer *replay = getReplaySource();
+    if (replay == NULL or timeline_slider->isSliderDown())
+    {
+        return;
+    }
+    double position = replay->getReplayPosition();
+    timeline_slider->blockSignals(true);
+    timeline_slider->setValue(static_cast<int>(position * 1000));
+    timeline_slider->blockSignals(false);
+    replay_position_lbl->setText(QString("%1 / %2 s").arg(position, 0, 'f', 3).arg(replay->getDuration(), 0, 'f', 3));
 }
 
 void GUI::handleZMQCheckBox(int state)
@@ -340,117 +445,61 @@ void GUI::handleZMQCheckBox(int state)
     }
 }
 
-void GUI::fixSize()
+void GUI::handleShowUnitsCheckBox(int state)
 {
-    resize(sizeHint());
+    data_model->setShowUnits(show_units_checkbox->isChecked());
 }
 
 void GUI::handleWheelListChanged(QListWidgetItem *item)
 {
-    int box_idx = -1;
-    for (int idx = 0; idx < wheel_group_boxes.size(); idx++)
+    // the list has the same order as the columns of the table
+    int column = wheel_list_widget->row(item);
+    if (column < 0 or column >= data_model->columnCount())
     {
-        if (wheel_group_boxes[idx]->objectName().compare(item->text()) == 0)
-        {
-            box_idx = idx;
-            break;
-        }
+        return;
     }
-    if (box_idx != -1)
+    data_table_view->setColumnHidden(column, item->checkState() == Qt::Unchecked);
+}
+
+void GUI::handleRefreshTimer()
+{
+    TraceScope trace("render", "GUI::handleRefreshTimer");
+    ProcessImagePtr image = std::atomic_load(&latest_image);
+    if (image and image->sequence != displayed_sequence)
     {
-        if (item->checkState() == Qt::Unchecked)
-        {
-            wheel_group_boxes[box_idx]->setVisible(false);
-        }
-        else if (item->checkState() == Qt::Checked)
+        data_model->updateData(image);
+        displayed_sequence = image->sequence;
+        frames_displayed++;
+        if (frames_displayed_metric)
         {
-            wheel_group_boxes[box_idx]->setVisible(true);
-            wheel_group_boxes[box_idx]->setMaximumWidth(600);
+            frames_displayed_metric->add();
         }
-        // See https://stackoverflow.com/questions/13942616/qt-resize-window-after-widget-remove
-        QTimer::singleShot(0, this, SLOT(fixSize()));
     }
+    QString status = QString("Frames received: %1\nFrames displayed: %2").arg(frames_received.load()).arg(frames_displayed);
+    if (ecat_data_source)
+    {
+        status += "\n" + QString::fromStdString(ecat_data_source->getMetricsSummary());
+    }
+    frame_counter_lbl->setText(status);
+    updateTimeline();
 }
 
-void GUI::handleDataChanged(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+void GUI::dataCallback(const ProcessImagePtr &image)
 {
-    for (int i = 0; i < slaves.size(); i++)
-    {
-        const std::vector<std::string> &rx_vars = slaves[i]->getRxVariables();
-        const std::vector<std::string> &tx_vars = slaves[i]->getTxVariables();
-        const std::vector<std::string> &rx_units = slaves[i]->getRxUnits();
-        const std::vector<std::string> &tx_units = slaves[i]->getTxUnits();
-        std::vector<std::string> rx_vals = slaves[i]->getRxValues();
-        std::vector<std::string> tx_vals = slaves[i]->getTxValues();
-        int rx_id = 0;
-        int tx_id = 0;
-
-        for (int child_idx = 0; child_idx < wheel_group_boxes[i]->children().count(); child_idx++)
-        {
-            std::string var_name = wheel_group_boxes[i]->children()[child_idx]->objectName().toStdString();
-            if (var_name.empty()) continue;
-            int var_type = 0;
-            if (var_name.rfind("RX", 0) == 0)
-            {
-                var_type = 1;
-                var_name = var_name.substr(2);
-                std::stringstream ss;
-                ss << rx_vals[rx_id];
-                if (show_units_checkbox->isChecked())
-                {
-                    ss << std::setw(10) << rx_units[rx_id];
-                }
-                qobject_cast<QLabel *>(wheel_group_boxes[i]->children()[child_idx])->setText(QString::fromStdString(ss.str()));
-            }
-            else if (var_name.rfind("TX", 0) == 0)
-            {
-                var_type = 2;
-                var_name = var_name.substr(2);
-                std::stringstream ss;
-                ss << tx_vals[tx_id];
-                if (show_units_checkbox->isChecked())
-                {
-                    ss << std::setw(10) << tx_units[tx_id];
-                }
-                qobject_cast<QLabel *>(wheel_group_boxes[i]->children()[child_idx])->setText(QString::fromStdString(ss.str()));
-            }
-            // set tooltip for variables whose bits can be parsed
-            if (slaves[i]->areBitsParsable(var_name))
-            {
-                std::vector<std::string> vars, vals;
-                uint16_t val;
-                if (var_type == 1)
-                {
-                    val = static_cast<uint16_t>(std::stoul(rx_vals[rx_id]));
-                }
-                else if (var_type == 2)
-                {
-                    val = static_cast<uint16_t>(std::stoul(tx_vals[tx_id]));
-                }
-                slaves[i]->parseBits(val, var_name, vars, vals);
-                std::string tooltip = "";
-                for (int cvar_idx = 0; cvar_idx < vars.size(); cvar_idx++)
-                {
-                    tooltip += vars[cvar_idx] + ":\t" + vals[cvar_idx];
-                    if (cvar_idx != vars.size() - 1) tooltip += "\n";
-                }
-                qobject_cast<QLabel *>(wheel_group_boxes[i]->children()[child_idx])->setToolTip(QString::fromStdString(tooltip));
-            }
-            if (var_type == 1)
-            {
-                rx_id++;
-            }
-            else if (var_type == 2)
-            {
-                tx_id++;
-            }
-        }
-    }
+    TraceScope trace("ui", "GUI::dataCallback");
+    // called from the data source's thread; only keep the latest image, older ones are never displayed
+    std::atomic_store(&latest_image, image);
+    frames_received++;
 }
 
-void GUI::dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+PacketSniffer* GUI::getReplaySource()
 {
-    emit dataChanged(slaves);
+    PacketSniffer *sniffer = dynamic_cast<PacketSniffer*>(ecat_data_source.get());
+    if (sniffer == NULL or !sniffer->isReplay())
+    {
+        return NULL;
+    }
+    return sniffer;
 }
 
 void GUI::populateNetworkInterfaces()
@@ -515,6 +564,43 @@ void GUI::enableZMQ(bool enable)
     publish_zmq_checkbox->setChecked(enable);
 }
 
+void GUI::setReplaySpeed(double speed)
+{
+    // the closest speed offered in the combo box
+    int closest_idx = 0;
+    for (int i = 0; i < REPLAY_SPEED_COUNT; i++)
+    {
+        if (std::fabs(REPLAY_SPEEDS[i] - speed) < std::fabs(REPLAY_SPEEDS[closest_idx] - speed))
+        {
+            closest_idx = i;
+        }
+    }
+    replay_speed = speed;
+    replay_speed_combo_box->blockSignals(true);
+    replay_speed_combo_box->setCurrentIndex(closest_idx);
+    replay_speed_combo_box->blockSignals(false);
+    PacketSniffer *replay = getReplaySource();
+    if (replay != NULL)
+    {
+        replay->setReplaySpeed(replay_speed);
+    }
+}
+
+void GUI::setTimeRange(double start_time, double end_time)
+{
+    replay_start_time = start_time;
+    replay_end_time = end_time;
+}
+
+void GUI::setDisplayRate(double rate)
+{
+    if (rate <= 0.0)
+    {
+        return;
+    }
+    refresh_timer->setInterval(static_cast<int>(1000.0 / rate));
+}
+
 void GUI::start()
 {
     discover_button->clicked();
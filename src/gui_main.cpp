@@ -10,6 +10,7 @@
 #include "ethercat_master.h"
 #include "zmq_publisher.h"
 #include "gui.h"
+#include "tracer.h"
 #include <memory>
 #include <iostream>
 
@@ -31,8 +32,20 @@ void print_usage(const std::string &exec_name)
               << "\t[--zmq_port ZMQ_PORT]"
               << std::endl
               << "\t[--start]"
+              << std::endl
+              << "\t[--display_rate DISPLAY_RATE]"
+              << std::endl
+              << "\t[--trace TRACE_FILE]"
+              << std::endl
+              << "\t[--replay_speed REPLAY_SPEED]"
+              << std::endl
+              << "\t[--start_time START_TIME]"
+              << std::endl
+              << "\t[--end_time END_TIME]"
               << std::endl;
     std::cout << "INPUT_SOURCE: valid sources are\n\tecat\n\tsniffer\n\tpcap" << std::endl;
+    std::cout << "REPLAY_SPEED: factor of the recorded speed at which a PCAP file is replayed, 0 for as fast as possible (default: 1)" << std::endl;
+    std::cout << "START_TIME, END_TIME: range of a PCAP file to replay, in seconds since its first frame" << std::endl;
     std::vector<std::string> interfaces = getNetworkInterfaces();
     std::cout << "NETWORK_INTERFACE: valid interfaces are:" << std::endl;;
     for (int i = 0; i < interfaces.size(); i++)
@@ -50,6 +63,11 @@ int main(int argc, char **argv)
     bool start = false;
     std::string zmq_port = "9872";
     bool publish_zmq = false;
+    double display_rate = 30.0;
+    std::string trace_file;
+    double replay_speed = 1.0;
+    double start_time = 0.0;
+    double end_time = -1.0;
     if (argc > 1)
     {
         for (int i = 1; i < argc; i++)
@@ -155,6 +173,69 @@ int main(int argc, char **argv)
                 zmq_port = std::string(argv[i+1]);
                 i += 1;
             }
+            else if (strcmp(argv[i], "--display_rate") == 0)
+            {
+                if (argc <= i+1)
+                {
+                    std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                    return 1;
+                }
+                display_rate = atof(argv[i+1]);
+                if (display_rate <= 0.0)
+                {
+                    std::cerr << "Invalid display rate " << argv[i+1] << std::endl;
+                    return 1;
+                }
+                i += 1;
+            }
+            else if (strcmp(argv[i], "--replay_speed") == 0)
+            {
+                if (argc <= i+1)
+                {
+                    std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                    return 1;
+                }
+                replay_speed = atof(argv[i+1]);
+                if (replay_speed < 0.0)
+                {
+                    std::cerr << "Invalid replay speed " << argv[i+1] << std::endl;
+                    return 1;
+                }
+                i += 1;
+            }
+            else if (strcmp(argv[i], "--start_time") == 0 or strcmp(argv[i], "--end_time") == 0)
+            {
+                if (argc <= i+1)
+                {
+                    std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                    return 1;
+                }
+                double time = atof(argv[i+1]);
+                if (time < 0.0)
+                {
+                    std::cerr << "Invalid time " << argv[i+1] << std::endl;
+                    return 1;
+                }
+                if (strcmp(argv[i], "--start_time") == 0)
+                {
+                    start_time = time;
+                }
+                else
+                {
+                    end_time = time;
+                }
+                i += 1;
+            }
+            else if (strcmp(argv[i], "--trace") == 0)
+            {
+                if (argc <= i+1)
+                {
+                    std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                    return 1;
+                }
+                trace_file = std::string(argv[i+1]);
+                i += 1;
+            }
             else if (strcmp(argv[i], "--publish_zmq") == 0)
             {
                 publish_zmq = true;
@@ -166,12 +247,20 @@ int main(int argc, char **argv)
             }
         }
     }
+    if (!trace_file.empty())
+    {
+        Tracer::start();
+        Tracer::setThreadName("gui");
+    }
     QApplication app (argc, argv);
     app.setStyle("Breeze");
     QCoreApplication::setApplicationName(QString("KELO Drive Data Viewer"));
 
     std::shared_ptr<ZMQPublisher> zmq_pub = std::make_shared<ZMQPublisher>(zmq_port);
     GUI gui(zmq_pub);
+    gui.setDisplayRate(display_rate);
+    gui.setReplaySpeed(replay_speed);
+    gui.setTimeRange(start_time, end_time);
 
     if (!input_source.empty())
     {
@@ -199,5 +288,16 @@ int main(int argc, char **argv)
     }
 
     gui.show();
-    return app.exec();
+    int result = app.exec();
+    if (!trace_file.empty())
+    {
+        Tracer::stop();
+        std::string error_msg;
+        Tracer::writeChromeTrace(trace_file, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+        }
+    }
+    return result;
 }
@@ -0,0 +1,805 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "ethercat_master.h"
+#include "packet_sniffer.h"
+#include "json_recorder.h"
+#include "columnar_recording.h"
+#include "offline_decoder.h"
+#include "frame_recorder.h"
+#include "trigger_capture.h"
+#include "zmq_publisher.h"
+#include "tracer.h"
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <pthread.h>
+
+struct HeadlessSettings
+{
+    std::string input_source;
+    std::string network_interface;
+    std::string config_file;
+    std::string pcap_file;
+    std::string record_file;
+    std::string record_format;
+    std::string record_pcap_file;
+    std::string pcap_compression;
+    double pcap_file_size;
+    double pcap_file_duration;
+    int pcap_max_files;
+    std::string trigger_conditions;
+    std::string trigger_pcap_file;
+    std::string trigger_columnar_file;
+    double trigger_pre_time;
+    double trigger_post_time;
+    double trigger_buffer_size;
+    std::string metrics_file;
+    std::string trace_file;
+    std::string zmq_port;
+    bool publish_zmq;
+    double frame_rate;
+    double replay_speed;
+    double start_time;
+    double end_time;
+    int jobs;
+};
+
+void print_usage(const std::string &exec_name)
+{
+    std::cout << std::endl << "---------------------------------------" << std::endl;
+    std::cout << "Usage: " << std::endl;
+    std::cout << exec_name
+              << std::endl
+              << "\t[--settings SETTINGS_FILE]"
+              << std::endl
+              << "\t[--src INPUT_SOURCE]"
+              << std::endl
+              << "\t[--iface NETWORK_INTERFACE]"
+              << std::endl
+              << "\t[--frame_rate FRAME_RATE]"
+              << std::endl
+              << "\t[--config CONFIG_FILE]"
+              << std::endl
+              << "\t[--pcap PCAP_FILE]"
+              << std::endl
+              << "\t[--replay_speed REPLAY_SPEED]"
+              << std::endl
+              << "\t[--start_time START_TIME]"
+              << std::endl
+              << "\t[--end_time END_TIME]"
+              << std::endl
+              << "\t[--record RECORD_FILE]"
+              << std::endl
+              << "\t[--record_format RECORD_FORMAT]"
+              << std::endl
+              << "\t[--jobs JOBS]"
+              << std::endl
+              << "\t[--record_pcap RECORD_PCAP_FILE]"
+              << std::endl
+              << "\t[--pcap_compression COMPRESSION]"
+              << std::endl
+              << "\t[--pcap_file_size FILE_SIZE]"
+              << std::endl
+              << "\t[--pcap_file_duration FILE_DURATION]"
+              << std::endl
+              << "\t[--pcap_max_files MAX_FILES]"
+              << std::endl
+              << "\t[--trigger CONDITIONS]"
+              << std::endl
+              << "\t[--trigger_pcap TRIGGER_PCAP_FILE]"
+              << std::endl
+              << "\t[--trigger_columnar TRIGGER_COLUMNAR_FILE]"
+              << std::endl
+              << "\t[--trigger_pre PRE_TRIGGER_TIME]"
+              << std::endl
+              << "\t[--trigger_post POST_TRIGGER_TIME]"
+              << std::endl
+              << "\t[--trigger_buffer TRIGGER_BUFFER_SIZE]"
+              << std::endl
+              << "\t[--metrics_file METRICS_FILE]"
+              << std::endl
+              << "\t[--trace TRACE_FILE]"
+              << std::endl
+              << "\t[--enable_zmq]"
+              << std::endl
+              << "\t[--zmq_port ZMQ_PORT]"
+              << std::endl;
+    std::cout << std::endl;
+    std::cout << "SETTINGS_FILE: JSON file with any of the keys src, iface, frame_rate, config, pcap, replay_speed, start_time, end_time, record, record_format, jobs, record_pcap, pcap_compression, pcap_file_size, pcap_file_duration, pcap_max_files, trigger, trigger_pcap, trigger_columnar, trigger_pre, trigger_post, trigger_buffer, metrics_file, trace, enable_zmq and zmq_port;"
+              << " command line options override the settings file" << std::endl;
+    std::cout << "FRAME_RATE: expected EtherCAT cycle rate in Hz, used to size the capture buffer of the sniffer (default: "
+              << DEFAULT_EXPECTED_FRAME_RATE << ")" << std::endl;
+    std::cout << "REPLAY_SPEED: factor of the recorded speed at which a PCAP file is replayed, 0 for as fast as possible (default: 1)" << std::endl;
+    std::cout << "START_TIME, END_TIME: range of a PCAP file to replay, in seconds since its first frame" << std::endl;
+    std::cout << "RECORD_FORMAT: json (default) or columnar" << std::endl;
+    std::cout << "JOBS: converts the PCAP file to RECORD_FILE on JOBS threads (0 for one per core) as fast as possible, instead of replaying it" << std::endl;
+    std::cout << "RECORD_PCAP_FILE: pcapng file to which the raw frames are written (sniffer and pcap only)" << std::endl;
+    std::cout << "COMPRESSION: none (default), zstd or lz4" << std::endl;
+    std::cout << "FILE_SIZE, FILE_DURATION: a new pcapng file is started after FILE_SIZE MB or FILE_DURATION seconds (default: 0, no limit)" << std::endl;
+    std::cout << "MAX_FILES: the oldest pcapng files are deleted to keep MAX_FILES files (default: 0, no limit)" << std::endl;
+    std::cout << "CONDITIONS: comma separated conditions which trigger a capture: wkc (working counter error), SLAVE.FIELD OP NUMBER"
+              << " (OP is one of < <= > >= == !=), SLAVE.FIELD & MASK or SLAVE.FIELD.BIT (negated with !); SIGUSR2 also triggers a capture" << std::endl;
+    std::cout << "TRIGGER_PCAP_FILE, TRIGGER_COLUMNAR_FILE: pcapng and columnar files written for each trigger, numbered like the pcapng files of RECORD_PCAP_FILE"
+              << " (sniffer and pcap only; the pcapng files use COMPRESSION)" << std::endl;
+    std::cout << "PRE_TRIGGER_TIME, POST_TRIGGER_TIME: seconds of frames written before and after the trigger (default: 10 and 5)" << std::endl;
+    std::cout << "TRIGGER_BUFFER_SIZE: MB of memory for the frames before the trigger (default: 256)" << std::endl;
+    std::cout << "TRACE_FILE: Chrome trace written on exit, and on SIGUSR1 while running" << std::endl;
+    std::cout << "INPUT_SOURCE: valid sources are\n\tecat\n\tsniffer\n\tpcap" << std::endl;
+    std::vector<std::string> interfaces = getNetworkInterfaces();
+    std::cout << "NETWORK_INTERFACE: valid interfaces are:" << std::endl;;
+    for (int i = 0; i < interfaces.size(); i++)
+    {
+        std::cout << "\t" << interfaces[i] << std::endl;
+    }
+    std::cout << "---------------------------------------" << std::endl;
+}
+
+void loadSettings(const std::string &filename, HeadlessSettings &settings, std::string &error)
+{
+    std::ifstream infile(filename);
+    if (!infile)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    Json::Value root;
+    Json::CharReaderBuilder reader_builder;
+    std::string parse_errors;
+    if (!Json::parseFromStream(reader_builder, infile, &root, &parse_errors))
+    {
+        error = "Could not parse " + filename + ": " + parse_errors;
+        return;
+    }
+    settings.input_source = root.get("src", settings.input_source).asString();
+    settings.network_interface = root.get("iface", settings.network_interface).asString();
+    settings.frame_rate = root.get("frame_rate", settings.frame_rate).asDouble();
+    settings.config_file = root.get("config", settings.config_file).asString();
+    settings.pcap_file = root.get("pcap", settings.pcap_file).asString();
+    settings.replay_speed = root.get("replay_speed", settings.replay_speed).asDouble();
+    settings.start_time = root.get("start_time", settings.start_time).asDouble();
+    settings.end_time = root.get("end_time", settings.end_time).asDouble();
+    settings.record_file = root.get("record", settings.record_file).asString();
+    settings.record_format = root.get("record_format", settings.record_format).asString();
+    settings.jobs = root.get("jobs", settings.jobs).asInt();
+    settings.record_pcap_file = root.get("record_pcap", settings.record_pcap_file).asString();
+    settings.pcap_compression = root.get("pcap_compression", settings.pcap_compression).asString();
+    settings.pcap_file_size = root.get("pcap_file_size", settings.pcap_file_size).asDouble();
+    settings.pcap_file_duration = root.get("pcap_file_duration", settings.pcap_file_duration).asDouble();
+    settings.pcap_max_files = root.get("pcap_max_files", settings.pcap_max_files).asInt();
+    settings.trigger_conditions = root.get("trigger", settings.trigger_conditions).asString();
+    settings.trigger_pcap_file = root.get("trigger_pcap", settings.trigger_pcap_file).asString();
+    settings.trigger_columnar_file = root.get("trigger_columnar", settings.trigger_columnar_file).asString();
+    settings.trigger_pre_time = root.get("trigger_pre", settings.trigger_pre_time).asDouble();
+    settings.trigger_post_time = root.get("trigger_post", settings.trigger_post_time).asDouble();
+    settings.trigger_buffer_size = root.get("trigger_buffer", settings.trigger_buffer_size).asDouble();
+    settings.metrics_file = root.get("metrics_file", settings.metrics_file).asString();
+    settings.trace_file = root.get("trace", settings.trace_file).asString();
+    settings.zmq_port = root.get("zmq_port", settings.zmq_port).asString();
+    settings.publish_zmq = root.get("enable_zmq", settings.publish_zmq).asBool();
+}
+
+std::shared_ptr<Recorder> createRecorder(const std::string &record_format)
+{
+    if (record_format == "json")
+    {
+        return std::make_shared<JsonRecorder>();
+    }
+    if (record_format == "columnar")
+    {
+        return std::make_shared<ColumnarRecorder>();
+    }
+    return std::shared_ptr<Recorder>();
+}
+
+/**
+ * Converts the PCAP file to the record file with the offline decoder, instead of replaying it
+ */
+int convertRecording(const HeadlessSettings &settings, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, Recorder &recorder)
+{
+    std::string error_msg;
+    recorder.open(settings.record_file, slaves, error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    OfflineDecoder decoder(slaves);
+    decoder.setThreadCount(settings.jobs);
+    decoder.setTimeRange(settings.start_time, settings.end_time);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    decoder.decode(settings.pcap_file, [&recorder]()
+    {
+        return recorder.createEncoder();
+    }, [&recorder](const std::string &output, uint64_t image_count)
+    {
+        recorder.recordEncoded(output, image_count);
+    }, error_msg);
+    recorder.close();
+    if (error_msg.empty() and recorder.getWriteErrors() > 0)
+    {
+        error_msg = "Could not write all images to " + settings.record_file;
+    }
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const OfflineDecodeStats &stats = decoder.getStats();
+    std::cout << "Recorded " << recorder.getRecordCount() << " images from " << stats.frames << " frames to " << settings.record_file
+              << " in " << seconds << " s (" << stats.working_counter_errors << " working counter errors)" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    HeadlessSettings settings;
+    settings.zmq_port = "9872";
+    settings.publish_zmq = false;
+    settings.frame_rate = DEFAULT_EXPECTED_FRAME_RATE;
+    settings.replay_speed = 1.0;
+    settings.start_time = 0.0;
+    settings.end_time = -1.0;
+    settings.jobs = -1;
+    settings.record_format = "json";
+    settings.pcap_compression = "none";
+    settings.pcap_file_size = 0.0;
+    settings.pcap_file_duration = 0.0;
+    settings.pcap_max_files = 0;
+    settings.trigger_pre_time = 10.0;
+    settings.trigger_post_time = 5.0;
+    settings.trigger_buffer_size = 256.0;
+
+    // the settings file is loaded first so that the other options override it
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--settings") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            std::string error_msg;
+            loadSettings(std::string(argv[i+1]), settings, error_msg);
+            if (!error_msg.empty())
+            {
+                std::cerr << error_msg << std::endl;
+                return 1;
+            }
+        }
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--enable_zmq") == 0)
+        {
+            settings.publish_zmq = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--frame_rate") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            settings.frame_rate = atof(argv[i+1]);
+            i += 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--replay_speed") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            settings.replay_speed = atof(argv[i+1]);
+            i += 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--jobs") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            settings.jobs = atoi(argv[i+1]);
+            i += 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--pcap_file_size") == 0 or strcmp(argv[i], "--pcap_file_duration") == 0 or strcmp(argv[i], "--pcap_max_files") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            if (strcmp(argv[i], "--pcap_max_files") == 0)
+            {
+                settings.pcap_max_files = atoi(argv[i+1]);
+            }
+            else
+            {
+                double &limit = strcmp(argv[i], "--pcap_file_size") == 0 ? settings.pcap_file_size : settings.pcap_file_duration;
+                limit = atof(argv[i+1]);
+            }
+            i += 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--trigger_pre") == 0 or strcmp(argv[i], "--trigger_post") == 0 or strcmp(argv[i], "--trigger_buffer") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            double &trigger_value = strcmp(argv[i], "--trigger_pre") == 0 ? settings.trigger_pre_time :
+                                    strcmp(argv[i], "--trigger_post") == 0 ? settings.trigger_post_time : settings.trigger_buffer_size;
+            trigger_value = atof(argv[i+1]);
+            i += 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--start_time") == 0 or strcmp(argv[i], "--end_time") == 0)
+        {
+            if (argc <= i+1)
+            {
+                std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+                print_usage(std::string(argv[0]));
+                return 1;
+            }
+            double &time = strcmp(argv[i], "--start_time") == 0 ? settings.start_time : settings.end_time;
+            time = atof(argv[i+1]);
+            i += 1;
+            continue;
+        }
+        std::string *value = NULL;
+        if (strcmp(argv[i], "--settings") == 0)
+        {
+            i += 1;
+            continue;
+        }
+        else if (strcmp(argv[i], "--src") == 0)
+        {
+            value = &settings.input_source;
+        }
+        else if (strcmp(argv[i], "--iface") == 0)
+        {
+            value = &settings.network_interface;
+        }
+        else if (strcmp(argv[i], "--config") == 0)
+        {
+            value = &settings.config_file;
+        }
+        else if (strcmp(argv[i], "--pcap") == 0)
+        {
+            value = &settings.pcap_file;
+        }
+        else if (strcmp(argv[i], "--record") == 0)
+        {
+            value = &settings.record_file;
+        }
+        else if (strcmp(argv[i], "--record_format") == 0)
+        {
+            value = &settings.record_format;
+        }
+        else if (strcmp(argv[i], "--record_pcap") == 0)
+        {
+            value = &settings.record_pcap_file;
+        }
+        else if (strcmp(argv[i], "--pcap_compression") == 0)
+        {
+            value = &settings.pcap_compression;
+        }
+        else if (strcmp(argv[i], "--trigger") == 0)
+        {
+            value = &settings.trigger_conditions;
+        }
+        else if (strcmp(argv[i], "--trigger_pcap") == 0)
+        {
+            value = &settings.trigger_pcap_file;
+        }
+        else if (strcmp(argv[i], "--trigger_columnar") == 0)
+        {
+            value = &settings.trigger_columnar_file;
+        }
+        else if (strcmp(argv[i], "--metrics_file") == 0)
+        {
+            value = &settings.metrics_file;
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            value = &settings.trace_file;
+        }
+        else if (strcmp(argv[i], "--zmq_port") == 0)
+        {
+            value = &settings.zmq_port;
+        }
+        else
+        {
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        if (argc <= i+1)
+        {
+            std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        *value = std::string(argv[i+1]);
+        i += 1;
+    }
+
+    if (settings.input_source != "ecat" and
+        settings.input_source != "sniffer" and
+        settings.input_source != "pcap")
+    {
+        std::cerr << "Invalid input source '" << settings.input_source << "'" << std::endl;
+        std::cerr << "Valid sources are: 'ecat', 'sniffer' and 'pcap' " << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.input_source != "pcap" and settings.network_interface.empty())
+    {
+        std::cerr << "No network interface specified" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.input_source != "ecat" and settings.config_file.empty())
+    {
+        std::cerr << "No config file specified" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.frame_rate <= 0.0)
+    {
+        std::cerr << "Invalid frame rate " << settings.frame_rate << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.replay_speed < 0.0)
+    {
+        std::cerr << "Invalid replay speed " << settings.replay_speed << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.input_source == "pcap" and settings.pcap_file.empty())
+    {
+        std::cerr << "No PCAP file specified" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+
+    std::shared_ptr<Recorder> recorder = createRecorder(settings.record_format);
+    if (!recorder)
+    {
+        std::cerr << "Invalid record format '" << settings.record_format << "'" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    FrameRecorderOptions pcap_options;
+    pcap_options.filename = settings.record_pcap_file;
+    if (!parseCompression(settings.pcap_compression, pcap_options.compression))
+    {
+        std::cerr << "Invalid compression '" << settings.pcap_compression << "'" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.pcap_file_size < 0.0 or settings.pcap_file_duration < 0.0 or settings.pcap_max_files < 0)
+    {
+        std::cerr << "Invalid limits of the pcapng files" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    pcap_options.max_file_size = static_cast<uint64_t>(settings.pcap_file_size * 1000000);
+    pcap_options.max_file_duration = settings.pcap_file_duration;
+    pcap_options.max_files = settings.pcap_max_files;
+    if (!settings.record_pcap_file.empty() and (settings.input_source == "ecat" or settings.jobs >= 0))
+    {
+        std::cerr << "--record_pcap requires the sniffer or a replayed PCAP file" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    TriggerCaptureOptions trigger_options;
+    trigger_options.pcap_filename = settings.trigger_pcap_file;
+    trigger_options.columnar_filename = settings.trigger_columnar_file;
+    trigger_options.compression = pcap_options.compression;
+    trigger_options.pre_trigger_time = settings.trigger_pre_time;
+    trigger_options.post_trigger_time = settings.trigger_post_time;
+    trigger_options.buffer_size = static_cast<size_t>(settings.trigger_buffer_size * 1000000);
+    bool has_trigger_capture = !settings.trigger_pcap_file.empty() or !settings.trigger_columnar_file.empty();
+    if (settings.trigger_pre_time < 0.0 or settings.trigger_post_time < 0.0 or settings.trigger_buffer_size <= 0.0)
+    {
+        std::cerr << "Invalid trigger capture window or buffer size" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (has_trigger_capture and (settings.input_source == "ecat" or settings.jobs >= 0))
+    {
+        std::cerr << "--trigger_pcap and --trigger_columnar require the sniffer or a replayed PCAP file" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (!settings.trigger_conditions.empty() and !has_trigger_capture)
+    {
+        std::cerr << "--trigger requires --trigger_pcap or --trigger_columnar" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+    if (settings.jobs >= 0 and (settings.input_source != "pcap" or settings.record_file.empty()))
+    {
+        std::cerr << "--jobs requires a PCAP file and a record file" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+
+    if (!settings.trace_file.empty())
+    {
+        Tracer::start();
+        Tracer::setThreadName("main");
+    }
+
+    if (settings.jobs >= 0)
+    {
+        // the offline decoder only needs the slaves, so the recording is not opened for a replay
+        std::string error_msg;
+        std::vector<std::shared_ptr<EthercatSlave>> slaves = readSlaveConfig(settings.config_file, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            return 1;
+        }
+        std::cout << "Found " << slaves.size() << " slaves" << std::endl;
+        int result = convertRecording(settings, slaves, *recorder);
+        if (!settings.trace_file.empty())
+        {
+            Tracer::stop();
+            Tracer::writeChromeTrace(settings.trace_file, error_msg);
+            if (!error_msg.empty())
+            {
+                std::cerr << error_msg << std::endl;
+                return 1;
+            }
+            std::cout << "Wrote trace to " << settings.trace_file << std::endl;
+        }
+        return result;
+    }
+
+    // block the termination signals (and SIGUSR1, which writes the trace, and SIGUSR2,
+    // which triggers a capture) in all threads (which inherit the mask), and wait for them below
+    sigset_t handled_signals;
+    sigemptyset(&handled_signals);
+    sigaddset(&handled_signals, SIGINT);
+    sigaddset(&handled_signals, SIGTERM);
+    sigaddset(&handled_signals, SIGUSR1);
+    sigaddset(&handled_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &handled_signals, NULL);
+
+    std::shared_ptr<ZMQPublisher> zmq_pub;
+    if (settings.publish_zmq)
+    {
+        zmq_pub = std::make_shared<ZMQPublisher>(settings.zmq_port);
+    }
+
+    std::string error_msg;
+    std::shared_ptr<EthercatDataSource> ecat_data_source;
+    std::shared_ptr<PacketSniffer> sniffer;
+    std::shared_ptr<PacketSniffer> replay;
+    std::shared_ptr<FrameRecorder> frame_recorder;
+    std::shared_ptr<TriggerCapture> trigger_capture;
+    if (settings.input_source == "ecat")
+    {
+        ecat_data_source = std::make_shared<EthercatMaster>(settings.network_interface, zmq_pub);
+    }
+    else
+    {
+        bool is_pcap_file = settings.input_source == "pcap";
+        sniffer = std::make_shared<PacketSniffer>(
+                is_pcap_file ? settings.pcap_file : settings.network_interface, is_pcap_file, zmq_pub, error_msg, settings.frame_rate);
+        if (error_msg.empty())
+        {
+            sniffer->setReplaySpeed(settings.replay_speed);
+            sniffer->setTimeRange(settings.start_time, settings.end_time);
+            sniffer->setConfigFile(settings.config_file, error_msg);
+        }
+        if (error_msg.empty() and !settings.record_pcap_file.empty())
+        {
+            frame_recorder = std::make_shared<FrameRecorder>(pcap_options, sniffer->getMetrics());
+            frame_recorder->start(error_msg);
+            sniffer->addFrameListener(frame_recorder);
+        }
+        ecat_data_source = sniffer;
+        if (is_pcap_file)
+        {
+            replay = sniffer;
+        }
+    }
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    ecat_data_source->setZMQPublish(settings.publish_zmq);
+    ecat_data_source->setMetricsFile(settings.metrics_file);
+
+    std::vector<std::shared_ptr<EthercatSlave>> slaves = ecat_data_source->getSlaves(error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    std::cout << "Found " << slaves.size() << " slaves" << std::endl;
+
+    if (has_trigger_capture)
+    {
+        // the conditions refer to the fields of the slaves, which are only known now
+        std::vector<TriggerCondition> conditions;
+        parseTriggerConditions(settings.trigger_conditions, slaves, conditions, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            return 1;
+        }
+        trigger_capture = std::make_shared<TriggerCapture>(trigger_options, conditions, slaves, sniffer->getMetrics());
+        trigger_capture->start(error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            return 1;
+        }
+        sniffer->addFrameListener(trigger_capture);
+    }
+
+    int recorder_subscription = -1;
+    if (!settings.record_file.empty())
+    {
+        recorder->open(settings.record_file, slaves, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            return 1;
+        }
+        // images are only dropped if the disk cannot keep up for a long time
+        SubscriberOptions options;
+        options.queue_size = 10000;
+        options.overflow_policy = DROP_NEWEST;
+        Metric *write_errors_metric = &ecat_data_source->getMetrics().getMetric("kddv_recorder_write_errors_total", METRIC_COUNTER,
+                                                                                "Failed writes to the record file");
+        recorder_subscription = ecat_data_source->getDataBus().subscribe("recorder", [recorder, write_errors_metric](const ProcessImagePtr &image)
+        {
+            recorder->record(*image);
+            write_errors_metric->set(recorder->getWriteErrors());
+        }, options);
+    }
+
+    ecat_data_source->start(error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+
+    int signal_number = 0;
+    bool replay_finished = false;
+    while (1)
+    {
+        if (replay)
+        {
+            // a replayed recording stops at its end
+            struct timespec timeout = {0, 200000000};
+            signal_number = sigtimedwait(&handled_signals, NULL, &timeout);
+            if (signal_number < 0)
+            {
+                replay_finished = replay->isReplayFinished();
+                if (replay_finished)
+                {
+                    break;
+                }
+                continue;
+            }
+        }
+        else
+        {
+            sigwait(&handled_signals, &signal_number);
+        }
+        if (signal_number == SIGUSR2)
+        {
+            if (!trigger_capture)
+            {
+                std::cerr << "Received SIGUSR2, but trigger capture is not enabled" << std::endl;
+                continue;
+            }
+            trigger_capture->trigger();
+            continue;
+        }
+        if (signal_number != SIGUSR1)
+        {
+            break;
+        }
+        if (settings.trace_file.empty())
+        {
+            std::cerr << "Received SIGUSR1, but tracing is not enabled" << std::endl;
+            continue;
+        }
+        Tracer::writeChromeTrace(settings.trace_file, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            error_msg.clear();
+            continue;
+        }
+        std::cout << "Wrote trace to " << settings.trace_file << std::endl;
+    }
+    if (replay_finished)
+    {
+        std::cout << "Replay finished, stopping" << std::endl;
+    }
+    else
+    {
+        std::cout << "Received signal " << signal_number << ", stopping" << std::endl;
+    }
+
+    ecat_data_source->stop();
+    if (frame_recorder)
+    {
+        frame_recorder->stop();
+        std::cout << "Recorded " << frame_recorder->getRecordedFrames() << " frames to " << frame_recorder->getFileCount() << " pcapng files ("
+                  << frame_recorder->getDroppedFrames() << " dropped)" << std::endl;
+    }
+    if (trigger_capture)
+    {
+        trigger_capture->stop();
+        std::cout << "Wrote " << trigger_capture->getCaptureCount() << " trigger captures" << std::endl;
+    }
+    MetricsRegistry &metrics = ecat_data_source->getMetrics();
+    if (metrics.getValue("kddv_kernel_dropped_frames_total") > 0 or metrics.getValue("kddv_datagram_index_gaps_total") > 0)
+    {
+        std::cout << "Capture is incomplete: " << metrics.getValue("kddv_kernel_dropped_frames_total") << " frames dropped by the kernel, "
+                  << metrics.getValue("kddv_datagram_index_gaps_total") << " datagram indices missing" << std::endl;
+    }
+    if (recorder_subscription >= 0)
+    {
+        std::vector<SubscriberStats> stats = ecat_data_source->getDataBus().getStats();
+        uint64_t dropped = 0;
+        for (int i = 0; i < stats.size(); i++)
+        {
+            if (stats[i].name == "recorder")
+            {
+                dropped = stats[i].dropped;
+            }
+        }
+        // writes the images which are still queued
+        ecat_data_source->getDataBus().unsubscribe(recorder_subscription);
+        recorder->close();
+        std::cout << "Recorded " << recorder->getRecordCount() << " images to " << settings.record_file
+                  << " (" << dropped << " dropped, " << recorder->getWriteErrors() << " write errors)" << std::endl;
+    }
+    if (!settings.trace_file.empty())
+    {
+        Tracer::stop();
+        Tracer::writeChromeTrace(settings.trace_file, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote trace to " << settings.trace_file << std::endl;
+    }
+    return 0;
+}
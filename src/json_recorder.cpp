@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "json_recorder.h"
+#include "tracer.h"
+#include <iostream>
+
+JsonRecorder::JsonRecorder() : record_count(0), write_errors(0)
+{
+}
+
+JsonRecorder::~JsonRecorder()
+{
+    close();
+}
+
+void JsonRecorder::open(const std::string &filename, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, std::string &error)
+{
+    file.open(filename, std::ios::out | std::ios::app);
+    if (!file.is_open())
+    {
+        error = "Could not open recording file " + filename;
+        return;
+    }
+    this->filename = filename;
+    this->slaves = slaves;
+    json_encoder.setSlaves(slaves);
+    record_count = 0;
+    write_errors = 0;
+}
+
+void JsonRecorder::close()
+{
+    if (file.is_open())
+    {
+        file.close();
+        checkWrite();
+    }
+}
+
+void JsonRecorder::record(const ProcessImage &image)
+{
+    TraceScope trace("record", "JsonRecorder::record");
+    if (!file.is_open())
+    {
+        return;
+    }
+    // JSON strings are written without newlines, so each image is on its own line
+    file << json_encoder.encode(image, image.timestamp) << '\n';
+    if (checkWrite())
+    {
+        record_count++;
+    }
+}
+
+std::shared_ptr<ImageEncoder> JsonRecorder::createEncoder() const
+{
+    return std::make_shared<JsonLineEncoder>(slaves);
+}
+
+void JsonRecorder::recordEncoded(const std::string &lines, uint64_t image_count)
+{
+    if (!file.is_open())
+    {
+        return;
+    }
+    file.write(lines.data(), lines.size());
+    if (checkWrite())
+    {
+        record_count += image_count;
+    }
+}
+
+uint64_t JsonRecorder::getRecordCount() const
+{
+    return record_count;
+}
+
+uint64_t JsonRecorder::getWriteErrors() const
+{
+    return write_errors;
+}
+
+bool JsonRecorder::checkWrite()
+{
+    if (!file.fail())
+    {
+        return true;
+    }
+    // e.g. the disk is full; the stream is reset so that writing continues when there is space again,
+    // and further errors are only counted, since every image would fail
+    if (write_errors == 0)
+    {
+        std::cerr << "Could not write recording file " << filename << std::endl;
+    }
+    write_errors++;
+    file.clear();
+    return false;
+}
+
+JsonLineEncoder::JsonLineEncoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves) : slaves(slaves)
+{
+}
+
+void JsonLineEncoder::startChunk()
+{
+    json_encoder.setSlaves(slaves);
+}
+
+void JsonLineEncoder::encode(const ProcessImage &image, std::string &output)
+{
+    output += json_encoder.encode(image, image.timestamp);
+    output += '\n';
+}
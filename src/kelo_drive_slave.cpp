@@ -6,7 +6,7 @@
  */
 
 #include "kelo_drive_slave.h"
-#include <cstring>
+#include <cstddef>
 
 const std::vector<std::string> KeloDriveSlave::tx_variables =
 {
@@ -126,159 +126,109 @@ const std::vector<std::string> KeloDriveSlave::rx_units =
     "[ns]"
 };
 
-const std::vector<std::string>& KeloDriveSlave::getRxVariables()
+// key TX variables shown in the overview of all slaves
+const std::vector<std::string> KeloDriveSlave::overview_variables =
 {
-    return rx_variables;
-}
+    "status1",
+    "voltage_bus",
+    "current_in",
+    "current_1_q",
+    "current_2_q",
+    "temperature_1",
+    "temperature_2"
+};
 
-const std::vector<std::string>& KeloDriveSlave::getTxVariables()
+const std::vector<FieldLayout> KeloDriveSlave::rx_layout =
 {
-    return tx_variables;
-}
+    {FIELD_UINT16, offsetof(rxpdo1_t, command1)},
+    {FIELD_UINT16, offsetof(rxpdo1_t, command2)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, setpoint1)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, setpoint2)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, limit1_p)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, limit1_n)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, limit2_p)},
+    {FIELD_FLOAT, offsetof(rxpdo1_t, limit2_n)},
+    {FIELD_UINT64, offsetof(rxpdo1_t, timestamp)}
+};
 
-const std::vector<std::string>& KeloDriveSlave::getRxUnits()
+const std::vector<FieldLayout> KeloDriveSlave::tx_layout =
 {
-    return rx_units;
-}
+    {FIELD_UINT16, offsetof(txpdo1_t, status1)},
+    {FIELD_UINT16, offsetof(txpdo1_t, status2)},
+    {FIELD_UINT64, offsetof(txpdo1_t, sensor_ts)},
+    {FIELD_UINT64, offsetof(txpdo1_t, setpoint_ts)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, encoder_1)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, velocity_1)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_1_d)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_1_q)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_1_u)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_1_v)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_1_w)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_1)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_1_u)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_1_v)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_1_w)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, temperature_1)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, encoder_2)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, velocity_2)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_2_d)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_2_q)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_2_u)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_2_v)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_2_w)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_2)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_2_u)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_2_v)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_2_w)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, temperature_2)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, encoder_pivot)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, velocity_pivot)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, voltage_bus)},
+    {FIELD_UINT64, offsetof(txpdo1_t, imu_ts)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, accel_x)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, accel_y)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, accel_z)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, gyro_x)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, gyro_y)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, gyro_z)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, temperature_imu)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, pressure)},
+    {FIELD_FLOAT, offsetof(txpdo1_t, current_in)}
+};
 
-const std::vector<std::string>& KeloDriveSlave::getTxUnits()
+const std::vector<std::string>& KeloDriveSlave::getRxVariables() const
 {
-    return tx_units;
+    return rx_variables;
 }
 
-KeloDriveSlave::KeloDriveSlave()
+const std::vector<std::string>& KeloDriveSlave::getTxVariables() const
 {
+    return tx_variables;
 }
 
-KeloDriveSlave::~KeloDriveSlave()
+const std::vector<std::string>& KeloDriveSlave::getRxUnits() const
 {
+    return rx_units;
 }
 
-void KeloDriveSlave::copyData(uint8_t *outputs, uint8_t *inputs)
+const std::vector<std::string>& KeloDriveSlave::getTxUnits() const
 {
-    std::memcpy(&rx, outputs, sizeof(rxpdo1_t));
-    std::memcpy(&tx, inputs, sizeof(txpdo1_t));
+    return tx_units;
 }
 
-void KeloDriveSlave::convertToJson(Json::Value &data) const
+const std::vector<std::string>& KeloDriveSlave::getOverviewVariables() const
 {
-    data["commands"]["command1"] = rx.command1;
-    data["commands"]["command2"] = rx.command2;
-    data["commands"]["setpoint1"] = rx.setpoint1;
-    data["commands"]["setpoint2"] = rx.setpoint2;
-    data["commands"]["limit1_p"] = rx.limit1_p;
-    data["commands"]["limit1_n"] = rx.limit1_n;
-    data["commands"]["limit2_p"] = rx.limit2_p;
-    data["commands"]["limit2_n"] = rx.limit2_n;
-    data["commands"]["timestamp"] = Json::Value::UInt64(rx.timestamp);
-
-    data["sensors"]["status1"] = tx.status1;
-    data["sensors"]["status2"] = tx.status2;
-    data["sensors"]["sensor_ts"] = Json::Value::UInt64(tx.sensor_ts);
-    data["sensors"]["setpoint_ts"] = Json::Value::UInt64(tx.setpoint_ts);
-    data["sensors"]["encoder_1"] = tx.encoder_1;
-    data["sensors"]["velocity_1"] = tx.velocity_1;
-    data["sensors"]["current_1_d"] = tx.current_1_d;
-    data["sensors"]["current_1_q"] = tx.current_1_q;
-    data["sensors"]["current_1_u"] = tx.current_1_u;
-    data["sensors"]["current_1_v"] = tx.current_1_v;
-    data["sensors"]["current_1_w"] = tx.current_1_w;
-    data["sensors"]["voltage_1"] = tx.voltage_1;
-    data["sensors"]["voltage_1_u"] = tx.voltage_1_u;
-    data["sensors"]["voltage_1_v"] = tx.voltage_1_v;
-    data["sensors"]["voltage_1_w"] = tx.voltage_1_w;
-    data["sensors"]["temperature_1"] = tx.temperature_1;
-    data["sensors"]["encoder_2"] = tx.encoder_2;
-    data["sensors"]["velocity_2"] = tx.velocity_2;
-    data["sensors"]["current_2_d"] = tx.current_2_d;
-    data["sensors"]["current_2_q"] = tx.current_2_q;
-    data["sensors"]["current_2_u"] = tx.current_2_u;
-    data["sensors"]["current_2_v"] = tx.current_2_v;
-    data["sensors"]["current_2_w"] = tx.current_2_w;
-    data["sensors"]["voltage_2"] = tx.voltage_2;
-    data["sensors"]["voltage_2_u"] = tx.voltage_2_u;
-    data["sensors"]["voltage_2_v"] = tx.voltage_2_v;
-    data["sensors"]["voltage_2_w"] = tx.voltage_2_w;
-    data["sensors"]["temperature_2"] = tx.temperature_2;
-    data["sensors"]["encoder_pivot"] = tx.encoder_pivot;
-    data["sensors"]["velocity_pivot"] = tx.velocity_pivot;
-    data["sensors"]["voltage_bus"] = tx.voltage_bus;
-    data["sensors"]["imu_ts"] = Json::Value::UInt64(tx.imu_ts);
-    data["sensors"]["accel_x"] = tx.accel_x;
-    data["sensors"]["accel_y"] = tx.accel_y;
-    data["sensors"]["accel_z"] = tx.accel_z;
-    data["sensors"]["gyro_x"] = tx.gyro_x;
-    data["sensors"]["gyro_y"] = tx.gyro_y;
-    data["sensors"]["gyro_z"] = tx.gyro_z;
-    data["sensors"]["temperature_imu"] = tx.temperature_imu;
-    data["sensors"]["pressure"] = tx.pressure;
-    data["sensors"]["current_in"] = tx.current_in;
+    return overview_variables;
 }
 
-std::vector<std::string> KeloDriveSlave::getRxValues()
+KeloDriveSlave::KeloDriveSlave() : EthercatSlave(rx_layout, tx_layout, sizeof(rxpdo1_t), sizeof(txpdo1_t))
 {
-    std::vector<std::string> data_values;
-    data_values.reserve(KeloDriveSlave::rx_variables.size());
-    data_values.push_back(std::to_string(rx.command1));
-    data_values.push_back(std::to_string(rx.command2));
-    data_values.push_back(std::to_string(rx.setpoint1));
-    data_values.push_back(std::to_string(rx.setpoint2));
-    data_values.push_back(std::to_string(rx.limit1_p));
-    data_values.push_back(std::to_string(rx.limit1_n));
-    data_values.push_back(std::to_string(rx.limit2_p));
-    data_values.push_back(std::to_string(rx.limit2_n));
-    data_values.push_back(std::to_string(rx.timestamp));
-    return data_values;
 }
 
-
-std::vector<std::string> KeloDriveSlave::getTxValues()
+KeloDriveSlave::~KeloDriveSlave()
 {
-    std::vector<std::string> data_values;
-    data_values.reserve(KeloDriveSlave::tx_variables.size());
-    data_values.push_back(std::to_string(tx.status1));
-    data_values.push_back(std::to_string(tx.status2));
-    data_values.push_back(std::to_string(tx.sensor_ts));
-    data_values.push_back(std::to_string(tx.setpoint_ts));
-    data_values.push_back(std::to_string(tx.encoder_1));
-    data_values.push_back(std::to_string(tx.velocity_1));
-    data_values.push_back(std::to_string(tx.current_1_d));
-    data_values.push_back(std::to_string(tx.current_1_q));
-    data_values.push_back(std::to_string(tx.current_1_u));
-    data_values.push_back(std::to_string(tx.current_1_v));
-    data_values.push_back(std::to_string(tx.current_1_w));
-    data_values.push_back(std::to_string(tx.voltage_1));
-    data_values.push_back(std::to_string(tx.voltage_1_u));
-    data_values.push_back(std::to_string(tx.voltage_1_v));
-    data_values.push_back(std::to_string(tx.voltage_1_w));
-    data_values.push_back(std::to_string(tx.temperature_1));
-    data_values.push_back(std::to_string(tx.encoder_2));
-    data_values.push_back(std::to_string(tx.velocity_2));
-    data_values.push_back(std::to_string(tx.current_2_d));
-    data_values.push_back(std::to_string(tx.current_2_q));
-    data_values.push_back(std::to_string(tx.current_2_u));
-    data_values.push_back(std::to_string(tx.current_2_v));
-    data_values.push_back(std::to_string(tx.current_2_w));
-    data_values.push_back(std::to_string(tx.voltage_2));
-    data_values.push_back(std::to_string(tx.voltage_2_u));
-    data_values.push_back(std::to_string(tx.voltage_2_v));
-    data_values.push_back(std::to_string(tx.voltage_2_w));
-    data_values.push_back(std::to_string(tx.temperature_2));
-    data_values.push_back(std::to_string(tx.encoder_pivot));
-    data_values.push_back(std::to_string(tx.velocity_pivot));
-    data_values.push_back(std::to_string(tx.voltage_bus));
-    data_values.push_back(std::to_string(tx.imu_ts));
-    data_values.push_back(std::to_string(tx.accel_x));
-    data_values.push_back(std::to_string(tx.accel_y));
-    data_values.push_back(std::to_string(tx.accel_z));
-    data_values.push_back(std::to_string(tx.gyro_x));
-    data_values.push_back(std::to_string(tx.gyro_y));
-    data_values.push_back(std::to_string(tx.gyro_z));
-    data_values.push_back(std::to_string(tx.temperature_imu));
-    data_values.push_back(std::to_string(tx.pressure));
-    data_values.push_back(std::to_string(tx.current_in));
-    return data_values;
 }
+
 bool KeloDriveSlave::areBitsParsable(const std::string &var_name)
 {
     return (var_name == "command1" or var_name == "status1");
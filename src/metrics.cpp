@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "metrics.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+Histogram::Histogram(const std::vector<uint64_t> &upper_bounds)
+    : upper_bounds(upper_bounds), bucket_counts(upper_bounds.size() + 1)
+{
+}
+
+void Histogram::observe(uint64_t value)
+{
+    int idx = 0;
+    while (idx < upper_bounds.size() and value > upper_bounds[idx])
+    {
+        idx++;
+    }
+    bucket_counts[idx].add();
+    sum.add(value);
+}
+
+const std::vector<uint64_t>& Histogram::getUpperBounds() const
+{
+    return upper_bounds;
+}
+
+uint64_t Histogram::getBucketCount(int idx) const
+{
+    return bucket_counts[idx].get();
+}
+
+uint64_t Histogram::getCount() const
+{
+    // summed from the buckets, so that it is consistent with them while values are observed
+    uint64_t count = 0;
+    for (int i = 0; i < bucket_counts.size(); i++)
+    {
+        count += bucket_counts[i].get();
+    }
+    return count;
+}
+
+uint64_t Histogram::getSum() const
+{
+    return sum.get();
+}
+
+Metric& MetricsRegistry::getMetric(const std::string &name, MetricType type, const std::string &help, const std::string &labels)
+{
+    std::lock_guard<std::mutex> guard(entries_mutex);
+    for (int i = 0; i < entries.size(); i++)
+    {
+        if (entries[i]->name == name and entries[i]->labels == labels)
+        {
+            return entries[i]->metric;
+        }
+    }
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->name = name;
+    entry->labels = labels;
+    entry->help = help;
+    entry->type = type;
+    entries.push_back(std::move(entry));
+    return entries.back()->metric;
+}
+
+Histogram& MetricsRegistry::getHistogram(const std::string &name, const std::string &help, const std::vector<uint64_t> &upper_bounds,
+                                        const std::string &labels)
+{
+    std::lock_guard<std::mutex> guard(entries_mutex);
+    for (int i = 0; i < entries.size(); i++)
+    {
+        if (entries[i]->name == name and entries[i]->labels == labels and entries[i]->histogram)
+        {
+            return *entries[i]->histogram;
+        }
+    }
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->name = name;
+    entry->labels = labels;
+    entry->help = help;
+    entry->type = METRIC_HISTOGRAM;
+    entry->histogram.reset(new Histogram(upper_bounds));
+    entries.push_back(std::move(entry));
+    return *entries.back()->histogram;
+}
+
+uint64_t MetricsRegistry::getValue(const std::string &name, const std::string &labels) const
+{
+    std::lock_guard<std::mutex> guard(entries_mutex);
+    for (int i = 0; i < entries.size(); i++)
+    {
+        if (entries[i]->name == name and entries[i]->labels == labels)
+        {
+            return entries[i]->histogram ? entries[i]->histogram->getCount() : entries[i]->metric.get();
+        }
+    }
+    return 0;
+}
+
+std::string MetricsRegistry::toPrometheus() const
+{
+    std::lock_guard<std::mutex> guard(entries_mutex);
+    // the samples of a name (with different labels) must form one group, so
+    // they are collected when the name first appears
+    std::vector<const Entry*> grouped;
+    for (int i = 0; i < entries.size(); i++)
+    {
+        bool is_grouped = false;
+        for (int j = 0; j < grouped.size(); j++)
+        {
+            is_grouped = is_grouped or grouped[j]->name == entries[i]->name;
+        }
+        for (int j = i; j < entries.size() and !is_grouped; j++)
+        {
+            if (entries[j]->name == entries[i]->name)
+            {
+                grouped.push_back(entries[j].get());
+            }
+        }
+    }
+    std::ostringstream out;
+    for (int i = 0; i < grouped.size(); i++)
+    {
+        const Entry &entry = *grouped[i];
+        // HELP and TYPE once per name, before the first sample with that name
+        if (i == 0 or grouped[i - 1]->name != entry.name)
+        {
+            out << "# HELP " << entry.name << " " << entry.help << "\n";
+            out << "# TYPE " << entry.name << " " << getTypeName(entry.type) << "\n";
+        }
+        if (entry.histogram)
+        {
+            writePrometheusHistogram(out, entry);
+            continue;
+        }
+        out << entry.name;
+        if (!entry.labels.empty())
+        {
+            out << "{" << entry.labels << "}";
+        }
+        out << " " << entry.metric.get() << "\n";
+    }
+    return out.str();
+}
+
+Json::Value MetricsRegistry::toJson() const
+{
+    std::lock_guard<std::mutex> guard(entries_mutex);
+    Json::Value metrics;
+    for (int i = 0; i < entries.size(); i++)
+    {
+        std::string key = entries[i]->name;
+        if (!entries[i]->labels.empty())
+        {
+            key += "{" + entries[i]->labels + "}";
+        }
+        if (entries[i]->histogram)
+        {
+            const Histogram &histogram = *entries[i]->histogram;
+            Json::Value value;
+            for (int j = 0; j <= histogram.getUpperBounds().size(); j++)
+            {
+                std::string bound = j < histogram.getUpperBounds().size() ? std::to_string(histogram.getUpperBounds()[j]) : "+Inf";
+                value["buckets"][bound] = static_cast<Json::UInt64>(histogram.getBucketCount(j));
+            }
+            value["sum"] = static_cast<Json::UInt64>(histogram.getSum());
+            value["count"] = static_cast<Json::UInt64>(histogram.getCount());
+            metrics[key] = value;
+            continue;
+        }
+        metrics[key] = static_cast<Json::UInt64>(entries[i]->metric.get());
+    }
+    return metrics;
+}
+
+const char* MetricsRegistry::getTypeName(MetricType type)
+{
+    switch (type)
+    {
+        case METRIC_COUNTER:
+            return "counter";
+        case METRIC_GAUGE:
+            return "gauge";
+        case METRIC_HISTOGRAM:
+            return "histogram";
+    }
+    return "untyped";
+}
+
+void MetricsRegistry::writePrometheusHistogram(std::ostream &out, const Entry &entry)
+{
+    // buckets are cumulative in the Prometheus format
+    const Histogram &histogram = *entry.histogram;
+    std::string label_prefix = entry.labels.empty() ? "" : entry.labels + ",";
+    uint64_t cumulative_count = 0;
+    for (int i = 0; i <= histogram.getUpperBounds().size(); i++)
+    {
+        cumulative_count += histogram.getBucketCount(i);
+        std::string bound = i < histogram.getUpperBounds().size() ? std::to_string(histogram.getUpperBounds()[i]) : "+Inf";
+        out << entry.name << "_bucket{" << label_prefix << "le=\"" << bound << "\"} " << cumulative_count << "\n";
+    }
+    std::string labels = entry.labels.empty() ? "" : "{" + entry.labels + "}";
+    out << entry.name << "_sum" << labels << " " << histogram.getSum() << "\n";
+    out << entry.name << "_count" << labels << " " << cumulative_count << "\n";
+}
+
+void MetricsRegistry::writePrometheusFile(const std::string &filename, std::string &error) const
+{
+    std::string tmp_filename = filename + ".tmp";
+    {
+        std::ofstream outfile(tmp_filename, std::ios::out | std::ios::trunc);
+        if (!outfile)
+        {
+            error = "Could not open file " + tmp_filename;
+            return;
+        }
+        outfile << toPrometheus();
+        if (!outfile)
+        {
+            error = "Could not write file " + tmp_filename;
+            return;
+        }
+    }
+    if (std::rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        error = "Could not rename " + tmp_filename + " to " + filename;
+    }
+}
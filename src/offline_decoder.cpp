@@ -0,0 +1,225 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "offline_decoder.h"
+#include "ethercat_frame.h"
+#include "pcap_index.h"
+#include "tracer.h"
+#include <algorithm>
+#include <thread>
+
+extern "C" {
+#include "ethercat.h"
+}
+
+const int OfflineDecoder::CHUNK_FRAMES;
+
+OfflineDecoder::OfflineDecoder(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+    : slaves(slaves), thread_count(0), start_time(0.0), end_time(-1.0), stats(), next_chunk(0), written_chunks(0),
+      max_pending_chunks(0), cancelled(false)
+{
+}
+
+void OfflineDecoder::setThreadCount(int thread_count)
+{
+    this->thread_count = thread_count;
+}
+
+void OfflineDecoder::setTimeRange(double start_time, double end_time)
+{
+    this->start_time = start_time;
+    this->end_time = end_time;
+}
+
+void OfflineDecoder::decode(const std::string &filename, const ImageEncoderFactory &encoder_factory,
+                            const OutputCallback &output_callback, std::string &error)
+{
+    stats = OfflineDecodeStats();
+    PcapReader reader;
+    PcapIndex pcap_index;
+    reader.open(filename, error);
+    if (error.empty())
+    {
+        pcap_index.open(filename, reader, error);
+    }
+    if (!error.empty())
+    {
+        return;
+    }
+    uint64_t start_timestamp = pcap_index.getStartTime() + static_cast<uint64_t>(std::max(start_time, 0.0) * 1000000);
+    uint64_t end_timestamp = end_time < 0.0 ? 0 : pcap_index.getStartTime() + static_cast<uint64_t>(end_time * 1000000);
+
+    // chunks start at indexed frames; the timestamp of an entry is the highest up to its frame,
+    // so a chunk can be skipped if the entry of the next chunk is before the start
+    int entries_per_chunk = CHUNK_FRAMES / PcapIndex::INDEX_INTERVAL;
+    chunks.clear();
+    for (int i = 0; i < pcap_index.getEntryCount(); i += entries_per_chunk)
+    {
+        int next = i + entries_per_chunk;
+        if (next < pcap_index.getEntryCount() and pcap_index.getEntryTimestamp(next) < start_timestamp)
+        {
+            continue;
+        }
+        if (end_timestamp > 0 and pcap_index.getEntryTimestamp(i) > end_timestamp)
+        {
+            break;
+        }
+        Chunk chunk;
+        chunk.start_offset = pcap_index.getEntryOffset(i);
+        // the last chunk ends after the last complete frame, before a truncated end of the recording
+        chunk.end_offset = next < pcap_index.getEntryCount() ? pcap_index.getEntryOffset(next) : pcap_index.getEndOffset();
+        chunk.done = false;
+        chunk.stats = OfflineDecodeStats();
+        chunks.push_back(chunk);
+    }
+    reader.close();
+
+    int threads = thread_count > 0 ? thread_count : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, static_cast<int>(chunks.size())));
+    next_chunk = 0;
+    written_chunks = 0;
+    max_pending_chunks = threads * 2;
+    cancelled = false;
+    std::vector<std::thread> decoder_threads;
+    for (int i = 0; i < threads; i++)
+    {
+        decoder_threads.push_back(std::thread(&OfflineDecoder::decodeChunks, this, filename, encoder_factory,
+                                              start_timestamp, end_timestamp, i));
+    }
+
+    for (int i = 0; i < chunks.size(); i++)
+    {
+        Chunk &chunk = chunks[i];
+        {
+            std::unique_lock<std::mutex> lock(chunks_mutex);
+            chunks_condition.wait(lock, [&chunk] { return chunk.done; });
+        }
+        if (!chunk.error.empty())
+        {
+            error = chunk.error;
+            break;
+        }
+        // the chunk is not touched by the decoding threads anymore
+        output_callback(chunk.output, chunk.stats.images);
+        stats.frames += chunk.stats.frames;
+        stats.images += chunk.stats.images;
+        stats.frames_filtered += chunk.stats.frames_filtered;
+        stats.working_counter_errors += chunk.stats.working_counter_errors;
+        std::string().swap(chunk.output);
+        {
+            std::lock_guard<std::mutex> guard(chunks_mutex);
+            written_chunks++;
+        }
+        chunks_condition.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> guard(chunks_mutex);
+        cancelled = true;
+    }
+    chunks_condition.notify_all();
+    for (int i = 0; i < decoder_threads.size(); i++)
+    {
+        decoder_threads[i].join();
+    }
+    chunks.clear();
+}
+
+const OfflineDecodeStats& OfflineDecoder::getStats() const
+{
+    return stats;
+}
+
+void OfflineDecoder::decodeChunks(const std::string &filename, const ImageEncoderFactory &encoder_factory,
+                                  uint64_t start_timestamp, uint64_t end_timestamp, int thread_idx)
+{
+    Tracer::setThreadName("decoder " + std::to_string(thread_idx));
+    // each thread maps the file with its own reader, since readers are not thread safe
+    PcapReader reader;
+    std::string error;
+    reader.open(filename, error);
+    std::shared_ptr<ImageEncoder> encoder = encoder_factory();
+    std::shared_ptr<ProcessImagePool> pool = std::make_shared<ProcessImagePool>(slaves);
+    while (true)
+    {
+        int chunk_idx;
+        {
+            std::unique_lock<std::mutex> lock(chunks_mutex);
+            chunks_condition.wait(lock, [this]
+            {
+                return cancelled or next_chunk >= chunks.size() or next_chunk < written_chunks + max_pending_chunks;
+            });
+            if (cancelled or next_chunk >= chunks.size())
+            {
+                break;
+            }
+            chunk_idx = next_chunk++;
+        }
+        Chunk &chunk = chunks[chunk_idx];
+        if (error.empty())
+        {
+            decodeChunk(reader, *encoder, *pool, chunk, start_timestamp, end_timestamp);
+        }
+        else
+        {
+            chunk.error = error;
+        }
+        {
+            std::lock_guard<std::mutex> guard(chunks_mutex);
+            chunk.done = true;
+        }
+        chunks_condition.notify_all();
+    }
+}
+
+void OfflineDecoder::decodeChunk(PcapReader &reader, ImageEncoder &encoder, ProcessImagePool &pool, Chunk &chunk,
+                                 uint64_t start_timestamp, uint64_t end_timestamp)
+{
+    TraceScope trace("decode", "OfflineDecoder::decodeChunk");
+    encoder.startChunk();
+    reader.seek(chunk.start_offset);
+    // each slave gets +3 for read/write, see PacketSniffer
+    int expected_wkcnt = slaves.size() * 3;
+    std::shared_ptr<ProcessImage> previous;
+    PcapFrame frame;
+    while (reader.getPosition() < chunk.end_offset and reader.readFrame(frame, chunk.error))
+    {
+        if (frame.offset >= chunk.end_offset)
+        {
+            break;
+        }
+        if (frame.timestamp_us < start_timestamp or (end_timestamp > 0 and frame.timestamp_us > end_timestamp))
+        {
+            continue;
+        }
+        chunk.stats.frames++;
+        EthercatFrame ethercat_frame;
+        if (frame.size < ETHERNET_HEADER_SIZE or frame.data[12] != 0x88 or frame.data[13] != 0xa4 or
+            !parseEthercatFrame(frame.data, frame.size, ethercat_frame) or
+            !ethercat_frame.returned or ethercat_frame.command != EC_CMD_LRW)
+        {
+            chunk.stats.frames_filtered++;
+            continue;
+        }
+        std::shared_ptr<ProcessImage> image = pool.acquire();
+        // the number of the cycle is only known when the chunks are merged
+        image->sequence = 0;
+        image->timestamp = frame.timestamp_us / 1000000.0;
+        if (!copyFrameData(ethercat_frame, slaves, *image, previous.get()))
+        {
+            chunk.stats.frames_filtered++;
+            continue;
+        }
+        if (ethercat_frame.working_counter != expected_wkcnt)
+        {
+            chunk.stats.working_counter_errors++;
+        }
+        encoder.encode(*image, chunk.output);
+        chunk.stats.images++;
+        previous = image;
+    }
+    encoder.finishChunk(chunk.output);
+}
@@ -9,28 +9,92 @@
 #include "robile_battery_slave.h"
 #include "kelo_drive_slave.h"
 #include "kelo_bms_slave.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include "ui.h"
+#include "tracer.h"
+#include "ethercat_frame.h"
 
-PacketSniffer::PacketSniffer(const std::string &ifname_or_filename, bool is_pcap_file, std::shared_ptr<ZMQPublisher> zmq_pub, std::string &error_msg)
-    : EthercatDataSource(zmq_pub)
+namespace
+{
+    void loadConfig(const std::string &filename, Json::Value &config, std::string &error)
+    {
+        std::ifstream infile(filename);
+        if (infile)
+        {
+            infile >> config;
+        }
+        else
+        {
+            error = "Could not open file "  + filename;
+        }
+    }
+
+    std::vector<std::shared_ptr<EthercatSlave>> createSlaves(const Json::Value &config)
+    {
+        std::vector<std::shared_ptr<EthercatSlave>> slaves;
+        for (int i = 0; i < config["Slaves"].size(); i++)
+        {
+            uint8_t slave_type = getSlaveType(config["Slaves"][i]["Name"].asString());
+            std::shared_ptr<EthercatSlave> slave = createSlave(slave_type);
+
+            slave->slave_info.slave_type = slave_type;
+            slave->slave_info.name = config["Slaves"][i]["Name"].asString();
+            slave->slave_info.slave_number = config["Slaves"][i]["Slave ID"].asInt();
+            slave->slave_info.eep_man = config["Slaves"][i]["EEP Man"].asInt();
+            slave->slave_info.eep_id = config["Slaves"][i]["EEP ID"].asInt();
+            slave->slave_info.eep_rev = config["Slaves"][i]["EEP Rev"].asInt();
+            slave->slave_info.address = config["Slaves"][i]["Address"].asInt();
+            slave->slave_info.rx_start_offset = config["Slaves"][i]["RX start offset"].asInt();
+            slave->slave_info.tx_start_offset = config["Slaves"][i]["TX start offset"].asInt();
+            slaves.push_back(slave);
+        }
+        return slaves;
+    }
+}
+
+std::vector<std::shared_ptr<EthercatSlave>> readSlaveConfig(const std::string &filename, std::string &error)
+{
+    Json::Value config;
+    loadConfig(filename, config, error);
+    if (!error.empty())
+    {
+        return std::vector<std::shared_ptr<EthercatSlave>>();
+    }
+    return createSlaves(config);
+}
+
+PacketSniffer::PacketSniffer(const std::string &ifname_or_filename, bool is_pcap_file, std::shared_ptr<ZMQPublisher> zmq_pub, std::string &error_msg,
+                             double expected_frame_rate)
+    : EthercatDataSource(zmq_pub), is_live_capture(!is_pcap_file),
+      kernel_drops_metric(metrics.getMetric("kddv_kernel_dropped_frames_total", METRIC_COUNTER, "Frames dropped by the kernel because the capture buffer was full")),
+      index_gaps_metric(metrics.getMetric("kddv_datagram_index_gaps_total", METRIC_COUNTER,
+                                          "Datagram indices missing between consecutive returned frames (dropped by the kernel or lost on the bus)")),
+      incomplete_seconds_metric(metrics.getMetric("kddv_capture_incomplete_seconds_total", METRIC_COUNTER,
+                                                  "Seconds of live capture in which frames were dropped or datagram indices were missing")),
+      last_reported_losses(0), has_datagram_index(false), last_datagram_index(0), max_datagram_index(0),
+      frame_timing(metrics), replay_speed(1.0), replay_paused(false), replay_steps(0), replay_stopped(false),
+      has_replay_anchor(false), replay_anchor_timestamp(0), replay_start_time(0.0), replay_end_time(-1.0), seek_pending(false),
+      seek_timestamp(0), replay_position(0), replay_finished(false)
 {
     Tins::SnifferConfiguration sniffer_config;
     // https://gitlab.com/wireshark/wireshark/-/wikis/Protocols/ethercat
     sniffer_config.set_filter("ether proto 0x88a4");
     // without this, the packet capture will lag behind the packets being received
     sniffer_config.set_immediate_mode(true);
+    // each cycle is seen twice (sent and returned); the buffer holds two seconds
+    // of full size frames, plus the kernel's per frame overhead
+    double buffer_size = expected_frame_rate * 2 * (1518 + 64) * 2;
+    buffer_size = std::min(std::max(buffer_size, 2.0 * 1024 * 1024), 256.0 * 1024 * 1024);
+    sniffer_config.set_buffer_size(static_cast<uint32_t>(buffer_size));
 
     if (is_pcap_file)
     {
-        try
-        {
-            sniffer = std::make_shared<Tins::FileSniffer>(ifname_or_filename, sniffer_config);
-        }
-        catch (std::exception &e)
+        pcap_reader.open(ifname_or_filename, error_msg);
+        if (error_msg.empty())
         {
-            error_msg = e.what();
+            pcap_index.open(ifname_or_filename, pcap_reader, error_msg);
         }
     }
     else
@@ -48,12 +112,18 @@ PacketSniffer::PacketSniffer(const std::string &ifname_or_filename, bool is_pcap
 
 PacketSniffer::~PacketSniffer()
 {
+    {
+        // a replay waits at the end of the recording until it is stopped
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        replay_stopped = true;
+    }
+    replay_condition.notify_all();
     if (sniffer_thread.joinable()) sniffer_thread.join();
 }
 
 void PacketSniffer::setConfigFile(const std::string &filename, std::string &error_msg)
 {
-    loadConfig(filename, error_msg);
+    loadConfig(filename, config, error_msg);
 }
 
 std::vector<std::shared_ptr<EthercatSlave>>& PacketSniffer::getSlaves(std::string &error)
@@ -64,123 +134,357 @@ std::vector<std::shared_ptr<EthercatSlave>>& PacketSniffer::getSlaves(std::strin
         error = "No config file specified";
         return slaves;
     }
-    for (int i = 0; i < config["Slaves"].size(); i++)
+    slaves = createSlaves(config);
+    return slaves;
+}
+
+void PacketSniffer::start(std::string &error)
+{
+    prepareRun();
     {
-        std::shared_ptr<EthercatSlave> slave;
-        uint8_t slave_type = getSlaveType(config["Slaves"][i]["Name"].asString());
-        if (slave_type == ROBILE_BATTERY_SLAVE)
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        replay_stopped = false;
+        has_replay_anchor = false;
+        if (!is_live_capture)
         {
-            slave = std::make_shared<RobileBatterySlave>();
+            seek_pending = true;
+            seek_timestamp = pcap_index.getStartTime() + static_cast<uint64_t>(std::max(replay_start_time, 0.0) * 1000000);
         }
-        else if (slave_type == KELO_DRIVE_SLAVE)
+    }
+    sniffer_thread = std::thread(&PacketSniffer::startSnifferLoop, this);
+}
+
+void PacketSniffer::stop()
+{
+    {
+        // wakes up a paused or waiting replay
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        replay_stopped = true;
+    }
+    replay_condition.notify_all();
+    if (is_live_capture)
+    {
+        sniffer->stop_sniff();
+    }
+    if (sniffer_thread.joinable()) sniffer_thread.join();
+}
+
+void PacketSniffer::addFrameListener(const std::shared_ptr<FrameListener> &listener)
+{
+    frame_listeners.push_back(listener);
+}
+
+bool PacketSniffer::isReplay() const
+{
+    return !is_live_capture;
+}
+
+void PacketSniffer::setReplaySpeed(double speed)
+{
+    {
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        replay_speed = std::max(speed, 0.0);
+        has_replay_anchor = false;
+    }
+    replay_condition.notify_all();
+}
+
+double PacketSniffer::getReplaySpeed()
+{
+    std::lock_guard<std::mutex> guard(replay_mutex);
+    return replay_speed;
+}
+
+void PacketSniffer::setPaused(bool paused)
+{
+    {
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        replay_paused = paused;
+        replay_steps = 0;
+        has_replay_anchor = false;
+    }
+    replay_condition.notify_all();
+}
+
+bool PacketSniffer::isPaused()
+{
+    std::lock_guard<std::mutex> guard(replay_mutex);
+    return replay_paused;
+}
+
+void PacketSniffer::step()
+{
+    {
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        if (!replay_paused)
         {
-            slave = std::make_shared<KeloDriveSlave>();
+            return;
         }
-        else if (slave_type == KELO_BMS_SLAVE)
+        replay_steps++;
+    }
+    replay_condition.notify_all();
+}
+
+void PacketSniffer::setTimeRange(double start_time, double end_time)
+{
+    std::lock_guard<std::mutex> guard(replay_mutex);
+    replay_start_time = start_time;
+    replay_end_time = end_time;
+}
+
+double PacketSniffer::getDuration() const
+{
+    return (pcap_index.getEndTime() - pcap_index.getStartTime()) / 1000000.0;
+}
+
+void PacketSniffer::seek(double time)
+{
+    {
+        std::lock_guard<std::mutex> guard(replay_mutex);
+        seek_pending = true;
+        seek_timestamp = pcap_index.getStartTime() + static_cast<uint64_t>(std::max(time, 0.0) * 1000000);
+        // a paused replay shows the image at the new time
+        if (replay_paused)
         {
-            slave = std::make_shared<KeloBMSSlave>();
+            replay_steps = 1;
         }
-
-        slave->slave_info.slave_type = slave_type;
-        slave->slave_info.name = config["Slaves"][i]["Name"].asString();
-        slave->slave_info.slave_number = config["Slaves"][i]["Slave ID"].asInt();
-        slave->slave_info.eep_man = config["Slaves"][i]["EEP Man"].asInt();
-        slave->slave_info.eep_id = config["Slaves"][i]["EEP ID"].asInt();
-        slave->slave_info.eep_rev = config["Slaves"][i]["EEP Rev"].asInt();
-        slave->slave_info.address = config["Slaves"][i]["Address"].asInt();
-        slave->slave_info.rx_start_offset = config["Slaves"][i]["RX start offset"].asInt();
-        slave->slave_info.tx_start_offset = config["Slaves"][i]["TX start offset"].asInt();
-        slaves.push_back(slave);
     }
-    return slaves;
+    replay_condition.notify_all();
 }
 
-void PacketSniffer::start(std::string &error)
+bool PacketSniffer::isReplayFinished() const
 {
-    sniffer_thread = std::thread(&PacketSniffer::startSnifferLoop, this);
+    return replay_finished;
 }
 
-void PacketSniffer::stop()
+double PacketSniffer::getReplayPosition() const
 {
-    sniffer->stop_sniff();
-    if (sniffer_thread.joinable()) sniffer_thread.join();
+    uint64_t position = replay_position.load();
+    return position > pcap_index.getStartTime() ? (position - pcap_index.getStartTime()) / 1000000.0 : 0.0;
+}
+
+bool PacketSniffer::waitForReplay(uint64_t timestamp_us)
+{
+    std::unique_lock<std::mutex> lock(replay_mutex);
+    // a seek interrupts the wait, and the replay loop continues at the new time
+    while (!replay_stopped and !seek_pending)
+    {
+        if (replay_paused)
+        {
+            if (replay_steps > 0)
+            {
+                replay_steps--;
+                return true;
+            }
+            replay_condition.wait(lock);
+            continue;
+        }
+        if (replay_speed <= 0.0)
+        {
+            return true;
+        }
+        if (!has_replay_anchor or timestamp_us < replay_anchor_timestamp)
+        {
+            has_replay_anchor = true;
+            replay_anchor_timestamp = timestamp_us;
+            replay_anchor_time = std::chrono::steady_clock::now();
+            return true;
+        }
+        std::chrono::steady_clock::time_point replay_time = replay_anchor_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::micro>((timestamp_us - replay_anchor_timestamp) / replay_speed));
+        if (std::chrono::steady_clock::now() >= replay_time)
+        {
+            return true;
+        }
+        // woken up early if the speed is changed, or the replay is paused, seeked or stopped
+        replay_condition.wait_until(lock, replay_time);
+    }
+    return false;
 }
 
 bool PacketSniffer::packetCallback(Tins::Packet &packet)
 {
-    Tins::PDU * pdu = packet.pdu();
     Tins::Timestamp timestamp = packet.timestamp();
-    Tins::EthernetII &eth  = pdu->rfind_pdu<Tins::EthernetII>();
+    Tins::EthernetII &eth = packet.pdu()->rfind_pdu<Tins::EthernetII>();
     Tins::PDU::serialization_type buffer = eth.serialize();
+    processFrame(&buffer[0], buffer.size(), static_cast<uint64_t>(timestamp.seconds()) * 1000000 + timestamp.microseconds());
+    return true;
+}
 
-    // make sure we only process incoming packets (i.e. those that have completed
-    // the cycle through all slaves and have the correct working count)
-    if (eth.src_addr().to_string() != "03:01:01:01:01:01")
+void PacketSniffer::processFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us)
+{
+    TraceScope trace("capture", "PacketSniffer::processFrame");
+
+    frames_seen_metric.add();
+    updateCaptureStats();
+    for (int i = 0; i < frame_listeners.size(); i++)
     {
-        return true;
+        frame_listeners[i]->addFrame(frame, size, timestamp_us);
+    }
+    EthercatFrame ethercat_frame;
+    if (!parseEthercatFrame(frame, size, ethercat_frame))
+    {
+        frames_filtered_metric.add();
+        return;
     }
 
-    ec_comt ethercat_header;
-    std::memcpy(&ethercat_header, &buffer[0] + eth.header_size(), sizeof(ec_comt));
+    // make sure we only process incoming packets (i.e. those that have completed
+    // the cycle through all slaves and have the correct working count); the
+    // outgoing process data frames are only used to measure the timing
+    if (!ethercat_frame.returned)
+    {
+        if (ethercat_frame.command == EC_CMD_LRW)
+        {
+            frame_timing.addOutgoingFrame(ethercat_frame.index, timestamp_us);
+        }
+        frames_filtered_metric.add();
+        return;
+    }
+    checkDatagramIndex(ethercat_frame.index);
 
     // don't process anything that's not a logical read write datagram
-    if (ethercat_header.command != EC_CMD_LRW)
+    if (ethercat_frame.command != EC_CMD_LRW)
     {
-        return true;
+        frames_filtered_metric.add();
+        return;
     }
-
-    int datagram_size = ((int)(ethercat_header.dlength) & 0x0fff);
-
-    int wkcnt = 0;
-    std::memcpy(&wkcnt, &buffer[0] + eth.header_size() + sizeof(ec_comt) + datagram_size, 2);
+    frame_timing.addReturnedFrame(ethercat_frame.index, timestamp_us);
 
     // each slave gets +3 for read/write: https://infosys.beckhoff.com/english.php?content=../content/1033/tc3_io_intro/1446515467.html&id= 
     int expected_wkcnt = slaves.size() * 3;
     // TODO: add a callback to the UI to display errors
-    if (expected_wkcnt != wkcnt)
+    if (expected_wkcnt != ethercat_frame.working_counter)
     {
-        std::cout << "Working counter is " << wkcnt << " but expected " << expected_wkcnt << std::endl;
+        working_counter_errors_metric.add();
+        std::cout << "Working counter is " << ethercat_frame.working_counter << " but expected " << expected_wkcnt << std::endl;
     }
 
-    double ts = timestamp.seconds() + (timestamp.microseconds() / 1000000.0);
-
-    int start_offset = eth.header_size() + sizeof(ec_comt);
-    int current_offset;
-
-
-    for (int i = 0; i < slaves.size(); i++)
+    std::shared_ptr<ProcessImage> image = createImage();
     {
-        current_offset = start_offset + slaves[i]->slave_info.rx_start_offset;
-        uint8 *rx_data = (uint8*)(&buffer[0] + current_offset);
-        current_offset = start_offset + slaves[i]->slave_info.tx_start_offset;
-        uint8 *tx_data = (uint8*)(&buffer[0] + current_offset);
-        slaves[i]->copyData(rx_data, tx_data);
+        TraceScope trace_decode("decode", "PacketSniffer::copySlaveData");
+        ProcessImagePtr previous = getLatestImage();
+        image->timestamp = timestamp_us / 1000000.0;
+        if (!copyFrameData(ethercat_frame, slaves, *image, previous.get()))
+        {
+            frames_filtered_metric.add();
+            return;
+        }
     }
 
-    (ui->*callback_fn)(slaves);
-    if (zmq_publish_enabled)
+    if (!is_live_capture and !waitForReplay(timestamp_us))
     {
-        zmq_pub->publishMsg(convertToJson(slaves));
+        return;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(5)); // 200 Hz
-
-    return true;
+    replay_position = timestamp_us;
+    publishImage(commitImage(image));
+}
 
+void PacketSniffer::checkDatagramIndex(uint8_t index)
+{
+    max_datagram_index = std::max(max_datagram_index, index);
+    if (has_datagram_index and index != last_datagram_index)
+    {
+        int missing;
+        if (index > last_datagram_index)
+        {
+            missing = index - last_datagram_index - 1;
+        }
+        else
+        {
+            missing = (max_datagram_index - last_datagram_index) + index;
+        }
+        if (missing > 0)
+        {
+            index_gaps_metric.add(missing);
+        }
+    }
+    has_datagram_index = true;
+    last_datagram_index = index;
 }
-void PacketSniffer::startSnifferLoop()
+
+void PacketSniffer::updateCaptureStats()
 {
-    sniffer->sniff_loop(std::bind(&PacketSniffer::packetCallback, this, std::placeholders::_1));
+    // the kernel's drop counter is only read once per second
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (!is_live_capture or now - last_capture_stats_time < std::chrono::seconds(1))
+    {
+        return;
+    }
+    last_capture_stats_time = now;
+    struct pcap_stat stats;
+    if (pcap_stats(sniffer->get_pcap_handle(), &stats) == 0)
+    {
+        kernel_drops_metric.set(stats.ps_drop + stats.ps_ifdrop);
+    }
+    uint64_t losses = kernel_drops_metric.get() + index_gaps_metric.get();
+    if (losses != last_reported_losses)
+    {
+        incomplete_seconds_metric.add();
+        last_reported_losses = losses;
+    }
 }
 
-void PacketSniffer::loadConfig(const std::string &filename, std::string &error_msg)
+void PacketSniffer::startSnifferLoop()
 {
-    std::ifstream infile(filename);
-    if (infile)
+    Tracer::setThreadName("sniffer");
+    if (is_live_capture)
     {
-        infile >> config;
+        sniffer->sniff_loop(std::bind(&PacketSniffer::packetCallback, this, std::placeholders::_1));
     }
     else
     {
-        error_msg = "Could not open file "  + filename;
+        replayLoop();
+    }
+}
+
+void PacketSniffer::replayLoop()
+{
+    PcapFrame frame;
+    std::string error_msg;
+    uint64_t skip_until = 0;
+    uint64_t end_timestamp = 0;
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> guard(replay_mutex);
+            if (replay_stopped)
+            {
+                break;
+            }
+            if (seek_pending)
+            {
+                // the index points at most INDEX_INTERVAL frames before the target, which are skipped
+                pcap_reader.seek(pcap_index.findOffset(seek_timestamp));
+                skip_until = seek_timestamp;
+                seek_pending = false;
+                has_replay_anchor = false;
+                has_datagram_index = false;
+                frame_timing.reset();
+            }
+            end_timestamp = replay_end_time < 0.0 ? 0 : pcap_index.getStartTime() + static_cast<uint64_t>(replay_end_time * 1000000);
+        }
+        // a truncated end of the recording is not read, see PcapIndex
+        bool has_frame = pcap_reader.getPosition() < pcap_index.getEndOffset() and pcap_reader.readFrame(frame, error_msg);
+        if (!error_msg.empty())
+        {
+            std::cerr << error_msg << std::endl;
+            error_msg.clear();
+        }
+        if (!has_frame or (end_timestamp > 0 and frame.timestamp_us > end_timestamp))
+        {
+            // at the end of the range, wait until the replay is seeked back or stopped
+            std::unique_lock<std::mutex> lock(replay_mutex);
+            replay_finished = true;
+            replay_condition.wait(lock, [this] { return replay_stopped or seek_pending; });
+            replay_finished = false;
+            continue;
+        }
+        // the capture filter of live captures
+        if (frame.timestamp_us < skip_until or frame.size < ETHERNET_HEADER_SIZE or frame.data[12] != 0x88 or frame.data[13] != 0xa4)
+        {
+            continue;
+        }
+        // decoded in place from the mapping of the file
+        processFrame(frame.data, frame.size, frame.timestamp_us);
     }
 }
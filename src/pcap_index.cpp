@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "pcap_index.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace
+{
+    // the fields are written in host byte order, since the cache is only read on the machine that wrote it
+    const char INDEX_MAGIC[8] = {'K', 'D', 'D', 'V', 'I', 'D', 'X', '2'};
+
+    struct IndexHeader
+    {
+        char magic[8];
+        uint64_t file_size;
+        int64_t modification_time;
+        uint64_t first_frame_offset;
+        uint64_t end_offset;
+        uint64_t start_time;
+        uint64_t end_time;
+        uint64_t frame_count;
+        uint64_t entry_count;
+    };
+}
+
+const int PcapIndex::INDEX_INTERVAL;
+
+PcapIndex::PcapIndex() : first_frame_offset(0), end_offset(0), start_time(0), end_time(0), frame_count(0)
+{
+}
+
+void PcapIndex::open(const std::string &filename, PcapReader &reader, std::string &error)
+{
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    std::string index_filename = filename + ".kddvidx";
+    if (load(index_filename, file_stat.st_size, file_stat.st_mtime))
+    {
+        return;
+    }
+    build(reader, error);
+    if (error.empty())
+    {
+        save(index_filename, file_stat.st_size, file_stat.st_mtime);
+    }
+}
+
+uint64_t PcapIndex::findOffset(uint64_t timestamp_us) const
+{
+    // entries are sorted, since their timestamps are the maximum up to the entry
+    Entry target = {timestamp_us, 0};
+    std::vector<Entry>::const_iterator it = std::upper_bound(entries.begin(), entries.end(), target,
+            [](const Entry &a, const Entry &b) { return a.timestamp_us < b.timestamp_us; });
+    if (it == entries.begin())
+    {
+        return entries.empty() ? first_frame_offset : entries.front().offset;
+    }
+    return (it - 1)->offset;
+}
+
+uint64_t PcapIndex::getStartTime() const
+{
+    return start_time;
+}
+
+uint64_t PcapIndex::getEndTime() const
+{
+    return end_time;
+}
+
+uint64_t PcapIndex::getFrameCount() const
+{
+    return frame_count;
+}
+
+uint64_t PcapIndex::getEndOffset() const
+{
+    return end_offset;
+}
+
+int PcapIndex::getEntryCount() const
+{
+    return entries.size();
+}
+
+uint64_t PcapIndex::getEntryOffset(int entry_idx) const
+{
+    return entries[entry_idx].offset;
+}
+
+uint64_t PcapIndex::getEntryTimestamp(int entry_idx) const
+{
+    return entries[entry_idx].timestamp_us;
+}
+
+void PcapIndex::build(PcapReader &reader, std::string &error)
+{
+    entries.clear();
+    first_frame_offset = reader.getFirstFrameOffset();
+    start_time = 0;
+    end_time = 0;
+    frame_count = 0;
+    end_offset = first_frame_offset;
+    reader.seek(first_frame_offset);
+    PcapFrame frame;
+    uint64_t max_timestamp = 0;
+    while (reader.readFrame(frame, error))
+    {
+        // recordings may contain slightly out of order timestamps
+        max_timestamp = std::max(max_timestamp, frame.timestamp_us);
+        if (frame_count % INDEX_INTERVAL == 0)
+        {
+            Entry entry = {max_timestamp, frame.offset};
+            entries.push_back(entry);
+        }
+        if (frame_count == 0)
+        {
+            start_time = frame.timestamp_us;
+        }
+        end_time = max_timestamp;
+        frame_count++;
+        end_offset = reader.getPosition();
+    }
+    if (!error.empty() and frame_count > 0)
+    {
+        std::cerr << "Warning: " << error << ", only the first " << frame_count << " frames are read" << std::endl;
+        error.clear();
+    }
+    reader.seek(first_frame_offset);
+}
+
+bool PcapIndex::load(const std::string &index_filename, uint64_t file_size, int64_t modification_time)
+{
+    FILE *infile = std::fopen(index_filename.c_str(), "rb");
+    if (infile == NULL)
+    {
+        return false;
+    }
+    IndexHeader header;
+    bool valid = std::fread(&header, sizeof(header), 1, infile) == 1 and
+                 std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 and
+                 header.file_size == file_size and header.modification_time == modification_time;
+    if (valid)
+    {
+        entries.resize(header.entry_count);
+        valid = header.entry_count == 0 or std::fread(&entries[0], sizeof(Entry), header.entry_count, infile) == header.entry_count;
+    }
+    std::fclose(infile);
+    if (!valid)
+    {
+        entries.clear();
+        return false;
+    }
+    first_frame_offset = header.first_frame_offset;
+    end_offset = header.end_offset;
+    start_time = header.start_time;
+    end_time = header.end_time;
+    frame_count = header.frame_count;
+    return true;
+}
+
+void PcapIndex::save(const std::string &index_filename, uint64_t file_size, int64_t modification_time) const
+{
+    // written to a temporary file which is then renamed, so a partial index is never read
+    std::string tmp_filename = index_filename + ".tmp";
+    FILE *outfile = std::fopen(tmp_filename.c_str(), "wb");
+    if (outfile == NULL)
+    {
+        return;
+    }
+    IndexHeader header;
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.file_size = file_size;
+    header.modification_time = modification_time;
+    header.first_frame_offset = first_frame_offset;
+    header.end_offset = end_offset;
+    header.start_time = start_time;
+    header.end_time = end_time;
+    header.frame_count = frame_count;
+    header.entry_count = entries.size();
+    bool written = std::fwrite(&header, sizeof(header), 1, outfile) == 1 and
+                   (entries.empty() or std::fwrite(&entries[0], sizeof(Entry), entries.size(), outfile) == entries.size());
+    written = std::fclose(outfile) == 0 and written;
+    if (!written or std::rename(tmp_filename.c_str(), index_filename.c_str()) != 0)
+    {
+        std::remove(tmp_filename.c_str());
+    }
+}
@@ -0,0 +1,439 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "pcap_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const uint32_t PCAP_MAGIC_MICROSECONDS = 0xa1b2c3d4;
+    const uint32_t PCAP_MAGIC_NANOSECONDS = 0xa1b23c4d;
+    const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+    const uint32_t LINKTYPE_ETHERNET = 1;
+
+    const uint32_t BLOCK_SECTION_HEADER = 0x0a0d0d0a;
+    const uint32_t BLOCK_INTERFACE_DESCRIPTION = 1;
+    const uint32_t BLOCK_PACKET = 2; // obsolete, but still written by some tools
+    const uint32_t BLOCK_SIMPLE_PACKET = 3;
+    const uint32_t BLOCK_ENHANCED_PACKET = 6;
+    const uint16_t OPTION_END = 0;
+    const uint16_t OPTION_IF_TSRESOL = 9;
+
+    // larger than any Ethernet frame; anything bigger means that the file is corrupt
+    const uint32_t MAX_FRAME_SIZE = 262144;
+
+    uint32_t swap32(uint32_t value)
+    {
+        return ((value & 0xff) << 24) | ((value & 0xff00) << 8) | ((value >> 8) & 0xff00) | (value >> 24);
+    }
+}
+
+PcapReader::PcapReader() : mapping(NULL), file_size(0), position(0), is_pcapng(false), swapped(false), units_per_second(1000000),
+                           first_frame_offset(0), last_timestamp_us(0)
+{
+}
+
+PcapReader::~PcapReader()
+{
+    close();
+}
+
+void PcapReader::open(const std::string &filename, std::string &error)
+{
+    close();
+    this->filename = filename;
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 and file_stat.st_size >= 4)
+    {
+        void *address = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            mapping = static_cast<const uint8_t*>(address);
+            file_size = file_stat.st_size;
+            madvise(address, file_size, MADV_SEQUENTIAL);
+        }
+        else
+        {
+            error = "Could not map file " + filename;
+        }
+    }
+    else
+    {
+        error = filename + " is not a PCAP file";
+    }
+    // the mapping keeps the file open
+    ::close(fd);
+    if (!error.empty())
+    {
+        return;
+    }
+
+    uint32_t magic;
+    std::memcpy(&magic, mapping, 4);
+    if (magic == BLOCK_SECTION_HEADER)
+    {
+        is_pcapng = true;
+        position = 0;
+        readSectionHeader(error);
+        // interfaces are described before the first frame
+        while (error.empty())
+        {
+            uint64_t offset = position;
+            const uint8_t *block = getData(offset, 8);
+            if (block == NULL)
+            {
+                first_frame_offset = offset;
+                break;
+            }
+            uint32_t type = toHost32(block);
+            uint32_t length = toHost32(block + 4);
+            if (type == BLOCK_PACKET or type == BLOCK_SIMPLE_PACKET or type == BLOCK_ENHANCED_PACKET)
+            {
+                first_frame_offset = offset;
+                break;
+            }
+            if (length < 12 or length % 4 != 0)
+            {
+                error = "Malformed block in " + filename;
+                break;
+            }
+            if (getData(offset, length) == NULL)
+            {
+                error = "Truncated block in " + filename;
+                break;
+            }
+            if (type == BLOCK_SECTION_HEADER)
+            {
+                readSectionHeader(error);
+                continue;
+            }
+            if (type == BLOCK_INTERFACE_DESCRIPTION)
+            {
+                readInterfaceDescription(block, length, error);
+            }
+            position = offset + length;
+        }
+    }
+    else
+    {
+        is_pcapng = false;
+        const uint8_t *header = getData(0, 24);
+        if (header == NULL)
+        {
+            error = filename + " is not a PCAP file";
+        }
+        else
+        {
+            readPcapHeader(header, error);
+        }
+        first_frame_offset = 24;
+    }
+    if (!error.empty())
+    {
+        close();
+        return;
+    }
+    seek(first_frame_offset);
+}
+
+void PcapReader::close()
+{
+    if (mapping != NULL)
+    {
+        munmap(const_cast<uint8_t*>(mapping), file_size);
+        mapping = NULL;
+    }
+    file_size = 0;
+    position = 0;
+    interface_units_per_second.clear();
+}
+
+bool PcapReader::readFrame(PcapFrame &frame, std::string &error)
+{
+    if (mapping == NULL)
+    {
+        return false;
+    }
+    return is_pcapng ? readPcapngFrame(frame, error) : readPcapFrame(frame, error);
+}
+
+void PcapReader::seek(uint64_t offset)
+{
+    position = offset;
+}
+
+uint64_t PcapReader::getFirstFrameOffset() const
+{
+    return first_frame_offset;
+}
+
+uint64_t PcapReader::getPosition() const
+{
+    return position;
+}
+
+const uint8_t* PcapReader::getData(uint64_t offset, uint64_t size) const
+{
+    if (offset > file_size or size > file_size - offset)
+    {
+        return NULL;
+    }
+    return mapping + offset;
+}
+
+uint16_t PcapReader::toHost16(const uint8_t *data) const
+{
+    uint16_t value;
+    std::memcpy(&value, data, 2);
+    return swapped ? static_cast<uint16_t>((value << 8) | (value >> 8)) : value;
+}
+
+uint32_t PcapReader::toHost32(const uint8_t *data) const
+{
+    uint32_t value;
+    std::memcpy(&value, data, 4);
+    return swapped ? swap32(value) : value;
+}
+
+uint64_t PcapReader::toMicroseconds(uint64_t timestamp, uint64_t units) const
+{
+    // split into seconds and fraction, since nanosecond timestamps would overflow when multiplied
+    uint64_t seconds = timestamp / units;
+    uint64_t fraction = timestamp % units;
+    // for resolutions finer than about 10^-13 seconds, the fraction would
+    // still overflow; units is a power of 10 or 2, so dividing both by the
+    // base only drops digits below a microsecond
+    while (units > std::numeric_limits<uint64_t>::max() / 1000000)
+    {
+        uint64_t base = units % 10 == 0 ? 10 : 2;
+        units /= base;
+        fraction /= base;
+    }
+    return seconds * 1000000 + fraction * 1000000 / units;
+}
+
+void PcapReader::readPcapHeader(const uint8_t *header, std::string &error)
+{
+    uint32_t magic;
+    std::memcpy(&magic, header, 4);
+    if (magic == PCAP_MAGIC_MICROSECONDS or magic == PCAP_MAGIC_NANOSECONDS)
+    {
+        swapped = false;
+    }
+    else if (swap32(magic) == PCAP_MAGIC_MICROSECONDS or swap32(magic) == PCAP_MAGIC_NANOSECONDS)
+    {
+        swapped = true;
+    }
+    else
+    {
+        error = filename + " is not a PCAP file";
+        return;
+    }
+    units_per_second = toHost32(header) == PCAP_MAGIC_NANOSECONDS ? 1000000000 : 1000000;
+    // the upper bits may contain the FCS length
+    if ((toHost32(header + 20) & 0xffff) != LINKTYPE_ETHERNET)
+    {
+        error = filename + " is not an Ethernet capture";
+    }
+}
+
+bool PcapReader::readPcapFrame(PcapFrame &frame, std::string &error)
+{
+    if (position >= file_size)
+    {
+        return false;
+    }
+    const uint8_t *header = getData(position, 16);
+    if (header == NULL or toHost32(header + 8) > MAX_FRAME_SIZE)
+    {
+        error = "Malformed record in " + filename;
+        return false;
+    }
+    uint32_t captured_size = toHost32(header + 8);
+    const uint8_t *data = getData(position + 16, captured_size);
+    if (data == NULL)
+    {
+        error = "Truncated record in " + filename;
+        return false;
+    }
+    uint64_t fraction = toHost32(header + 4);
+    frame.offset = position;
+    frame.timestamp_us = static_cast<uint64_t>(toHost32(header)) * 1000000 +
+                         (units_per_second == 1000000000 ? fraction / 1000 : fraction);
+    frame.data = data;
+    frame.size = captured_size;
+    position += 16 + captured_size;
+    return true;
+}
+
+bool PcapReader::readPcapngFrame(PcapFrame &frame, std::string &error)
+{
+    while (true)
+    {
+        uint64_t offset = position;
+        if (offset >= file_size)
+        {
+            return false;
+        }
+        const uint8_t *block = getData(offset, 8);
+        uint32_t length = block == NULL ? 0 : toHost32(block + 4);
+        if (block == NULL or length < 12 or length % 4 != 0)
+        {
+            error = "Malformed block in " + filename;
+            return false;
+        }
+        if (getData(offset, length) == NULL)
+        {
+            error = "Truncated block in " + filename;
+            return false;
+        }
+        uint32_t type = toHost32(block);
+        if (type == BLOCK_SECTION_HEADER)
+        {
+            readSectionHeader(error);
+            if (!error.empty())
+            {
+                return false;
+            }
+            continue;
+        }
+        position = offset + length;
+        if (type == BLOCK_INTERFACE_DESCRIPTION)
+        {
+            readInterfaceDescription(block, length, error);
+            if (!error.empty())
+            {
+                return false;
+            }
+            continue;
+        }
+        if (type != BLOCK_PACKET and type != BLOCK_SIMPLE_PACKET and type != BLOCK_ENHANCED_PACKET)
+        {
+            continue;
+        }
+
+        uint32_t header_length = type == BLOCK_SIMPLE_PACKET ? 12 : 28;
+        if (length < header_length + 4)
+        {
+            error = "Malformed block in " + filename;
+            return false;
+        }
+        uint32_t captured_size;
+        if (type == BLOCK_SIMPLE_PACKET)
+        {
+            // has no timestamp, so it gets the one of the previous frame
+            captured_size = std::min(toHost32(block + 8), length - 16);
+            frame.timestamp_us = last_timestamp_us;
+        }
+        else
+        {
+            uint32_t interface_id = type == BLOCK_PACKET ? toHost16(block + 8) : toHost32(block + 8);
+            uint64_t timestamp = (static_cast<uint64_t>(toHost32(block + 12)) << 32) | toHost32(block + 16);
+            uint64_t units = interface_id < interface_units_per_second.size() ? interface_units_per_second[interface_id] : 1000000;
+            frame.timestamp_us = toMicroseconds(timestamp, units);
+            captured_size = toHost32(block + 20);
+        }
+        if (captured_size > MAX_FRAME_SIZE or captured_size > length - header_length - 4)
+        {
+            error = "Malformed block in " + filename;
+            return false;
+        }
+        frame.offset = offset;
+        frame.data = block + header_length;
+        frame.size = captured_size;
+        last_timestamp_us = frame.timestamp_us;
+        return true;
+    }
+}
+
+void PcapReader::readSectionHeader(std::string &error)
+{
+    const uint8_t *header = getData(position, 12);
+    if (header == NULL)
+    {
+        error = "Truncated section header in " + filename;
+        return;
+    }
+    uint32_t byte_order_magic;
+    std::memcpy(&byte_order_magic, header + 8, 4);
+    if (byte_order_magic == PCAPNG_BYTE_ORDER_MAGIC)
+    {
+        swapped = false;
+    }
+    else if (swap32(byte_order_magic) == PCAPNG_BYTE_ORDER_MAGIC)
+    {
+        swapped = true;
+    }
+    else
+    {
+        error = filename + " is not a PCAPNG file";
+        return;
+    }
+    uint32_t length = toHost32(header + 4);
+    if (length < 28 or length % 4 != 0 or getData(position, length) == NULL)
+    {
+        error = "Malformed section header in " + filename;
+        return;
+    }
+    // interface ids are per section
+    interface_units_per_second.clear();
+    position += length;
+}
+
+void PcapReader::readInterfaceDescription(const uint8_t *block, uint32_t length, std::string &error)
+{
+    if (length < 20)
+    {
+        error = "Malformed interface description in " + filename;
+        return;
+    }
+    if (toHost16(block + 8) != LINKTYPE_ETHERNET)
+    {
+        error = filename + " is not an Ethernet capture";
+        return;
+    }
+    uint64_t units = 1000000;
+    size_t pos = 16;
+    while (pos + 4 <= length - 4)
+    {
+        uint16_t code = toHost16(block + pos);
+        uint16_t option_length = toHost16(block + pos + 2);
+        if (code == OPTION_END)
+        {
+            break;
+        }
+        if (code == OPTION_IF_TSRESOL and option_length >= 1 and pos + 4 < length)
+        {
+            // 10^-n or 2^-n seconds; finer resolutions do not fit into 64 bits
+            uint8_t resolution = block[pos + 4];
+            if ((resolution & 0x80) ? (resolution & 0x7f) > 63 : resolution > 19)
+            {
+                error = "Malformed interface description in " + filename;
+                return;
+            }
+            units = 1;
+            for (int i = 0; i < (resolution & 0x7f); i++)
+            {
+                units *= (resolution & 0x80) ? 2 : 10;
+            }
+        }
+        pos += 4 + ((option_length + 3) & ~3);
+    }
+    interface_units_per_second.push_back(units);
+}
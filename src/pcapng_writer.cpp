@@ -0,0 +1,371 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "pcapng_writer.h"
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+    const uint32_t SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+    const uint32_t INTERFACE_DESCRIPTION_BLOCK = 1;
+    const uint32_t ENHANCED_PACKET_BLOCK = 6;
+    const uint32_t BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+    const uint16_t LINKTYPE_ETHERNET = 1;
+    // blocks are compressed (or written) once this many bytes were collected
+    const size_t INPUT_CHUNK_SIZE = 128 * 1024;
+
+    void appendValue(std::vector<uint8_t> &buffer, const void *value, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t*>(value);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+}
+
+bool parseCompression(const std::string &name, Compression &compression)
+{
+    if (name == "none")
+    {
+        compression = COMPRESSION_NONE;
+    }
+    else if (name == "zstd")
+    {
+        compression = COMPRESSION_ZSTD;
+    }
+    else if (name == "lz4")
+    {
+        compression = COMPRESSION_LZ4;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool isCompressionSupported(Compression compression)
+{
+    switch (compression)
+    {
+        case COMPRESSION_NONE:
+            return true;
+        case COMPRESSION_ZSTD:
+#ifdef KDDV_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        case COMPRESSION_LZ4:
+#ifdef KDDV_HAVE_LZ4
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+std::string getCompressionExtension(Compression compression)
+{
+    switch (compression)
+    {
+        case COMPRESSION_NONE:
+            return "";
+        case COMPRESSION_ZSTD:
+            return ".zst";
+        case COMPRESSION_LZ4:
+            return ".lz4";
+    }
+    return "";
+}
+
+std::string getNumberedFilename(const std::string &filename, int number, uint64_t timestamp_us)
+{
+    size_t name_start = filename.rfind('/');
+    size_t extension_start = filename.find('.', name_start == std::string::npos ? 0 : name_start + 1);
+    if (extension_start == std::string::npos)
+    {
+        extension_start = filename.size();
+    }
+    time_t seconds = timestamp_us / 1000000;
+    struct tm local_time;
+    localtime_r(&seconds, &local_time);
+    char suffix[64];
+    size_t length = std::snprintf(suffix, sizeof(suffix), "_%05d_", number);
+    std::strftime(suffix + length, sizeof(suffix) - length, "%Y%m%d%H%M%S", &local_time);
+    return filename.substr(0, extension_start) + suffix + filename.substr(extension_start);
+}
+
+PcapngWriter::PcapngWriter()
+    : file(NULL), compression(COMPRESSION_NONE), file_size(0), input_frames(0), written_frames(0), lost_frames(0)
+{
+#ifdef KDDV_HAVE_ZSTD
+    zstd_context = NULL;
+#endif
+#ifdef KDDV_HAVE_LZ4
+    lz4_context = NULL;
+#endif
+}
+
+PcapngWriter::~PcapngWriter()
+{
+    std::string error;
+    close(error);
+}
+
+void PcapngWriter::open(const std::string &filename, Compression compression, std::string &error)
+{
+    std::string close_error;
+    close(close_error);
+    if (!isCompressionSupported(compression))
+    {
+        error = "kddv was built without support for " + getCompressionExtension(compression).substr(1) + " compression";
+        return;
+    }
+    file = std::fopen(filename.c_str(), "wb");
+    if (file == NULL)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    // chunks are written at once; without a buffer of the file, a failed write is noticed with its chunk
+    std::setvbuf(file, NULL, _IONBF, 0);
+    this->filename = filename;
+    this->compression = compression;
+    file_size = 0;
+    input.clear();
+    input_frames = 0;
+    written_frames = 0;
+    lost_frames = 0;
+    input.reserve(INPUT_CHUNK_SIZE + 64 * 1024);
+
+#ifdef KDDV_HAVE_ZSTD
+    if (compression == COMPRESSION_ZSTD)
+    {
+        zstd_context = ZSTD_createCCtx();
+        // the default level; fast enough for the capture rate on small computers
+        ZSTD_CCtx_setParameter(zstd_context, ZSTD_c_compressionLevel, 3);
+    }
+#endif
+#ifdef KDDV_HAVE_LZ4
+    if (compression == COMPRESSION_LZ4)
+    {
+        size_t result = LZ4F_createCompressionContext(&lz4_context, LZ4F_VERSION);
+        if (!LZ4F_isError(result))
+        {
+            output.resize(LZ4F_HEADER_SIZE_MAX);
+            result = LZ4F_compressBegin(lz4_context, &output[0], output.size(), NULL);
+        }
+        if (LZ4F_isError(result))
+        {
+            error = std::string("Could not start lz4 compression: ") + LZ4F_getErrorName(result);
+            // nothing was written, so the stream is not ended
+            this->compression = COMPRESSION_NONE;
+            close(close_error);
+            return;
+        }
+        writeOutput(&output[0], result, error);
+    }
+#endif
+
+    std::vector<uint8_t> section_header;
+    uint16_t major_version = 1;
+    uint16_t minor_version = 0;
+    int64_t section_length = -1;
+    appendValue(section_header, &BYTE_ORDER_MAGIC, sizeof(BYTE_ORDER_MAGIC));
+    appendValue(section_header, &major_version, sizeof(major_version));
+    appendValue(section_header, &minor_version, sizeof(minor_version));
+    appendValue(section_header, &section_length, sizeof(section_length));
+    writeBlock(SECTION_HEADER_BLOCK, &section_header[0], section_header.size(), NULL, 0, error);
+
+    // the default timestamp resolution of an interface is microseconds
+    std::vector<uint8_t> interface_description;
+    uint16_t reserved = 0;
+    uint32_t snap_length = 0;
+    appendValue(interface_description, &LINKTYPE_ETHERNET, sizeof(LINKTYPE_ETHERNET));
+    appendValue(interface_description, &reserved, sizeof(reserved));
+    appendValue(interface_description, &snap_length, sizeof(snap_length));
+    writeBlock(INTERFACE_DESCRIPTION_BLOCK, &interface_description[0], interface_description.size(), NULL, 0, error);
+    if (!error.empty())
+    {
+        close(close_error);
+    }
+}
+
+void PcapngWriter::writeFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us, std::string &error)
+{
+    uint32_t body[5];
+    body[0] = 0; // interface
+    body[1] = static_cast<uint32_t>(timestamp_us >> 32);
+    body[2] = static_cast<uint32_t>(timestamp_us);
+    body[3] = size; // captured length
+    body[4] = size; // original length
+    writeBlock(ENHANCED_PACKET_BLOCK, reinterpret_cast<const uint8_t*>(body), sizeof(body), frame, size, error);
+}
+
+void PcapngWriter::close(std::string &error)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    compressInput(true, error);
+    if (std::fclose(file) != 0 and error.empty())
+    {
+        error = "Could not write file " + filename;
+    }
+    file = NULL;
+#ifdef KDDV_HAVE_ZSTD
+    ZSTD_freeCCtx(zstd_context);
+    zstd_context = NULL;
+#endif
+#ifdef KDDV_HAVE_LZ4
+    LZ4F_freeCompressionContext(lz4_context);
+    lz4_context = NULL;
+#endif
+}
+
+bool PcapngWriter::isOpen() const
+{
+    return file != NULL;
+}
+
+uint64_t PcapngWriter::getFileSize() const
+{
+    return file_size;
+}
+
+uint64_t PcapngWriter::getWrittenFrames() const
+{
+    return written_frames;
+}
+
+uint64_t PcapngWriter::getLostFrames() const
+{
+    return lost_frames;
+}
+
+void PcapngWriter::writeBlock(uint32_t block_type, const uint8_t *body, uint32_t body_size, const uint8_t *data, uint32_t data_size, std::string &error)
+{
+    if (file == NULL)
+    {
+        error = "No file is open";
+        if (block_type == ENHANCED_PACKET_BLOCK)
+        {
+            lost_frames++;
+        }
+        return;
+    }
+    // block type, total length, body, data padded to 32 bits, total length
+    uint32_t padding = (4 - data_size % 4) % 4;
+    uint32_t total_length = 12 + body_size + data_size + padding;
+    const uint8_t zeros[4] = {0, 0, 0, 0};
+    appendValue(input, &block_type, sizeof(block_type));
+    appendValue(input, &total_length, sizeof(total_length));
+    appendValue(input, body, body_size);
+    if (data_size > 0)
+    {
+        appendValue(input, data, data_size);
+    }
+    appendValue(input, zeros, padding);
+    appendValue(input, &total_length, sizeof(total_length));
+    if (block_type == ENHANCED_PACKET_BLOCK)
+    {
+        input_frames++;
+    }
+    if (input.size() >= INPUT_CHUNK_SIZE)
+    {
+        compressInput(false, error);
+    }
+}
+
+void PcapngWriter::compressInput(bool end, std::string &error)
+{
+    // every chunk is flushed out of the compressor, so its frames are in the file once it was written
+    if (compression == COMPRESSION_NONE)
+    {
+        if (!input.empty())
+        {
+            writeOutput(&input[0], input.size(), error);
+        }
+    }
+#ifdef KDDV_HAVE_ZSTD
+    else if (compression == COMPRESSION_ZSTD)
+    {
+        ZSTD_inBuffer in = {input.data(), input.size(), 0};
+        output.resize(ZSTD_CStreamOutSize());
+        bool done = false;
+        while (!done and error.empty())
+        {
+            ZSTD_outBuffer out = {&output[0], output.size(), 0};
+            size_t remaining = ZSTD_compressStream2(zstd_context, &out, &in, end ? ZSTD_e_end : ZSTD_e_flush);
+            if (ZSTD_isError(remaining))
+            {
+                error = std::string("Could not compress: ") + ZSTD_getErrorName(remaining);
+                break;
+            }
+            writeOutput(&output[0], out.pos, error);
+            done = remaining == 0;
+        }
+    }
+#endif
+#ifdef KDDV_HAVE_LZ4
+    else if (compression == COMPRESSION_LZ4)
+    {
+        size_t result = 0;
+        if (!input.empty())
+        {
+            output.resize(LZ4F_compressBound(input.size(), NULL));
+            result = LZ4F_compressUpdate(lz4_context, &output[0], output.size(), &input[0], input.size(), NULL);
+            if (!LZ4F_isError(result))
+            {
+                writeOutput(&output[0], result, error);
+            }
+        }
+        if (!LZ4F_isError(result) and error.empty())
+        {
+            output.resize(LZ4F_compressBound(0, NULL));
+            if (end)
+            {
+                result = LZ4F_compressEnd(lz4_context, &output[0], output.size(), NULL);
+            }
+            else
+            {
+                result = LZ4F_flush(lz4_context, &output[0], output.size(), NULL);
+            }
+            if (!LZ4F_isError(result))
+            {
+                writeOutput(&output[0], result, error);
+            }
+        }
+        if (LZ4F_isError(result))
+        {
+            error = std::string("Could not compress: ") + LZ4F_getErrorName(result);
+        }
+    }
+#endif
+    if (error.empty())
+    {
+        written_frames += input_frames;
+    }
+    else
+    {
+        lost_frames += input_frames;
+    }
+    input_frames = 0;
+    input.clear();
+}
+
+void PcapngWriter::writeOutput(const uint8_t *data, size_t size, std::string &error)
+{
+    if (size > 0 and std::fwrite(data, 1, size, file) != size)
+    {
+        error = "Could not write file " + filename;
+        return;
+    }
+    file_size += size;
+}
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "process_image.h"
+#include "tracer.h"
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    // shared by all sources and runs, so a consumer's cache never matches the
+    // generation of a different run; 0 is never used
+    std::atomic<uint64_t> next_generation(1);
+}
+
+ProcessImage::ProcessImage(const std::shared_ptr<const ProcessImageLayout> &layout)
+    : sequence(0), timestamp(0.0), layout(layout), data(layout->size, 0), generations(layout->rx_offsets.size(), 0)
+{
+}
+
+int ProcessImage::getSlaveCount() const
+{
+    return generations.size();
+}
+
+const uint8_t *ProcessImage::getRxData(int slave_idx) const
+{
+    return data.data() + layout->rx_offsets[slave_idx];
+}
+
+const uint8_t *ProcessImage::getTxData(int slave_idx) const
+{
+    return data.data() + layout->tx_offsets[slave_idx];
+}
+
+uint64_t ProcessImage::getGeneration(int slave_idx) const
+{
+    return generations[slave_idx];
+}
+
+void ProcessImage::copySlaveData(int slave_idx, const uint8_t *outputs, const uint8_t *inputs, const ProcessImage *previous)
+{
+    size_t rx_offset = layout->rx_offsets[slave_idx];
+    size_t rx_size = layout->rx_sizes[slave_idx];
+    size_t tx_offset = layout->tx_offsets[slave_idx];
+    size_t tx_size = layout->tx_sizes[slave_idx];
+    std::memcpy(data.data() + rx_offset, outputs, rx_size);
+    std::memcpy(data.data() + tx_offset, inputs, tx_size);
+
+    // RX and TX bytes of a slave are adjacent, so compare both at once
+    if (previous == NULL or previous->layout != layout or
+        std::memcmp(data.data() + rx_offset, previous->data.data() + rx_offset, rx_size + tx_size) != 0)
+    {
+        generations[slave_idx] = next_generation.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    generations[slave_idx] = previous->generations[slave_idx];
+}
+
+ProcessImagePool::ProcessImagePool(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+{
+    layout = std::make_shared<ProcessImageLayout>();
+    size_t offset = 0;
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        layout->rx_offsets.push_back(offset);
+        layout->rx_sizes.push_back(slaves[i]->getRxSize());
+        offset += slaves[i]->getRxSize();
+        layout->tx_offsets.push_back(offset);
+        layout->tx_sizes.push_back(slaves[i]->getTxSize());
+        offset += slaves[i]->getTxSize();
+    }
+    layout->size = offset;
+}
+
+ProcessImagePool::~ProcessImagePool()
+{
+    for (int i = 0; i < free_images.size(); i++)
+    {
+        delete free_images[i];
+    }
+}
+
+std::shared_ptr<ProcessImage> ProcessImagePool::acquire()
+{
+    ProcessImage *image = NULL;
+    {
+        std::lock_guard<std::mutex> guard(free_images_mutex);
+        if (!free_images.empty())
+        {
+            image = free_images.back();
+            free_images.pop_back();
+        }
+    }
+    if (image == NULL)
+    {
+        image = new ProcessImage(layout);
+    }
+    // images still referenced by a consumer when the pool is destroyed are simply deleted
+    std::weak_ptr<ProcessImagePool> weak_pool = shared_from_this();
+    return std::shared_ptr<ProcessImage>(image, [weak_pool](ProcessImage *img)
+    {
+        std::shared_ptr<ProcessImagePool> pool = weak_pool.lock();
+        if (pool)
+        {
+            pool->release(img);
+        }
+        else
+        {
+            delete img;
+        }
+    });
+}
+
+void ProcessImagePool::release(ProcessImage *image)
+{
+    std::lock_guard<std::mutex> guard(free_images_mutex);
+    free_images.push_back(image);
+}
+
+void ValueCache::setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+{
+    this->slaves = slaves;
+    Entry empty_entry;
+    empty_entry.generation = std::numeric_limits<uint64_t>::max();
+    rx_entries.clear();
+    tx_entries.clear();
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        rx_entries.push_back(std::vector<Entry>(slaves[i]->getRxVariables().size(), empty_entry));
+        tx_entries.push_back(std::vector<Entry>(slaves[i]->getTxVariables().size(), empty_entry));
+    }
+}
+
+const std::string& ValueCache::getRxValue(const ProcessImage &image, int slave_idx, int field_idx)
+{
+    Entry &entry = rx_entries[slave_idx][field_idx];
+    if (entry.generation != image.getGeneration(slave_idx))
+    {
+        entry.value = slaves[slave_idx]->formatRxValue(image.getRxData(slave_idx), field_idx);
+        entry.generation = image.getGeneration(slave_idx);
+    }
+    return entry.value;
+}
+
+const std::string& ValueCache::getTxValue(const ProcessImage &image, int slave_idx, int field_idx)
+{
+    Entry &entry = tx_entries[slave_idx][field_idx];
+    if (entry.generation != image.getGeneration(slave_idx))
+    {
+        entry.value = slaves[slave_idx]->formatTxValue(image.getTxData(slave_idx), field_idx);
+        entry.generation = image.getGeneration(slave_idx);
+    }
+    return entry.value;
+}
+
+JsonEncoder::JsonEncoder()
+{
+    json_stream_builder["indentation"] = "";
+}
+
+void JsonEncoder::setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+{
+    this->slaves = slaves;
+    slave_json.assign(slaves.size(), Json::Value());
+    slave_json_generations.assign(slaves.size(), std::numeric_limits<uint64_t>::max());
+}
+
+std::string JsonEncoder::encode(const ProcessImage &image, double timestamp)
+{
+    TraceScope trace("serialize", "JsonEncoder::encode");
+    Json::Value root;
+    root["timestamp"] = timestamp;
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        if (slave_json_generations[i] != image.getGeneration(i))
+        {
+            slave_json[i] = Json::Value();
+            slaves[i]->convertToJson(image.getRxData(i), image.getTxData(i), slave_json[i]);
+            slave_json_generations[i] = image.getGeneration(i);
+        }
+        root[slaves[i]->slave_info.name + " " + std::to_string(slaves[i]->slave_info.slave_number)] = slave_json[i];
+    }
+    return Json::writeString(json_stream_builder, root);
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "columnar_recording.h"
+#include "recording_query.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+void print_usage(const std::string &exec_name)
+{
+    std::cerr << std::endl << "---------------------------------------" << std::endl;
+    std::cerr << "Usage: " << std::endl;
+    std::cerr << exec_name
+              << std::endl
+              << "\t--recording RECORDING_FILE"
+              << std::endl
+              << "\t--where CONDITIONS"
+              << std::endl
+              << "\t[--list_fields]"
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "RECORDING_FILE: columnar recording (--record_format columnar of kddv-headless)" << std::endl;
+    std::cerr << "CONDITIONS: conditions joined by \" and \", each one of" << std::endl;
+    std::cerr << "\tSLAVE.FIELD OP NUMBER, where OP is one of > >= < <= == !=, e.g. 5.voltage_bus < 20" << std::endl;
+    std::cerr << "\tSLAVE.FIELD & MASK, e.g. 5.status1 & 0x600" << std::endl;
+    std::cerr << "\tSLAVE.FIELD.BIT, e.g. 5.status1.OVERTEMP_1" << std::endl;
+    std::cerr << "\tthe last two can be negated with !, e.g. !5.status1.ENABLED1" << std::endl;
+    std::cerr << "--list_fields: print the fields of the recording and exit" << std::endl;
+    std::cerr << "---------------------------------------" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::string recording_file;
+    std::string expression;
+    bool list_fields = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--list_fields") == 0)
+        {
+            list_fields = true;
+            continue;
+        }
+        if (argc <= i+1)
+        {
+            std::cerr << "Specified argument " << argv[i] << " but did not provide a value " << std::endl;
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        if (strcmp(argv[i], "--recording") == 0)
+        {
+            recording_file = std::string(argv[i+1]);
+        }
+        else if (strcmp(argv[i], "--where") == 0)
+        {
+            expression = std::string(argv[i+1]);
+        }
+        else
+        {
+            print_usage(std::string(argv[0]));
+            return 1;
+        }
+        i += 1;
+    }
+    if (recording_file.empty() or (expression.empty() and !list_fields))
+    {
+        std::cerr << "A recording and conditions are required" << std::endl;
+        print_usage(std::string(argv[0]));
+        return 1;
+    }
+
+    std::string error_msg;
+    ColumnarReader reader;
+    reader.open(recording_file, error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    if (list_fields)
+    {
+        for (int i = 0; i < reader.getColumnCount(); i++)
+        {
+            std::cout << reader.getColumn(i).name << std::endl;
+        }
+        return 0;
+    }
+
+    RecordingQuery query(reader);
+    query.parse(expression, error_msg);
+    if (!error_msg.empty())
+    {
+        std::cerr << error_msg << std::endl;
+        return 1;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<TimeInterval> intervals;
+    QueryStats stats;
+    query.run(intervals, stats);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "start,end,duration,rows" << std::endl;
+    for (int i = 0; i < intervals.size(); i++)
+    {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%.6f,%.6f,%.6f,%llu",
+                      intervals[i].start_us / 1e6, intervals[i].end_us / 1e6,
+                      (intervals[i].end_us - intervals[i].start_us) / 1e6,
+                      static_cast<unsigned long long>(intervals[i].rows));
+        std::cout << line << std::endl;
+    }
+    std::cerr << intervals.size() << " intervals, " << stats.rows_matched << " rows; "
+              << stats.blocks << " blocks: " << stats.blocks_skipped << " skipped, "
+              << stats.blocks_matched << " matched entirely, " << stats.blocks_scanned << " scanned; "
+              << elapsed * 1000 << " ms" << std::endl;
+    return 0;
+}
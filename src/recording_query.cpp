@@ -0,0 +1,484 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "recording_query.h"
+#include "ethercat_data_source.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    std::string trim(const std::string &text)
+    {
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string::npos)
+        {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t");
+        return text.substr(start, end - start + 1);
+    }
+
+    bool parseDouble(const std::string &text, double &value)
+    {
+        char *end;
+        value = std::strtod(text.c_str(), &end);
+        return !text.empty() and *end == '\0' and !std::isnan(value);
+    }
+
+    bool parseMask(const std::string &text, uint64_t &value)
+    {
+        char *end;
+        value = std::strtoull(text.c_str(), &end, 0);
+        return !text.empty() and text[0] != '-' and *end == '\0';
+    }
+
+    // the loops have no branches, so that the compiler can vectorize them
+
+    template <typename T, typename B>
+    void scanRange(const uint8_t *data, uint32_t count, B lo, B hi, uint8_t negate, uint8_t *match)
+    {
+        const T *values = reinterpret_cast<const T*>(data);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            match[i] &= ((values[i] >= lo) & (values[i] <= hi)) ^ negate;
+        }
+    }
+
+    template <typename T>
+    void scanBits(const uint8_t *data, uint32_t count, T mask, uint8_t negate, uint8_t *match)
+    {
+        const T *values = reinterpret_cast<const T*>(data);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            match[i] &= ((values[i] & mask) != 0) ^ negate;
+        }
+    }
+}
+
+RecordingQuery::RecordingQuery(const ColumnarReader &reader) : reader(reader)
+{
+}
+
+void RecordingQuery::parse(const std::string &expression, std::string &error)
+{
+    predicates.clear();
+    size_t start = 0;
+    while (start <= expression.size())
+    {
+        size_t end = expression.find(" and ", start);
+        if (end == std::string::npos)
+        {
+            end = expression.size();
+        }
+        std::string condition = trim(expression.substr(start, end - start));
+        if (condition.empty())
+        {
+            error = "Empty condition in query '" + expression + "'";
+            predicates.clear();
+            return;
+        }
+        QueryPredicate predicate;
+        if (!parseCondition(condition, predicate, error))
+        {
+            predicates.clear();
+            return;
+        }
+        predicates.push_back(predicate);
+        start = end + 5;
+    }
+}
+
+void RecordingQuery::run(std::vector<TimeInterval> &intervals, QueryStats &stats) const
+{
+    TraceScope trace("query", "RecordingQuery::run");
+    intervals.clear();
+    std::memset(&stats, 0, sizeof(stats));
+    stats.blocks = reader.getBlockCount();
+    std::vector<uint8_t> match;
+    std::vector<int> scan_predicates;
+    bool in_interval = false;
+    TimeInterval interval;
+    for (int b = 0; b < stats.blocks; b++)
+    {
+        uint32_t row_count = reader.getRowCount(b);
+        BlockMatch block_match = MATCH_ALL;
+        scan_predicates.clear();
+        for (int i = 0; i < predicates.size() and block_match != MATCH_NONE; i++)
+        {
+            BlockMatch predicate_match = checkBlock(b, predicates[i]);
+            if (predicate_match == MATCH_NONE)
+            {
+                block_match = MATCH_NONE;
+            }
+            else if (predicate_match == MATCH_SOME)
+            {
+                block_match = MATCH_SOME;
+                scan_predicates.push_back(i);
+            }
+        }
+
+        if (block_match == MATCH_NONE)
+        {
+            stats.blocks_skipped++;
+            if (in_interval)
+            {
+                intervals.push_back(interval);
+                in_interval = false;
+            }
+            continue;
+        }
+        if (block_match == MATCH_ALL)
+        {
+            // neither the timestamps nor the values of the block are read
+            stats.blocks_matched++;
+            stats.rows_matched += row_count;
+            if (!in_interval)
+            {
+                interval.start_us = reader.getStartTime(b);
+                interval.rows = 0;
+                in_interval = true;
+            }
+            interval.end_us = reader.getEndTime(b);
+            interval.rows += row_count;
+            continue;
+        }
+
+        stats.blocks_scanned++;
+        match.assign(row_count, 1);
+        for (int i = 0; i < scan_predicates.size(); i++)
+        {
+            scanBlock(b, predicates[scan_predicates[i]], &match[0]);
+        }
+        const int64_t *timestamps = reader.getTimestamps(b);
+        for (uint32_t row = 0; row < row_count; row++)
+        {
+            if (match[row])
+            {
+                if (!in_interval)
+                {
+                    interval.start_us = timestamps[row];
+                    interval.rows = 0;
+                    in_interval = true;
+                }
+                interval.end_us = timestamps[row];
+                interval.rows++;
+                stats.rows_matched++;
+            }
+            else if (in_interval)
+            {
+                intervals.push_back(interval);
+                in_interval = false;
+            }
+        }
+    }
+    if (in_interval)
+    {
+        intervals.push_back(interval);
+    }
+}
+
+bool RecordingQuery::parseCondition(const std::string &condition, QueryPredicate &predicate, std::string &error) const
+{
+    predicate.negate = false;
+    predicate.lo = 0;
+    predicate.hi = 0;
+    predicate.lo_float = 0.0;
+    predicate.hi_float = 0.0;
+    predicate.mask = 0;
+
+    std::string text = condition;
+    bool negated = text[0] == '!';
+    if (negated)
+    {
+        text = trim(text.substr(1));
+    }
+    size_t op_pos = text.find_first_of("<>=!&");
+    std::string column_name = trim(text.substr(0, op_pos));
+    if (op_pos == std::string::npos)
+    {
+        // COLUMN or COLUMN.BIT
+        predicate.kind = QueryPredicate::BITS;
+        predicate.negate = negated;
+        predicate.column_idx = reader.findColumn(column_name);
+        if (predicate.column_idx >= 0)
+        {
+            predicate.mask = std::numeric_limits<uint64_t>::max();
+            if (reader.getColumn(predicate.column_idx).type == FIELD_FLOAT)
+            {
+                error = column_name + " is not an integer field";
+                return false;
+            }
+            return true;
+        }
+        size_t bit_pos = column_name.rfind('.');
+        if (bit_pos != std::string::npos)
+        {
+            predicate.column_idx = reader.findColumn(column_name.substr(0, bit_pos));
+        }
+        if (predicate.column_idx < 0)
+        {
+            error = "Unknown field " + column_name;
+            return false;
+        }
+        if (!findBitMask(predicate.column_idx, column_name.substr(bit_pos + 1), predicate.mask))
+        {
+            error = column_name.substr(bit_pos + 1) + " is not a bit of " + column_name.substr(0, bit_pos);
+            return false;
+        }
+        return true;
+    }
+
+    predicate.column_idx = reader.findColumn(column_name);
+    if (predicate.column_idx < 0)
+    {
+        error = "Unknown field " + column_name;
+        return false;
+    }
+    std::string op = text.substr(op_pos, 1);
+    if (op_pos + 1 < text.size() and text[op_pos + 1] == '=')
+    {
+        op += "=";
+    }
+    std::string operand = trim(text.substr(op_pos + op.size()));
+    bool is_float = reader.getColumn(predicate.column_idx).type == FIELD_FLOAT;
+    if (op == "&")
+    {
+        predicate.kind = QueryPredicate::BITS;
+        predicate.negate = negated;
+        if (is_float)
+        {
+            error = column_name + " is not an integer field";
+            return false;
+        }
+        if (!parseMask(operand, predicate.mask))
+        {
+            error = "Invalid mask '" + operand + "' in condition '" + condition + "'";
+            return false;
+        }
+        return true;
+    }
+    if (negated)
+    {
+        error = "Only bit conditions can be negated with !, in condition '" + condition + "'";
+        return false;
+    }
+    if (op != ">" and op != ">=" and op != "<" and op != "<=" and op != "==" and op != "!=")
+    {
+        error = "Invalid operator '" + op + "' in condition '" + condition + "'";
+        return false;
+    }
+    double threshold;
+    if (!parseDouble(operand, threshold))
+    {
+        error = "Invalid number '" + operand + "' in condition '" + condition + "'";
+        return false;
+    }
+    setRange(op, threshold, predicate);
+    return true;
+}
+
+void RecordingQuery::setRange(const std::string &op, double threshold, QueryPredicate &predicate) const
+{
+    const double infinity = std::numeric_limits<double>::infinity();
+    predicate.kind = QueryPredicate::RANGE;
+    predicate.negate = op == "!=";
+    FieldType type = reader.getColumn(predicate.column_idx).type;
+    if (type == FIELD_FLOAT)
+    {
+        // float values are compared as doubles, so the bounds are exact
+        predicate.lo_float = -infinity;
+        predicate.hi_float = infinity;
+        if (op == ">")
+        {
+            predicate.lo_float = std::nextafter(threshold, infinity);
+        }
+        else if (op == ">=")
+        {
+            predicate.lo_float = threshold;
+        }
+        else if (op == "<")
+        {
+            predicate.hi_float = std::nextafter(threshold, -infinity);
+        }
+        else if (op == "<=")
+        {
+            predicate.hi_float = threshold;
+        }
+        else
+        {
+            predicate.lo_float = threshold;
+            predicate.hi_float = threshold;
+        }
+        return;
+    }
+
+    uint64_t max_value = std::numeric_limits<uint64_t>::max();
+    if (type == FIELD_UINT16)
+    {
+        max_value = std::numeric_limits<uint16_t>::max();
+    }
+    else if (type == FIELD_UINT32)
+    {
+        max_value = std::numeric_limits<uint32_t>::max();
+    }
+    double lo = 0.0;
+    double hi = static_cast<double>(max_value);
+    if (op == ">")
+    {
+        lo = std::floor(threshold) + 1.0;
+    }
+    else if (op == ">=")
+    {
+        lo = std::ceil(threshold);
+    }
+    else if (op == "<")
+    {
+        hi = std::ceil(threshold) - 1.0;
+    }
+    else if (op == "<=")
+    {
+        hi = std::floor(threshold);
+    }
+    else if (threshold == std::floor(threshold))
+    {
+        lo = threshold;
+        hi = threshold;
+    }
+    else
+    {
+        // an integer is never equal to a fraction
+        lo = 1.0;
+        hi = 0.0;
+    }
+    lo = std::max(lo, 0.0);
+    hi = std::min(hi, static_cast<double>(max_value));
+    if (lo > hi)
+    {
+        predicate.kind = QueryPredicate::NEVER;
+        return;
+    }
+    // the largest uint64 is not representable as a double
+    predicate.lo = lo >= static_cast<double>(max_value) ? max_value : static_cast<uint64_t>(lo);
+    predicate.hi = hi >= static_cast<double>(max_value) ? max_value : static_cast<uint64_t>(hi);
+}
+
+bool RecordingQuery::findBitMask(int column_idx, const std::string &bit_name, uint64_t &mask) const
+{
+    const ColumnInfo &column = reader.getColumn(column_idx);
+    const Json::Value &schema = reader.getSchema();
+    std::shared_ptr<EthercatSlave> slave = createSlave(schema["slaves"][column.slave_idx]["slave_type"].asUInt());
+    std::string field = schema["columns"][column_idx]["field"].asString();
+    uint16_t bit;
+    if (!slave or column.type == FIELD_FLOAT or !slave->findBit(field, bit_name, bit))
+    {
+        return false;
+    }
+    mask = bit;
+    return true;
+}
+
+RecordingQuery::BlockMatch RecordingQuery::checkBlock(int block_idx, const QueryPredicate &predicate) const
+{
+    BlockMatch match = MATCH_SOME;
+    if (predicate.kind == QueryPredicate::NEVER)
+    {
+        match = MATCH_NONE;
+    }
+    else if (predicate.kind == QueryPredicate::BITS)
+    {
+        // a bit of the mask which is set in every row is sufficient for all rows to match
+        const ColumnStats &stats = reader.getStats(block_idx, predicate.column_idx);
+        if ((stats.bits_or & predicate.mask) == 0)
+        {
+            match = MATCH_NONE;
+        }
+        else if ((stats.bits_and & predicate.mask) != 0)
+        {
+            match = MATCH_ALL;
+        }
+    }
+    else if (reader.getColumn(predicate.column_idx).type == FIELD_FLOAT)
+    {
+        const ColumnStats &stats = reader.getStats(block_idx, predicate.column_idx);
+        double min;
+        double max;
+        std::memcpy(&min, &stats.min, sizeof(double));
+        std::memcpy(&max, &stats.max, sizeof(double));
+        // NaN is never within the range
+        if (stats.nan_count == reader.getRowCount(block_idx) or max < predicate.lo_float or min > predicate.hi_float)
+        {
+            match = MATCH_NONE;
+        }
+        else if (stats.nan_count == 0 and min >= predicate.lo_float and max <= predicate.hi_float)
+        {
+            match = MATCH_ALL;
+        }
+    }
+    else
+    {
+        const ColumnStats &stats = reader.getStats(block_idx, predicate.column_idx);
+        if (stats.max < predicate.lo or stats.min > predicate.hi)
+        {
+            match = MATCH_NONE;
+        }
+        else if (stats.min >= predicate.lo and stats.max <= predicate.hi)
+        {
+            match = MATCH_ALL;
+        }
+    }
+    if (predicate.negate and match != MATCH_SOME)
+    {
+        match = match == MATCH_NONE ? MATCH_ALL : MATCH_NONE;
+    }
+    return match;
+}
+
+void RecordingQuery::scanBlock(int block_idx, const QueryPredicate &predicate, uint8_t *match) const
+{
+    const uint8_t *data = reader.getColumnData(block_idx, predicate.column_idx);
+    uint32_t count = reader.getRowCount(block_idx);
+    uint8_t negate = predicate.negate ? 1 : 0;
+    FieldType type = reader.getColumn(predicate.column_idx).type;
+    if (predicate.kind == QueryPredicate::BITS)
+    {
+        switch (type)
+        {
+            case FIELD_UINT16:
+                scanBits<uint16_t>(data, count, predicate.mask, negate, match);
+                break;
+            case FIELD_UINT32:
+                scanBits<uint32_t>(data, count, predicate.mask, negate, match);
+                break;
+            case FIELD_UINT64:
+                scanBits<uint64_t>(data, count, predicate.mask, negate, match);
+                break;
+            case FIELD_FLOAT:
+                break;
+        }
+        return;
+    }
+    switch (type)
+    {
+        case FIELD_UINT16:
+            scanRange<uint16_t, uint16_t>(data, count, predicate.lo, predicate.hi, negate, match);
+            break;
+        case FIELD_UINT32:
+            scanRange<uint32_t, uint32_t>(data, count, predicate.lo, predicate.hi, negate, match);
+            break;
+        case FIELD_UINT64:
+            scanRange<uint64_t, uint64_t>(data, count, predicate.lo, predicate.hi, negate, match);
+            break;
+        case FIELD_FLOAT:
+            scanRange<float, double>(data, count, predicate.lo_float, predicate.hi_float, negate, match);
+            break;
+    }
+}
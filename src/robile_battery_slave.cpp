@@ -6,7 +6,7 @@
  */
 
 #include "robile_battery_slave.h"
-#include <cstring>
+#include <cstddef>
 
 const std::vector<std::string> RobileBatterySlave::tx_variables =
 {
@@ -71,106 +71,82 @@ const std::vector<std::string> RobileBatterySlave::rx_units =
     ""
 };
 
-const std::vector<std::string>& RobileBatterySlave::getRxVariables()
+// key TX variables shown in the overview of all slaves
+const std::vector<std::string> RobileBatterySlave::overview_variables =
+{
+    "status",
+    "error",
+    "output_voltage",
+    "output_current",
+    "bmsm_soc",
+    "bmsm_temperature"
+};
+
+const std::vector<FieldLayout> RobileBatterySlave::rx_layout =
+{
+    {FIELD_UINT32, offsetof(RobileMasterBatteryProcessDataOutput, Command1)},
+    {FIELD_UINT32, offsetof(RobileMasterBatteryProcessDataOutput, Command2)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataOutput, Shutdown)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataOutput, PwrDeviceId)}
+};
+
+const std::vector<FieldLayout> RobileBatterySlave::tx_layout =
+{
+    {FIELD_UINT64, offsetof(RobileMasterBatteryProcessDataInput, TimeStamp)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, Status)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, Error)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, Warning)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, OutputCurrent)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, OutputVoltage)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, OutputPower)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, AuxPortCurrent)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, GenericData1)},
+    {FIELD_UINT32, offsetof(RobileMasterBatteryProcessDataInput, GenericData2)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, bmsm_PwrDeviceId)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, bmsm_Status)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, bmsm_Voltage)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, bmsm_Current)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, bmsm_Temperature)},
+    {FIELD_UINT16, offsetof(RobileMasterBatteryProcessDataInput, bmsm_SOC)},
+    {FIELD_UINT32, offsetof(RobileMasterBatteryProcessDataInput, bmsm_SN)},
+    {FIELD_UINT32, offsetof(RobileMasterBatteryProcessDataInput, bmsm_BatData1)},
+    {FIELD_FLOAT, offsetof(RobileMasterBatteryProcessDataInput, bmsm_BatData2)}
+};
+
+const std::vector<std::string>& RobileBatterySlave::getRxVariables() const
 {
     return rx_variables;
 }
 
-const std::vector<std::string>& RobileBatterySlave::getTxVariables()
+const std::vector<std::string>& RobileBatterySlave::getTxVariables() const
 {
     return tx_variables;
 }
 
-const std::vector<std::string>& RobileBatterySlave::getRxUnits()
+const std::vector<std::string>& RobileBatterySlave::getRxUnits() const
 {
     return rx_units;
 }
 
-const std::vector<std::string>& RobileBatterySlave::getTxUnits()
+const std::vector<std::string>& RobileBatterySlave::getTxUnits() const
 {
     return tx_units;
 }
 
-RobileBatterySlave::RobileBatterySlave()
-{
-}
-
-RobileBatterySlave::~RobileBatterySlave()
+const std::vector<std::string>& RobileBatterySlave::getOverviewVariables() const
 {
+    return overview_variables;
 }
 
-void RobileBatterySlave::copyData(uint8_t *outputs, uint8_t *inputs)
+RobileBatterySlave::RobileBatterySlave() : EthercatSlave(rx_layout, tx_layout, sizeof(RobileMasterBatteryProcessDataOutput), sizeof(RobileMasterBatteryProcessDataInput))
 {
-    std::memcpy(&rx, outputs, sizeof(RobileMasterBatteryProcessDataOutput));
-    std::memcpy(&tx, inputs, sizeof(RobileMasterBatteryProcessDataInput));
 }
 
-void RobileBatterySlave::convertToJson(Json::Value &data) const
-{
-    data["commands"]["command1"] = rx.Command1;
-    data["commands"]["command2"] = rx.Command2;
-    data["commands"]["shutdown"] = rx.Shutdown;
-    data["commands"]["pwr_device_id"] = rx.PwrDeviceId;
-
-    data["sensors"]["timestamp"] = Json::Value::UInt64(tx.TimeStamp);
-    data["sensors"]["status"] = tx.Status;
-    data["sensors"]["error"] = tx.Error;
-    data["sensors"]["warning"] = tx.Warning;
-    data["sensors"]["output_current"] = tx.OutputCurrent;
-    data["sensors"]["output_voltage"] = tx.OutputVoltage;
-    data["sensors"]["output_power"] = tx.OutputPower;
-    data["sensors"]["aux_port_current"] = tx.AuxPortCurrent;
-    data["sensors"]["generic_data1"] = tx.GenericData1;
-    data["sensors"]["generic_data2"] = tx.GenericData2;
-    data["sensors"]["bmsm_pwr_device_id"] = tx.bmsm_PwrDeviceId;
-    data["sensors"]["bmsm_status"] = tx.bmsm_Status;
-    data["sensors"]["bmsm_voltage"] = tx.bmsm_Voltage;
-    data["sensors"]["bmsm_current"] = tx.bmsm_Current;
-    data["sensors"]["bmsm_temperature"] = tx.bmsm_Temperature;
-    data["sensors"]["bmsm_soc"] = tx.bmsm_SOC;
-    data["sensors"]["bmsm_sn"] = tx.bmsm_SN;
-    data["sensors"]["bmsm_bat_data1"] = tx.bmsm_BatData1;
-    data["sensors"]["bmsm_bat_data2"] = tx.bmsm_BatData2;
-}
-
-std::vector<std::string> RobileBatterySlave::getRxValues()
+RobileBatterySlave::~RobileBatterySlave()
 {
-    std::vector<std::string> data_values;
-    data_values.reserve(RobileBatterySlave::rx_variables.size());
-    data_values.push_back(std::to_string(rx.Command1));
-    data_values.push_back(std::to_string(rx.Command2));
-    data_values.push_back(std::to_string(rx.Shutdown));
-    data_values.push_back(std::to_string(rx.PwrDeviceId));
-    return data_values;
 }
 
 
-std::vector<std::string> RobileBatterySlave::getTxValues()
-{
-    std::vector<std::string> data_values;
-    data_values.reserve(RobileBatterySlave::tx_variables.size());
-    data_values.push_back(std::to_string(tx.TimeStamp));
-    data_values.push_back(std::to_string(tx.Status));
-    data_values.push_back(std::to_string(tx.Error));
-    data_values.push_back(std::to_string(tx.Warning));
-    data_values.push_back(std::to_string(tx.OutputCurrent));
-    data_values.push_back(std::to_string(tx.OutputVoltage));
-    data_values.push_back(std::to_string(tx.OutputPower));
-    data_values.push_back(std::to_string(tx.AuxPortCurrent));
-    data_values.push_back(std::to_string(tx.GenericData1));
-    data_values.push_back(std::to_string(tx.GenericData2));
-    data_values.push_back(std::to_string(tx.bmsm_PwrDeviceId));
-    data_values.push_back(std::to_string(tx.bmsm_Status));
-    data_values.push_back(std::to_string(tx.bmsm_Voltage));
-    data_values.push_back(std::to_string(tx.bmsm_Current));
-    data_values.push_back(std::to_string(tx.bmsm_Temperature));
-    data_values.push_back(std::to_string(tx.bmsm_SOC));
-    data_values.push_back(std::to_string(tx.bmsm_SN));
-    data_values.push_back(std::to_string(tx.bmsm_BatData1));
-    data_values.push_back(std::to_string(tx.bmsm_BatData2));
-    return data_values;
-}
-
 void RobileBatterySlave::parseBits(uint16_t data, const std::string &var_name, std::vector<std::string> &vars, std::vector<std::string> &vals)
 {
     vars.clear();
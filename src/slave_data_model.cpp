@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "slave_data_model.h"
+#include <cstring>
+
+SlaveDataModel::SlaveDataModel(QObject *parent) : QAbstractTableModel(parent), show_units(false)
+{
+}
+
+void SlaveDataModel::setSlaves(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+{
+    beginResetModel();
+    this->slaves = slaves;
+    value_cache.setSlaves(slaves);
+    image.reset();
+    rows.clear();
+    field_indices.clear();
+    slave_names.clear();
+
+    // RX rows first, then TX rows, each in the order the variables first appear
+    std::map<std::string, int> rx_rows;
+    std::map<std::string, int> tx_rows;
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        const std::vector<std::string> &rx_vars = slaves[i]->getRxVariables();
+        for (int j = 0; j < rx_vars.size(); j++)
+        {
+            if (rx_rows.find(rx_vars[j]) == rx_rows.end())
+            {
+                rx_rows[rx_vars[j]] = rows.size();
+                Row row = {true, rx_vars[j]};
+                rows.push_back(row);
+            }
+        }
+    }
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        const std::vector<std::string> &tx_vars = slaves[i]->getTxVariables();
+        for (int j = 0; j < tx_vars.size(); j++)
+        {
+            if (tx_rows.find(tx_vars[j]) == tx_rows.end())
+            {
+                tx_rows[tx_vars[j]] = rows.size();
+                Row row = {false, tx_vars[j]};
+                rows.push_back(row);
+            }
+        }
+    }
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        std::vector<int> indices(rows.size(), -1);
+        const std::vector<std::string> &rx_vars = slaves[i]->getRxVariables();
+        for (int j = 0; j < rx_vars.size(); j++)
+        {
+            indices[rx_rows[rx_vars[j]]] = j;
+        }
+        const std::vector<std::string> &tx_vars = slaves[i]->getTxVariables();
+        for (int j = 0; j < tx_vars.size(); j++)
+        {
+            indices[tx_rows[tx_vars[j]]] = j;
+        }
+        field_indices.push_back(indices);
+        slave_names.push_back(QString::fromStdString(slaves[i]->slave_info.name + " " + std::to_string(slaves[i]->slave_info.slave_number)));
+    }
+    endResetModel();
+}
+
+void SlaveDataModel::setShowUnits(bool show)
+{
+    show_units = show;
+    if (!rows.empty() and !slaves.empty())
+    {
+        emit dataChanged(index(0, 0), index(rows.size() - 1, slaves.size() - 1), QVector<int>() << Qt::DisplayRole);
+    }
+}
+
+void SlaveDataModel::updateData(const ProcessImagePtr &new_image)
+{
+    // the image may belong to a data source which has since been replaced
+    if (new_image->getSlaveCount() != slaves.size())
+    {
+        return;
+    }
+    ProcessImagePtr old_image = image;
+    image = new_image;
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        if (old_image and old_image->getGeneration(i) == image->getGeneration(i))
+        {
+            continue;
+        }
+        // emit one signal per run of consecutive changed rows
+        int first_changed_row = -1;
+        for (int row = 0; row <= rows.size(); row++)
+        {
+            bool changed = row < rows.size() and (!old_image or isFieldChanged(i, row, *old_image));
+            if (changed and first_changed_row < 0)
+            {
+                first_changed_row = row;
+            }
+            else if (!changed and first_changed_row >= 0)
+            {
+                emit dataChanged(index(first_changed_row, i), index(row - 1, i));
+                first_changed_row = -1;
+            }
+        }
+    }
+}
+
+bool SlaveDataModel::isFieldChanged(int slave_idx, int row, const ProcessImage &old_image) const
+{
+    int field_idx = field_indices[slave_idx][row];
+    if (field_idx < 0)
+    {
+        return false;
+    }
+    const FieldLayout &field = rows[row].is_rx ? slaves[slave_idx]->getRxLayout()[field_idx]
+                                               : slaves[slave_idx]->getTxLayout()[field_idx];
+    const uint8_t *new_data = rows[row].is_rx ? image->getRxData(slave_idx) : image->getTxData(slave_idx);
+    const uint8_t *old_data = rows[row].is_rx ? old_image.getRxData(slave_idx) : old_image.getTxData(slave_idx);
+    return std::memcmp(new_data + field.offset, old_data + field.offset, getFieldSize(field.type)) != 0;
+}
+
+int SlaveDataModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int SlaveDataModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : slaves.size();
+}
+
+QVariant SlaveDataModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+    {
+        return QVariant();
+    }
+    int slave_idx = index.column();
+    int row = index.row();
+    int field_idx = field_indices[slave_idx][row];
+    if (field_idx < 0)
+    {
+        return QVariant();
+    }
+    const Row &var = rows[row];
+    if (role == Qt::TextAlignmentRole)
+    {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (!image)
+    {
+        return QVariant();
+    }
+    if (role == Qt::DisplayRole)
+    {
+        const std::string &value = var.is_rx ? value_cache.getRxValue(*image, slave_idx, field_idx)
+                                             : value_cache.getTxValue(*image, slave_idx, field_idx);
+        QString text = QString::fromStdString(value);
+        if (show_units)
+        {
+            const std::string &unit = var.is_rx ? slaves[slave_idx]->getRxUnits()[field_idx]
+                                                : slaves[slave_idx]->getTxUnits()[field_idx];
+            text += QString("%1").arg(QString::fromStdString(unit), 10);
+        }
+        return text;
+    }
+    // tooltips for variables whose bits can be parsed are only generated when they are shown
+    if (role == Qt::ToolTipRole and slaves[slave_idx]->areBitsParsable(var.name))
+    {
+        uint64_t bits = var.is_rx ? slaves[slave_idx]->decodeRxInteger(image->getRxData(slave_idx), field_idx)
+                                  : slaves[slave_idx]->decodeTxInteger(image->getTxData(slave_idx), field_idx);
+        std::vector<std::string> vars, vals;
+        slaves[slave_idx]->parseBits(static_cast<uint16_t>(bits), var.name, vars, vals);
+        std::string tooltip = "";
+        for (int cvar_idx = 0; cvar_idx < vars.size(); cvar_idx++)
+        {
+            tooltip += vars[cvar_idx] + ":\t" + vals[cvar_idx];
+            if (cvar_idx != vars.size() - 1) tooltip += "\n";
+        }
+        return QString::fromStdString(tooltip);
+    }
+    return QVariant();
+}
+
+QVariant SlaveDataModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole)
+    {
+        return QVariant();
+    }
+    if (orientation == Qt::Horizontal)
+    {
+        return slave_names[section];
+    }
+    return QString::fromStdString((rows[section].is_rx ? "RX " : "TX ") + rows[section].name);
+}
@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        const char *category;
+        const char *name;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    // an entry of the ring can be overwritten while the trace file is written
+    struct AtomicTraceEvent
+    {
+        std::atomic<const char*> category;
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> start_ns;
+        std::atomic<uint64_t> end_ns;
+    };
+
+    /**
+     * A ring of the latest events, written only by its thread; count is the
+     * number of events recorded so far and is published with release
+     * semantics so that the writer of the trace file sees complete events
+     */
+    struct ThreadBuffer
+    {
+        int tid;
+        std::string thread_name;
+        std::unique_ptr<AtomicTraceEvent[]> events;
+        uint64_t capacity;
+        std::atomic<uint64_t> count;
+    };
+
+    std::mutex buffers_mutex;
+    // buffers are kept after their thread exits, until the end of the process
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    size_t buffer_capacity = 0;
+    std::chrono::steady_clock::time_point trace_start;
+    bool started = false;
+    thread_local ThreadBuffer *thread_buffer = NULL;
+
+    ThreadBuffer *getThreadBuffer()
+    {
+        if (thread_buffer == NULL)
+        {
+            std::lock_guard<std::mutex> guard(buffers_mutex);
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+            buffer->tid = buffers.size() + 1;
+            buffer->thread_name = "thread " + std::to_string(buffer->tid);
+            buffer->events.reset(new AtomicTraceEvent[buffer_capacity]);
+            buffer->capacity = buffer_capacity;
+            buffer->count = 0;
+            thread_buffer = buffer.get();
+            buffers.push_back(std::move(buffer));
+        }
+        return thread_buffer;
+    }
+}
+
+std::atomic_bool Tracer::enabled(false);
+
+void Tracer::start(size_t events_per_thread)
+{
+    std::lock_guard<std::mutex> guard(buffers_mutex);
+    if (started)
+    {
+        return;
+    }
+    started = true;
+    buffer_capacity = events_per_thread;
+    trace_start = std::chrono::steady_clock::now();
+    enabled = true;
+}
+
+void Tracer::stop()
+{
+    enabled = false;
+}
+
+void Tracer::setThreadName(const std::string &name)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    ThreadBuffer *buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> guard(buffers_mutex);
+    buffer->thread_name = name;
+}
+
+uint64_t Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_start).count();
+}
+
+void Tracer::addEvent(const char *category, const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+    ThreadBuffer *buffer = getThreadBuffer();
+    if (buffer->capacity == 0)
+    {
+        return;
+    }
+    // once the buffer is full, the oldest event is overwritten
+    uint64_t idx = buffer->count.load(std::memory_order_relaxed);
+    AtomicTraceEvent &event = buffer->events[idx % buffer->capacity];
+    // a reader which sees the new values also sees the count of the previous event
+    std::atomic_thread_fence(std::memory_order_release);
+    event.category.store(category, std::memory_order_relaxed);
+    event.name.store(name, std::memory_order_relaxed);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.end_ns.store(end_ns, std::memory_order_relaxed);
+    buffer->count.store(idx + 1, std::memory_order_release);
+}
+
+void Tracer::writeChromeTrace(const std::string &filename, std::string &error)
+{
+    FILE *outfile = std::fopen(filename.c_str(), "w");
+    if (outfile == NULL)
+    {
+        error = "Could not open file " + filename;
+        return;
+    }
+    std::lock_guard<std::mutex> guard(buffers_mutex);
+    std::fprintf(outfile, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (int i = 0; i < buffers.size(); i++)
+    {
+        const ThreadBuffer &buffer = *buffers[i];
+        std::fprintf(outfile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", buffer.tid, buffer.thread_name.c_str());
+        first = false;
+        // the last events of the ring are copied first, since the thread keeps recording
+        uint64_t capacity = buffer.capacity;
+        uint64_t count = buffer.count.load(std::memory_order_acquire);
+        uint64_t first_idx = count > capacity ? count - capacity : 0;
+        std::vector<TraceEvent> events(count - first_idx);
+        for (uint64_t j = first_idx; j < count; j++)
+        {
+            const AtomicTraceEvent &entry = buffer.events[j % capacity];
+            TraceEvent &event = events[j - first_idx];
+            event.category = entry.category.load(std::memory_order_relaxed);
+            event.name = entry.name.load(std::memory_order_relaxed);
+            event.start_ns = entry.start_ns.load(std::memory_order_relaxed);
+            event.end_ns = entry.end_ns.load(std::memory_order_relaxed);
+        }
+        // events which were (or are being) overwritten while they were copied are skipped
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t new_count = buffer.count.load(std::memory_order_relaxed);
+        size_t skipped = 0;
+        if (new_count + 1 > capacity + first_idx)
+        {
+            skipped = std::min<uint64_t>(new_count + 1 - capacity - first_idx, events.size());
+        }
+        for (size_t j = skipped; j < events.size(); j++)
+        {
+            const TraceEvent &event = events[j];
+            // complete events, with timestamps in microseconds
+            std::fprintf(outfile, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                         event.name, event.category, event.start_ns / 1000.0, (event.end_ns - event.start_ns) / 1000.0, buffer.tid);
+        }
+    }
+    std::fprintf(outfile, "\n]}\n");
+    if (std::fclose(outfile) != 0)
+    {
+        error = "Could not write file " + filename;
+    }
+}
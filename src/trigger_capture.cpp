@@ -0,0 +1,653 @@
+/**
+ * Copyright (c) 2021
+ * Hochschule Bonn-Rhein-Sieg
+ *
+ * License: GPLv3
+ */
+
+#include "trigger_capture.h"
+#include "columnar_recording.h"
+#include "process_image.h"
+#include "tracer.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+extern "C" {
+#include "ethercat.h"
+}
+
+namespace
+{
+    const uint32_t WRAP_MARKER = 0xffffffff;
+    const uint64_t OPEN_CAPTURE = std::numeric_limits<uint64_t>::max();
+
+    size_t alignRecord(size_t size)
+    {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    std::string trim(const std::string &text)
+    {
+        size_t start = text.find_first_not_of(" \t");
+        if (start == std::string::npos)
+        {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t");
+        return text.substr(start, end - start + 1);
+    }
+
+    bool parseField(const std::string &name, const std::vector<std::shared_ptr<EthercatSlave>> &slaves, FieldSelector &field, std::string &error)
+    {
+        std::vector<FieldSelector> fields;
+        parseFieldSelectors(name, slaves, fields, error);
+        if (!error.empty() or fields.size() != 1)
+        {
+            if (error.empty())
+            {
+                error = "Invalid field " + name;
+            }
+            return false;
+        }
+        field = fields[0];
+        return true;
+    }
+
+    bool parseCondition(const std::string &condition, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                        TriggerCondition &result, std::string &error)
+    {
+        result.text = condition;
+        result.comparison = TriggerCondition::EQUAL;
+        result.threshold = 0.0;
+        result.mask = 0;
+        result.negate = false;
+        if (condition == "wkc")
+        {
+            result.kind = TriggerCondition::WORKING_COUNTER;
+            return true;
+        }
+
+        std::string text = condition;
+        bool negated = text[0] == '!';
+        if (negated)
+        {
+            text = trim(text.substr(1));
+        }
+        size_t op_pos = text.find_first_of("<>=!&");
+        std::string field_name = trim(text.substr(0, op_pos));
+        if (op_pos == std::string::npos)
+        {
+            // SLAVE.FIELD.BIT
+            result.kind = TriggerCondition::BITS;
+            result.negate = negated;
+            size_t bit_pos = field_name.rfind('.');
+            if (bit_pos == std::string::npos or field_name.find_first_of(" \t") != std::string::npos or !parseField(field_name.substr(0, bit_pos), slaves, result.field, error))
+            {
+                if (error.empty())
+                {
+                    error = "Invalid condition '" + condition + "'";
+                }
+                return false;
+            }
+            uint16_t bit;
+            std::string var_name = result.field.is_rx ? slaves[result.field.slave_idx]->getRxVariables()[result.field.field_idx]
+                                                      : slaves[result.field.slave_idx]->getTxVariables()[result.field.field_idx];
+            if (result.field.type == FIELD_FLOAT or !slaves[result.field.slave_idx]->findBit(var_name, field_name.substr(bit_pos + 1), bit))
+            {
+                error = field_name.substr(bit_pos + 1) + " is not a bit of " + field_name.substr(0, bit_pos);
+                return false;
+            }
+            result.mask = bit;
+            return true;
+        }
+
+        if (!parseField(field_name, slaves, result.field, error))
+        {
+            return false;
+        }
+        std::string op = text.substr(op_pos, 1);
+        if (op_pos + 1 < text.size() and text[op_pos + 1] == '=')
+        {
+            op += "=";
+        }
+        std::string operand = trim(text.substr(op_pos + op.size()));
+        char *end;
+        if (op == "&")
+        {
+            result.kind = TriggerCondition::BITS;
+            result.negate = negated;
+            result.mask = std::strtoull(operand.c_str(), &end, 0);
+            if (result.field.type == FIELD_FLOAT or operand.empty() or *end != '\0')
+            {
+                error = "Invalid bit condition '" + condition + "'";
+                return false;
+            }
+            return true;
+        }
+        result.kind = TriggerCondition::THRESHOLD;
+        result.threshold = std::strtod(operand.c_str(), &end);
+        if (negated or operand.empty() or *end != '\0')
+        {
+            error = "Invalid condition '" + condition + "'";
+            return false;
+        }
+        if (op == "<")
+        {
+            result.comparison = TriggerCondition::LESS;
+        }
+        else if (op == "<=")
+        {
+            result.comparison = TriggerCondition::LESS_EQUAL;
+        }
+        else if (op == ">")
+        {
+            result.comparison = TriggerCondition::GREATER;
+        }
+        else if (op == ">=")
+        {
+            result.comparison = TriggerCondition::GREATER_EQUAL;
+        }
+        else if (op == "==")
+        {
+            result.comparison = TriggerCondition::EQUAL;
+        }
+        else if (op == "!=")
+        {
+            result.comparison = TriggerCondition::NOT_EQUAL;
+        }
+        else
+        {
+            error = "Invalid operator '" + op + "' in condition '" + condition + "'";
+            return false;
+        }
+        return true;
+    }
+}
+
+void parseTriggerConditions(const std::string &conditions, const std::vector<std::shared_ptr<EthercatSlave>> &slaves,
+                            std::vector<TriggerCondition> &result, std::string &error)
+{
+    std::stringstream stream(conditions);
+    std::string condition;
+    while (std::getline(stream, condition, ','))
+    {
+        condition = trim(condition);
+        if (condition.empty())
+        {
+            continue;
+        }
+        TriggerCondition parsed;
+        if (!parseCondition(condition, slaves, parsed, error))
+        {
+            return;
+        }
+        result.push_back(parsed);
+    }
+}
+
+TriggerCapture::TriggerCapture(const TriggerCaptureOptions &options, const std::vector<TriggerCondition> &conditions,
+                               const std::vector<std::shared_ptr<EthercatSlave>> &slaves, MetricsRegistry &metrics)
+    : options(options), conditions(conditions), slaves(slaves),
+      triggers_metric(metrics.getMetric("kddv_trigger_triggers_total", METRIC_COUNTER, "Trigger conditions which became true, and manual triggers")),
+      ignored_triggers_metric(metrics.getMetric("kddv_trigger_ignored_triggers_total", METRIC_COUNTER,
+                                                "Triggers while the previous capture was still being written")),
+      dropped_frames_metric(metrics.getMetric("kddv_trigger_dropped_frames_total", METRIC_COUNTER,
+                                              "Frames which were not captured because the ring buffer was full while a capture was written")),
+      captures_metric(metrics.getMetric("kddv_trigger_captures_total", METRIC_COUNTER, "Captures written after a trigger")),
+      buffered_bytes_metric(metrics.getMetric("kddv_trigger_buffered_bytes", METRIC_GAUGE, "Bytes of frames in the ring buffer of the trigger capture")),
+      condition_states(conditions.size(), false), has_condition_states(false), manual_trigger(false), next_sequence(0),
+      capture_end_time(0), head(0), tail(0), frame_count(0), used_bytes(0), running(false), capturing(false),
+      capture_last_sequence(0), capture_trigger_time(0)
+{
+}
+
+TriggerCapture::~TriggerCapture()
+{
+    stop();
+}
+
+void TriggerCapture::start(std::string &error)
+{
+    if (!options.pcap_filename.empty() and !isCompressionSupported(options.compression))
+    {
+        error = "kddv was built without support for " + getCompressionExtension(options.compression).substr(1) + " compression";
+        return;
+    }
+    std::lock_guard<std::mutex> guard(ring_mutex);
+    if (running)
+    {
+        return;
+    }
+    // the memory is allocated (and touched) up front, so the buffer always fits
+    ring.assign(options.buffer_size, 0);
+    head = 0;
+    tail = 0;
+    frame_count = 0;
+    used_bytes = 0;
+    capturing = false;
+    running = true;
+    writer_thread = std::thread(&TriggerCapture::writeLoop, this);
+}
+
+void TriggerCapture::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(ring_mutex);
+        running = false;
+        if (capturing and capture_last_sequence == OPEN_CAPTURE)
+        {
+            capture_last_sequence = next_sequence - 1;
+        }
+    }
+    ring_condition.notify_one();
+    if (writer_thread.joinable())
+    {
+        writer_thread.join();
+    }
+}
+
+void TriggerCapture::addFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us)
+{
+    std::string reason;
+    bool triggered = checkConditions(frame, size, reason);
+    if (manual_trigger.exchange(false))
+    {
+        triggered = true;
+        reason = "manual trigger";
+    }
+    uint64_t pre_trigger_us = static_cast<uint64_t>(options.pre_trigger_time * 1000000);
+    uint64_t post_trigger_us = static_cast<uint64_t>(options.post_trigger_time * 1000000);
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> guard(ring_mutex);
+        if (!running)
+        {
+            return;
+        }
+        if (capturing and capture_last_sequence == OPEN_CAPTURE and timestamp_us > capture_end_time)
+        {
+            // the post-trigger window ended with the previous frame
+            capture_last_sequence = next_sequence - 1;
+            notify = true;
+        }
+        bool appended = appendFrame(frame, size, timestamp_us);
+        if (!appended)
+        {
+            dropped_frames_metric.add();
+        }
+        if (triggered)
+        {
+            triggers_metric.add();
+            // the frame which triggered the capture is its first post-trigger frame
+            if (!capturing and appended)
+            {
+                capturing = true;
+                capture_last_sequence = OPEN_CAPTURE;
+                capture_end_time = timestamp_us + post_trigger_us;
+                capture_trigger_time = timestamp_us;
+                capture_reason = reason;
+                notify = true;
+            }
+            else if (capturing and capture_last_sequence == OPEN_CAPTURE)
+            {
+                capture_end_time = timestamp_us + post_trigger_us;
+            }
+            else
+            {
+                ignored_triggers_metric.add();
+            }
+        }
+        // while a capture is written, the frames are removed by the writer
+        while (!capturing and frame_count > 1)
+        {
+            size_t position = tail;
+            if (getFrame(position)->timestamp_us + pre_trigger_us >= timestamp_us)
+            {
+                break;
+            }
+            removeOldestFrame();
+        }
+        buffered_bytes_metric.set(used_bytes);
+    }
+    if (notify)
+    {
+        ring_condition.notify_one();
+    }
+}
+
+void TriggerCapture::trigger()
+{
+    manual_trigger = true;
+}
+
+int TriggerCapture::getCaptureCount() const
+{
+    return captures_metric.get();
+}
+
+bool TriggerCapture::checkConditions(const uint8_t *frame, uint32_t size, std::string &reason)
+{
+    EthercatFrame ethercat_frame;
+    if (conditions.empty() or size < ETHERNET_HEADER_SIZE or frame[12] != 0x88 or frame[13] != 0xa4 or
+        !parseEthercatFrame(frame, size, ethercat_frame) or !ethercat_frame.returned or ethercat_frame.command != EC_CMD_LRW)
+    {
+        return false;
+    }
+    bool triggered = false;
+    for (int i = 0; i < conditions.size(); i++)
+    {
+        const TriggerCondition &condition = conditions[i];
+        bool state = condition_states[i];
+        if (condition.kind == TriggerCondition::WORKING_COUNTER)
+        {
+            // each slave gets +3 for read/write, as in PacketSniffer
+            state = ethercat_frame.working_counter != static_cast<int>(slaves.size()) * 3;
+        }
+        else
+        {
+            const EthercatSlave &slave = *slaves[condition.field.slave_idx];
+            int offset = condition.field.is_rx ? slave.slave_info.rx_start_offset : slave.slave_info.tx_start_offset;
+            size_t data_size = condition.field.is_rx ? slave.getRxSize() : slave.getTxSize();
+            // the state is kept if the datagram does not contain the slave's data
+            if (offset + data_size <= ethercat_frame.datagram_size)
+            {
+                const uint8_t *data = ethercat_frame.datagram + offset;
+                if (condition.kind == TriggerCondition::BITS)
+                {
+                    uint64_t value = condition.field.is_rx ? slave.decodeRxInteger(data, condition.field.field_idx)
+                                                           : slave.decodeTxInteger(data, condition.field.field_idx);
+                    state = ((value & condition.mask) != 0) != condition.negate;
+                }
+                else
+                {
+                    double value = condition.field.is_rx ? slave.decodeRxDouble(data, condition.field.field_idx)
+                                                         : slave.decodeTxDouble(data, condition.field.field_idx);
+                    switch (condition.comparison)
+                    {
+                        case TriggerCondition::LESS:
+                            state = value < condition.threshold;
+                            break;
+                        case TriggerCondition::LESS_EQUAL:
+                            state = value <= condition.threshold;
+                            break;
+                        case TriggerCondition::GREATER:
+                            state = value > condition.threshold;
+                            break;
+                        case TriggerCondition::GREATER_EQUAL:
+                            state = value >= condition.threshold;
+                            break;
+                        case TriggerCondition::EQUAL:
+                            state = value == condition.threshold;
+                            break;
+                        case TriggerCondition::NOT_EQUAL:
+                            state = value != condition.threshold;
+                            break;
+                    }
+                }
+            }
+        }
+        // only a change from false to true triggers, so a condition which is already true at the start does not
+        if (state and !condition_states[i] and has_condition_states and !triggered)
+        {
+            triggered = true;
+            reason = condition.text;
+        }
+        condition_states[i] = state;
+    }
+    has_condition_states = true;
+    return triggered;
+}
+
+bool TriggerCapture::appendFrame(const uint8_t *frame, uint32_t size, uint64_t timestamp_us)
+{
+    size_t record_size = alignRecord(sizeof(FrameHeader) + size);
+    if (record_size > ring.size())
+    {
+        return false;
+    }
+    while (true)
+    {
+        size_t position = ring.size();
+        if (frame_count == 0)
+        {
+            head = 0;
+            tail = 0;
+            position = 0;
+        }
+        else if (head > tail)
+        {
+            if (ring.size() - head >= record_size)
+            {
+                position = head;
+            }
+            else if (tail >= record_size)
+            {
+                if (ring.size() - head >= sizeof(FrameHeader))
+                {
+                    reinterpret_cast<FrameHeader*>(&ring[head])->size = WRAP_MARKER;
+                }
+                position = 0;
+            }
+        }
+        else if (head < tail and tail - head >= record_size)
+        {
+            position = head;
+        }
+        if (position != ring.size())
+        {
+            FrameHeader *header = reinterpret_cast<FrameHeader*>(&ring[position]);
+            header->timestamp_us = timestamp_us;
+            header->sequence = next_sequence++;
+            header->size = size;
+            header->padding = 0;
+            std::memcpy(&ring[position + sizeof(FrameHeader)], frame, size);
+            head = position + record_size;
+            frame_count++;
+            used_bytes += record_size;
+            return true;
+        }
+        if (capturing)
+        {
+            return false;
+        }
+        removeOldestFrame();
+    }
+}
+
+const TriggerCapture::FrameHeader* TriggerCapture::getFrame(size_t &position) const
+{
+    if (ring.size() - position < sizeof(FrameHeader) or reinterpret_cast<const FrameHeader*>(&ring[position])->size == WRAP_MARKER)
+    {
+        position = 0;
+    }
+    return reinterpret_cast<const FrameHeader*>(&ring[position]);
+}
+
+void TriggerCapture::removeOldestFrame()
+{
+    const FrameHeader *header = getFrame(tail);
+    size_t record_size = alignRecord(sizeof(FrameHeader) + header->size);
+    tail += record_size;
+    used_bytes -= record_size;
+    frame_count--;
+    if (frame_count == 0)
+    {
+        head = 0;
+        tail = 0;
+    }
+}
+
+void TriggerCapture::writeLoop()
+{
+    Tracer::setThreadName("trigger capture");
+    std::unique_lock<std::mutex> lock(ring_mutex);
+    while (true)
+    {
+        ring_condition.wait(lock, [this] { return !running or capturing; });
+        if (!capturing)
+        {
+            break;
+        }
+        uint64_t trigger_time = capture_trigger_time;
+        std::string reason = capture_reason;
+        lock.unlock();
+        writeCapture(trigger_time, reason);
+        lock.lock();
+    }
+}
+
+void TriggerCapture::writeCapture(uint64_t trigger_time, const std::string &reason)
+{
+    TraceScope trace("record", "TriggerCapture::writeCapture");
+    int capture_number = captures_metric.get() + 1;
+    std::string error;
+    PcapngWriter pcap_writer;
+    std::string pcap_filename;
+    if (!options.pcap_filename.empty())
+    {
+        pcap_filename = getNumberedFilename(options.pcap_filename, capture_number, trigger_time);
+        std::string extension = getCompressionExtension(options.compression);
+        if (pcap_filename.size() < extension.size() or pcap_filename.compare(pcap_filename.size() - extension.size(), extension.size(), extension) != 0)
+        {
+            pcap_filename += extension;
+        }
+        pcap_writer.open(pcap_filename, options.compression, error);
+        if (!error.empty())
+        {
+            std::cerr << error << std::endl;
+            error.clear();
+        }
+    }
+    ColumnarRecorder columnar_recorder;
+    std::string columnar_filename;
+    std::shared_ptr<ProcessImagePool> image_pool = std::make_shared<ProcessImagePool>(slaves);
+    std::shared_ptr<ProcessImage> previous;
+    if (!options.columnar_filename.empty())
+    {
+        columnar_filename = getNumberedFilename(options.columnar_filename, capture_number, trigger_time);
+        columnar_recorder.open(columnar_filename, slaves, error);
+        if (!error.empty())
+        {
+            std::cerr << error << std::endl;
+            error.clear();
+            columnar_filename.clear();
+        }
+    }
+    std::cout << "Triggered by " << reason << ", writing "
+              << (pcap_writer.isOpen() ? pcap_filename + " " : "") << columnar_filename << std::endl;
+
+    uint64_t pre_trigger_us = static_cast<uint64_t>(options.pre_trigger_time * 1000000);
+    uint64_t first_timestamp = trigger_time > pre_trigger_us ? trigger_time - pre_trigger_us : 0;
+    uint64_t written_frames = 0;
+    std::chrono::steady_clock::time_point last_frame_time = std::chrono::steady_clock::now();
+    uint64_t last_sequence_seen = 0;
+    bool done = false;
+    while (!done)
+    {
+        size_t position;
+        size_t available;
+        uint64_t last_sequence;
+        {
+            std::unique_lock<std::mutex> lock(ring_mutex);
+            ring_condition.wait_for(lock, std::chrono::milliseconds(100));
+            // the post-trigger window is also closed if the capture stops, e.g. because the bus failed
+            if (next_sequence != last_sequence_seen)
+            {
+                last_sequence_seen = next_sequence;
+                last_frame_time = std::chrono::steady_clock::now();
+            }
+            else if (capture_last_sequence == OPEN_CAPTURE and std::chrono::steady_clock::now() - last_frame_time > std::chrono::seconds(1))
+            {
+                capture_last_sequence = next_sequence - 1;
+            }
+            position = tail;
+            available = frame_count;
+            last_sequence = capture_last_sequence;
+        }
+
+        // the frames from tail are neither moved nor overwritten while capturing, so they are read without the lock
+        size_t consumed = 0;
+        size_t consumed_bytes = 0;
+        for (size_t i = 0; i < available; i++)
+        {
+            const FrameHeader *header = getFrame(position);
+            if (header->sequence > last_sequence)
+            {
+                done = true;
+                break;
+            }
+            const uint8_t *frame = reinterpret_cast<const uint8_t*>(header) + sizeof(FrameHeader);
+            if (header->timestamp_us >= first_timestamp)
+            {
+                if (pcap_writer.isOpen())
+                {
+                    pcap_writer.writeFrame(frame, header->size, header->timestamp_us, error);
+                    if (!error.empty())
+                    {
+                        std::cerr << error << std::endl;
+                        error.clear();
+                        pcap_writer.close(error);
+                        error.clear();
+                    }
+                }
+                EthercatFrame ethercat_frame;
+                if (!columnar_filename.empty() and header->size >= ETHERNET_HEADER_SIZE and frame[12] == 0x88 and frame[13] == 0xa4 and
+                    parseEthercatFrame(frame, header->size, ethercat_frame) and ethercat_frame.returned and ethercat_frame.command == EC_CMD_LRW)
+                {
+                    std::shared_ptr<ProcessImage> image = image_pool->acquire();
+                    image->sequence = columnar_recorder.getRecordCount();
+                    image->timestamp = header->timestamp_us / 1000000.0;
+                    if (copyFrameData(ethercat_frame, slaves, *image, previous.get()))
+                    {
+                        columnar_recorder.record(*image);
+                        previous = image;
+                    }
+                }
+                written_frames++;
+            }
+            size_t record_size = alignRecord(sizeof(FrameHeader) + header->size);
+            position += record_size;
+            consumed_bytes += record_size;
+            consumed++;
+            if (header->sequence == last_sequence)
+            {
+                done = true;
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(ring_mutex);
+        // the frames that were written make room for new frames
+        tail = position;
+        frame_count -= consumed;
+        used_bytes -= consumed_bytes;
+        if (frame_count == 0)
+        {
+            head = 0;
+            tail = 0;
+        }
+        // frames are appended before the window is closed, so all frames of the capture were written
+        if (frame_count == 0 and capture_last_sequence != OPEN_CAPTURE)
+        {
+            done = true;
+        }
+        if (done)
+        {
+            capturing = false;
+        }
+    }
+
+    pcap_writer.close(error);
+    if (!error.empty())
+    {
+        std::cerr << error << std::endl;
+        error.clear();
+    }
+    columnar_recorder.close();
+    captures_metric.add();
+    std::cout << "Wrote " << written_frames << " frames around " << reason << std::endl;
+}
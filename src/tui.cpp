@@ -6,22 +6,67 @@
  */
 
 #include "tui.h"
+#include "tracer.h"
 #include "ethercat_master.h"
 #include "packet_sniffer.h"
 #include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <limits>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
-TUI::TUI(std::shared_ptr<ZMQPublisher> zmq_pub) : UI(zmq_pub)
+// number of samples shown in a sparkline
+#define SPARKLINE_LENGTH 30
+
+FieldHistory::FieldHistory(int capacity) : values(capacity, 0.0), next(0), count(0)
+{
+}
+
+void FieldHistory::push(double value)
+{
+    values[next] = value;
+    next = (next + 1) % values.size();
+    if (count < values.size())
+    {
+        count++;
+    }
+}
+
+int FieldHistory::size() const
+{
+    return count;
+}
+
+double FieldHistory::at(int i) const
+{
+    return values[(next - count + i + values.size()) % values.size()];
+}
+
+TUI::TUI(std::shared_ptr<ZMQPublisher> zmq_pub) : UI(zmq_pub), wakeup_pending(false), display_rate(20.0), frames_displayed_metric(NULL)
 {
     enable_zmq = false;
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     setupWindow();
     selected_slave = 0;
+    selected_field = 0;
+    overview_mode = false;
+    detail_scroll = 0;
+    overview_scroll = 0;
+    layout_dirty = true;
+    displayed_sequence = 0;
 }
 
 TUI::~TUI()
 {
+    // stop the data source and its subscriber threads before the members they use are destroyed
+    ecat_data_source.reset();
     delwin(main_window);
     delwin(status_window);
     endwin();
+    close(wakeup_fd);
 }
 
 void TUI::setupWindow()
@@ -40,7 +85,7 @@ void TUI::setupWindow()
     main_window = newwin(screen_rows - 1, screen_cols, 0, 0);
     wrefresh(main_window);
 
-    std::string msg = "Quit: q, Left: <, Right: >";
+    std::string msg = "q: quit, </>: slave, ^/v: select, space: plot, o: overview, p/n/+/-: replay";
     instructions_window = newwin(1, msg.size(), screen_rows - 1, screen_cols - msg.size());
     mvwprintw(instructions_window, 0, 0, msg.c_str());
     wrefresh(instructions_window);
@@ -76,7 +121,204 @@ void TUI::enableZMQ(bool enable)
     enable_zmq = enable;
 }
 
-void TUI::dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves)
+void TUI::setReplaySpeed(double speed)
+{
+    replay_speed = speed;
+}
+
+void TUI::setTimeRange(double start_time, double end_time)
+{
+    replay_start_time = start_time;
+    replay_end_time = end_time;
+}
+
+void TUI::setDisplayRate(double rate)
+{
+    if (rate > 0.0)
+    {
+        display_rate = rate;
+    }
+}
+
+void TUI::dataCallback(const ProcessImagePtr &image)
+{
+    TraceScope trace("ui", "TUI::dataCallback");
+    // called from the data source's thread, so only hand over the image and wake up the main thread
+    std::atomic_store(&latest_image, image);
+    if (!wakeup_pending.exchange(true))
+    {
+        uint64_t count = 1;
+        ssize_t ret = write(wakeup_fd, &count, sizeof(count));
+        (void)ret;
+    }
+}
+
+void TUI::setupOverview()
+{
+    overview_lines.clear();
+    overview_fields.clear();
+    histories.clear();
+    for (int i = 0; i < slaves.size(); i++)
+    {
+        if (i == 0 or slaves[i]->slave_info.slave_type != slaves[i-1]->slave_info.slave_type)
+        {
+            OverviewLine header = {true, i};
+            overview_lines.push_back(header);
+        }
+        OverviewLine line = {false, i};
+        overview_lines.push_back(line);
+
+        const std::vector<std::string> &tx_vars = slaves[i]->getTxVariables();
+        const std::vector<std::string> &overview_vars = slaves[i]->getOverviewVariables();
+        std::vector<int> fields;
+        for (int k = 0; k < overview_vars.size(); k++)
+        {
+            std::vector<std::string>::const_iterator it = std::find(tx_vars.begin(), tx_vars.end(), overview_vars[k]);
+            fields.push_back(it == tx_vars.end() ? -1 : it - tx_vars.begin());
+        }
+        overview_fields.push_back(fields);
+    }
+}
+
+void TUI::handleKey(int input)
+{
+    if (handleReplayKey(input))
+    {
+        writeMetricsStatus();
+        return;
+    }
+    if (input == 'o')
+    {
+        overview_mode = !overview_mode;
+    }
+    else if (input == KEY_LEFT or (overview_mode and input == KEY_UP))
+    {
+        selected_slave -= 1;
+        selected_field = 0;
+        detail_scroll = 0;
+    }
+    else if (input == KEY_RIGHT or (overview_mode and input == KEY_DOWN))
+    {
+        selected_slave += 1;
+        selected_field = 0;
+        detail_scroll = 0;
+    }
+    else if (input == KEY_UP)
+    {
+        selected_field -= 1;
+    }
+    else if (input == KEY_DOWN)
+    {
+        selected_field += 1;
+    }
+    else if (input == ' ' and !overview_mode)
+    {
+        // toggle the sparkline of the field under the cursor
+        std::pair<int, int> key(selected_slave, selected_field);
+        if (histories.find(key) != histories.end())
+        {
+            histories.erase(key);
+        }
+        else
+        {
+            histories.insert(std::make_pair(key, FieldHistory(SPARKLINE_LENGTH)));
+        }
+    }
+    else
+    {
+        return;
+    }
+    layout_dirty = true;
+}
+
+bool TUI::handleReplayKey(int input)
+{
+    PacketSniffer *replay = dynamic_cast<PacketSniffer*>(ecat_data_source.get());
+    if (replay == NULL or !replay->isReplay())
+    {
+        return false;
+    }
+    if (input == 'p')
+    {
+        replay->setPaused(!replay->isPaused());
+    }
+    else if (input == 'n')
+    {
+        replay->step();
+    }
+    else if (input == '+' or input == '-')
+    {
+        // the next faster or slower speed of the list, also if the current speed is not in it
+        auto effective_speed = [](double speed) { return speed > 0.0 ? speed : std::numeric_limits<double>::infinity(); };
+        double current = effective_speed(replay_speed);
+        int next_idx = -1;
+        for (int i = 0; i < REPLAY_SPEED_COUNT; i++)
+        {
+            double speed = effective_speed(REPLAY_SPEEDS[i]);
+            if ((input == '+' ? speed > current : speed < current) and
+                (next_idx < 0 or (input == '+') == (speed < effective_speed(REPLAY_SPEEDS[next_idx]))))
+            {
+                next_idx = i;
+            }
+        }
+        if (next_idx < 0)
+        {
+            return true;
+        }
+        replay_speed = REPLAY_SPEEDS[next_idx];
+        replay->setReplaySpeed(replay_speed);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void TUI::drawData()
+{
+    TraceScope trace("render", "TUI::drawData");
+    ProcessImagePtr image = std::atomic_load(&latest_image);
+    if (!image or image->getSlaveCount() != slaves.size() or slaves.empty())
+    {
+        return;
+    }
+    bool new_image = image->sequence != displayed_sequence;
+    if (!new_image and !layout_dirty)
+    {
+        return;
+    }
+    if (new_image)
+    {
+        displayed_sequence = image->sequence;
+        for (std::map<std::pair<int, int>, FieldHistory>::iterator it = histories.begin(); it != histories.end(); ++it)
+        {
+            int slave_idx = it->first.first;
+            it->second.push(slaves[slave_idx]->decodeTxDouble(image->getTxData(slave_idx), it->first.second));
+        }
+    }
+    if (layout_dirty)
+    {
+        drawLayout();
+        layout_dirty = false;
+    }
+    if (new_image and frames_displayed_metric)
+    {
+        frames_displayed_metric->add();
+    }
+    // only values whose text changed are rewritten
+    if (overview_mode)
+    {
+        drawOverviewValues(*image);
+    }
+    else
+    {
+        drawDetailValues(*image);
+    }
+    wrefresh(main_window);
+}
+
+void TUI::drawLayout()
 {
     if (selected_slave < 0)
     {
@@ -86,8 +328,58 @@ void TUI::dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves
     {
         selected_slave = slaves.size() - 1;
     }
+    int tx_count = slaves[selected_slave]->getTxVariables().size();
+    if (selected_field >= tx_count)
+    {
+        selected_field = tx_count - 1;
+    }
+    if (selected_field < 0)
+    {
+        selected_field = 0;
+    }
+
+    // scroll so that the selection is visible
+    int rows = getmaxy(main_window);
+    if (selected_field < detail_scroll)
+    {
+        detail_scroll = selected_field;
+    }
+    if (selected_field >= detail_scroll + rows - 2)
+    {
+        detail_scroll = selected_field - (rows - 2) + 1;
+    }
+    for (int i = 0; i < overview_lines.size(); i++)
+    {
+        if (!overview_lines[i].is_header and overview_lines[i].slave_idx == selected_slave)
+        {
+            // also show the header of the first slave of a group
+            int first_line = overview_lines[i-1].is_header ? i - 1 : i;
+            if (first_line < overview_scroll)
+            {
+                overview_scroll = first_line;
+            }
+            if (i >= overview_scroll + rows)
+            {
+                overview_scroll = i - rows + 1;
+            }
+            break;
+        }
+    }
+
     werase(main_window);
+    drawn_cells.clear();
+    if (overview_mode)
+    {
+        drawOverviewLayout();
+    }
+    else
+    {
+        drawDetailLayout();
+    }
+}
 
+void TUI::drawDetailLayout()
+{
     int width_per_column = 40;
     // heading line
     mvwhline(main_window, 1, 0, ACS_HLINE, 20 * slaves.size());
@@ -105,33 +397,179 @@ void TUI::dataCallback(const std::vector<std::shared_ptr<EthercatSlave>> &slaves
             wattroff(main_window, A_STANDOUT);
         }
     }
-    // display data for selected slave
+    // visible variable names of the selected slave
     const std::vector<std::string> &rx_vars = slaves[selected_slave]->getRxVariables();
     const std::vector<std::string> &tx_vars = slaves[selected_slave]->getTxVariables();
-    std::vector<std::string> rx_vals = slaves[selected_slave]->getRxValues();
-    std::vector<std::string> tx_vals = slaves[selected_slave]->getTxValues();
-    for (int j = 0; j < rx_vars.size(); j++)
+    int rows = getmaxy(main_window) - 2;
+    for (int line = 0; line < rows; line++)
     {
-        int length = rx_vals[j].length();
-        int rx_end = width_per_column - 4;
-        int val_start = rx_end - length;
-        mvwprintw(main_window, j+2, 0, rx_vars[j].c_str());
-        mvwprintw(main_window, j+2, val_start, rx_vals[j].c_str());
+        int j = line + detail_scroll;
+        if (j < rx_vars.size())
+        {
+            mvwprintw(main_window, line+2, 0, rx_vars[j].c_str());
+        }
+        if (j < tx_vars.size())
+        {
+            if (j == selected_field)
+            {
+                wattron(main_window, A_REVERSE);
+            }
+            mvwprintw(main_window, line+2, width_per_column, tx_vars[j].c_str());
+            if (j == selected_field)
+            {
+                wattroff(main_window, A_REVERSE);
+            }
+        }
+    }
+    // vertical lines to separate rx and tx
+    int line_count = std::min(rows, static_cast<int>(std::max(rx_vars.size(), tx_vars.size())) - detail_scroll);
+    mvwvline(main_window, 2, width_per_column - 2, ACS_VLINE, line_count);
+    mvwvline(main_window, 2, (2 * width_per_column) - 2, ACS_VLINE, line_count);
+}
+
+void TUI::drawOverviewLayout()
+{
+    int name_width = 16;
+    int column_width = 14;
+    int rows = getmaxy(main_window);
+    for (int line = 0; line < rows and line + overview_scroll < overview_lines.size(); line++)
+    {
+        const OverviewLine &overview_line = overview_lines[line + overview_scroll];
+        const EthercatSlave &slave = *slaves[overview_line.slave_idx];
+        if (overview_line.is_header)
+        {
+            // names of the overview variables of this slave type, right-aligned above the values
+            wattron(main_window, A_BOLD);
+            mvwprintw(main_window, line, 0, slave.slave_info.name.c_str());
+            const std::vector<std::string> &overview_vars = slave.getOverviewVariables();
+            for (int k = 0; k < overview_vars.size(); k++)
+            {
+                std::string var = overview_vars[k].substr(0, column_width - 2);
+                int end_col = name_width + (k + 1) * column_width;
+                if (end_col <= getmaxx(main_window))
+                {
+                    mvwprintw(main_window, line, end_col - var.length(), var.c_str());
+                }
+            }
+            wattroff(main_window, A_BOLD);
+        }
+        else
+        {
+            std::string name = slave.slave_info.name + " " + std::to_string(slave.slave_info.slave_number);
+            if (overview_line.slave_idx == selected_slave)
+            {
+                wattron(main_window, A_STANDOUT);
+            }
+            mvwprintw(main_window, line, 0, name.c_str());
+            if (overview_line.slave_idx == selected_slave)
+            {
+                wattroff(main_window, A_STANDOUT);
+            }
+        }
     }
-    for (int j = 0; j < tx_vars.size(); j++)
+}
+
+void TUI::drawDetailValues(const ProcessImage &image)
+{
+    int width_per_column = 40;
+    int rx_count = slaves[selected_slave]->getRxVariables().size();
+    int tx_count = slaves[selected_slave]->getTxVariables().size();
+    int rows = getmaxy(main_window) - 2;
+    for (int line = 0; line < rows; line++)
     {
-        int length = tx_vals[j].length();
-        int tx_end = (width_per_column * 2) - 4;
-        int val_start = tx_end - length;
-        int var_start = width_per_column;
-        mvwprintw(main_window, j+2, var_start, tx_vars[j].c_str());
-        mvwprintw(main_window, j+2, val_start, tx_vals[j].c_str());
+        int j = line + detail_scroll;
+        if (j < rx_count)
+        {
+            drawValue(line+2, width_per_column - 4, value_cache.getRxValue(image, selected_slave, j));
+        }
+        if (j < tx_count)
+        {
+            drawValue(line+2, (width_per_column * 2) - 4, value_cache.getTxValue(image, selected_slave, j));
+            std::map<std::pair<int, int>, FieldHistory>::const_iterator it = histories.find(std::make_pair(selected_slave, j));
+            if (it != histories.end())
+            {
+                drawSparkline(line+2, width_per_column * 2, it->second);
+            }
+        }
     }
-    // vertical lines to separate rx and tx
-    mvwvline(main_window, 2, width_per_column - 2, ACS_VLINE, tx_vars.size());
-    mvwvline(main_window, 2, (2 * width_per_column) - 2, ACS_VLINE, tx_vars.size());
+}
 
-    wrefresh(main_window);
+void TUI::drawOverviewValues(const ProcessImage &image)
+{
+    int name_width = 16;
+    int column_width = 14;
+    int rows = getmaxy(main_window);
+    for (int line = 0; line < rows and line + overview_scroll < overview_lines.size(); line++)
+    {
+        const OverviewLine &overview_line = overview_lines[line + overview_scroll];
+        if (overview_line.is_header)
+        {
+            continue;
+        }
+        const std::vector<int> &fields = overview_fields[overview_line.slave_idx];
+        for (int k = 0; k < fields.size(); k++)
+        {
+            if (fields[k] >= 0)
+            {
+                drawValue(line, name_width + (k + 1) * column_width,
+                          value_cache.getTxValue(image, overview_line.slave_idx, fields[k]));
+            }
+        }
+    }
+}
+
+void TUI::drawValue(int row, int end_col, const std::string &value)
+{
+    if (end_col > getmaxx(main_window))
+    {
+        return;
+    }
+    std::string &drawn = drawn_cells[std::make_pair(row, end_col)];
+    if (drawn == value)
+    {
+        return;
+    }
+    // right-aligned, and padded to the previous length so that a shorter value overwrites a longer one
+    int width = std::min(static_cast<int>(std::max(value.length(), drawn.length())), end_col);
+    mvwprintw(main_window, row, end_col - width, "%*s", width, value.c_str());
+    drawn = value;
+}
+
+void TUI::drawSparkline(int row, int col, const FieldHistory &history)
+{
+    int length = std::min(SPARKLINE_LENGTH, getmaxx(main_window) - col);
+    if (length <= 0 or history.size() == 0)
+    {
+        return;
+    }
+    // scaled to the range of the visible samples, newest on the right
+    static const char levels[] = "_.-~=+*#";
+    int level_count = sizeof(levels) - 1;
+    int first = std::max(0, history.size() - length);
+    double min_val = history.at(first);
+    double max_val = history.at(first);
+    for (int i = first; i < history.size(); i++)
+    {
+        min_val = std::min(min_val, history.at(i));
+        max_val = std::max(max_val, history.at(i));
+    }
+    std::string sparkline(length, ' ');
+    for (int i = first; i < history.size(); i++)
+    {
+        int level = level_count / 2;
+        if (max_val > min_val)
+        {
+            level = static_cast<int>((history.at(i) - min_val) / (max_val - min_val) * (level_count - 1) + 0.5);
+        }
+        sparkline[length - (history.size() - i)] = levels[level];
+    }
+    std::string &drawn = drawn_cells[std::make_pair(row, col)];
+    if (drawn == sparkline)
+    {
+        return;
+    }
+    mvwprintw(main_window, row, col, "%s", sparkline.c_str());
+    drawn = sparkline;
 }
 
 void TUI::start()
@@ -192,6 +630,8 @@ void TUI::start()
             }
             else
             {
+                std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setReplaySpeed(replay_speed);
+                std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setTimeRange(replay_start_time, replay_end_time);
                 std::static_pointer_cast<PacketSniffer>(ecat_data_source)->setConfigFile(config_file_name, error_msg);
                 if (!error_msg.empty())
                 {
@@ -205,10 +645,11 @@ void TUI::start()
     if (!error)
     {
         ecat_data_source->setZMQPublish(enable_zmq);
-        ecat_data_source->setDataCallback(&UI::dataCallback, this);
 
         std::string error_msg;
-        std::vector<std::shared_ptr<EthercatSlave>> slaves = ecat_data_source->getSlaves(error_msg);
+        slaves = ecat_data_source->getSlaves(error_msg);
+        value_cache.setSlaves(slaves);
+        setupOverview();
         if (!error_msg.empty())
         {
             writeStatus(error_msg);
@@ -219,7 +660,10 @@ void TUI::start()
         {
             std::string msg = "Found " + std::to_string(slaves.size()) + " slaves";
             writeStatus(msg);
-            ecat_data_source->setDataCallback(&UI::dataCallback, this);
+            // the callback only hands over the latest image, so a queue of one is enough
+            ecat_data_source->getDataBus().subscribe("tui", std::bind(&UI::dataCallback, this, std::placeholders::_1), SubscriberOptions());
+            frames_displayed_metric = &ecat_data_source->getMetrics().getMetric("kddv_ui_frames_displayed_total", METRIC_COUNTER,
+                                                                                "Frames displayed by the UI", "ui=\"tui\"");
             std::this_thread::sleep_for(std::chrono::milliseconds(50));
 
             ecat_data_source->start(error_msg);
@@ -232,28 +676,15 @@ void TUI::start()
             else
             {
                 // wait here until finish
-                while (true)
-                {
-                    int input = getch();
-                    if (input == 'q')
-                    {
-                        break;
-                    }
-                    if (input == KEY_LEFT)
-                    {
-                        selected_slave -= 1;
-                    }
-                    else if (input == KEY_RIGHT)
-                    {
-                        selected_slave += 1;
-                    }
-                }
+                runEventLoop();
                 ecat_data_source->stop();
             }
         }
     }
     if (error)
     {
+        // block until a key is pressed
+        timeout(-1);
         while (true)
         {
             int input = getch();
@@ -265,8 +696,94 @@ void TUI::start()
     }
 }
 
+void TUI::runEventLoop()
+{
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeup_fd;
+    fds[1].events = POLLIN;
+
+    std::chrono::steady_clock::duration frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / display_rate));
+    std::chrono::steady_clock::time_point next_frame = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_status = next_frame + std::chrono::seconds(1);
+    bool redraw_pending = false;
+
+    while (true)
+    {
+        // sleep until there is input or new data, or until the next frame if a redraw is pending;
+        // the metrics in the status line are updated every second
+        std::chrono::steady_clock::time_point wakeup_time = redraw_pending ? std::min(next_frame, next_status) : next_status;
+        std::chrono::steady_clock::duration remaining = wakeup_time - std::chrono::steady_clock::now();
+        int timeout_ms = std::max(0, static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count()));
+        int ret = poll(fds, 2, timeout_ms);
+        if (ret < 0 and errno != EINTR)
+        {
+            break;
+        }
+        if (ret > 0 and (fds[1].revents & POLLIN))
+        {
+            uint64_t count;
+            ssize_t bytes_read = read(wakeup_fd, &count, sizeof(count));
+            (void)bytes_read;
+            wakeup_pending = false;
+            redraw_pending = true;
+        }
+        if (ret > 0 and (fds[0].revents & POLLIN))
+        {
+            int input;
+            while ((input = getch()) != ERR)
+            {
+                if (input == 'q')
+                {
+                    return;
+                }
+                handleKey(input);
+                redraw_pending = true;
+            }
+        }
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= next_status)
+        {
+            writeMetricsStatus();
+            next_status = now + std::chrono::seconds(1);
+        }
+        if (redraw_pending and now >= next_frame)
+        {
+            drawData();
+            redraw_pending = false;
+            // frames stay on a fixed grid while data keeps arriving
+            next_frame += frame_interval;
+            if (next_frame <= now)
+            {
+                next_frame = now + frame_interval;
+            }
+        }
+    }
+}
+
 void TUI::writeStatus(const std::string &msg)
 {
     mvwprintw(status_window, 0, 0, msg.c_str());
     wrefresh(status_window);
 }
+
+void TUI::writeMetricsStatus()
+{
+    if (!ecat_data_source)
+    {
+        return;
+    }
+    werase(status_window);
+    std::string msg = ecat_data_source->getMetricsSummary();
+    PacketSniffer *replay = dynamic_cast<PacketSniffer*>(ecat_data_source.get());
+    if (replay != NULL and replay->isReplay())
+    {
+        msg = "[" + (replay->isPaused() ? std::string("paused") : formatReplaySpeed(replay_speed)) + "] " + msg;
+    }
+    // truncated to the width of the status window, since it would scroll otherwise
+    msg = msg.substr(0, getmaxx(status_window) - 1);
+    mvwprintw(status_window, 0, 0, msg.c_str());
+    wrefresh(status_window);
+}
@@ -6,6 +6,7 @@
  */
 
 #include "zmq_publisher.h"
+#include "tracer.h"
 #include <iostream>
 
 
@@ -21,9 +22,13 @@ ZMQPublisher::~ZMQPublisher()
     ctx.close();
 }
 
-void ZMQPublisher::publishMsg(const std::string &json_string)
+bool ZMQPublisher::publishMsg(const std::string &json_string)
 {
+    TraceScope trace("publish", "ZMQPublisher::publishMsg");
     zmq::message_t message(json_string.length());
     std::memcpy(message.data(), json_string.c_str(), json_string.length());
-    publisher.send(message, zmq::send_flags::dontwait);
+    // ZMQ sockets must not be used from several threads at the same time
+    std::lock_guard<std::mutex> guard(publisher_mutex);
+    zmq::send_result_t result = publisher.send(message, zmq::send_flags::dontwait);
+    return result.has_value();
 }